@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <string.h>
+
+#include "bussim.h"
+#include "dataset.h"
+#include "devset.h"
+#include "generate.h"
+#include "crc8.h"
+#include "config.h"
+
+static const char *outFile_pG = NULL;
+static const char *inFile_pG = NULL;
+static bool toText_G = false;
+static bool generate_G = false;
+static bool checkCrc_G = false;
+static GenParams_t genParams_G;
+
+static int process_cmdline_args (int argc, char *argv[]);
+static int to_text (void);
+static int to_dataset (void);
+static int generate (void);
+static int check_crc (void);
+
+int
+main (int argc, char *argv[])
+{
+	int ret;
+
+	ret = process_cmdline_args(argc, argv);
+	if (ret != 0)
+		return 1;
+
+	if (generate_G)
+		ret = generate();
+	else if (checkCrc_G)
+		ret = check_crc();
+	else if (toText_G)
+		ret = to_text();
+	else
+		ret = to_dataset();
+	return (ret == 0)? 0 : 1;
+}
+
+/**
+ * text data file (tester format) → binary dataset
+ */
+static int
+to_dataset (void)
+{
+	int ret, bitSize;
+	uint64_t *ids_p, *alarms_p;
+	size_t count, numAlarms;
+
+	ret = bussim_load_file(inFile_pG, &ids_p, &count, &bitSize, &alarms_p, &numAlarms);
+	if (ret != 0)
+		return -1;
+	ret = dataset_write(outFile_pG, ids_p, count, bitSize, alarms_p, numAlarms);
+	free(ids_p);
+	free(alarms_p);
+	return ret;
+}
+
+/**
+ * write IDs in the text format, to outFile_pG or stdout
+ * the alarms must be a subset of the IDs, both in the same order
+ */
+static int
+write_text (const uint64_t *ids_p, size_t count, int bitSize, const uint64_t *alarms_p, size_t numAlarms)
+{
+	int ret;
+	size_t i, alarm;
+	FILE *out_p;
+
+	if (outFile_pG == NULL)
+		out_p = stdout;
+	else {
+		out_p = fopen(outFile_pG, "w");
+		if (out_p == NULL) {
+			perror("open text file");
+			return -1;
+		}
+	}
+
+	fprintf(out_p, "%zu\n%d\n", count, bitSize);
+	alarm = 0;
+	for (i=0; i<count; ++i) {
+		if ((alarm < numAlarms) && (alarms_p[alarm] == ids_p[i])) {
+			fprintf(out_p, "%"PRIu64" A\n", ids_p[i]);
+			++alarm;
+		}
+		else
+			fprintf(out_p, "%"PRIu64"\n", ids_p[i]);
+	}
+
+	ret = 0;
+	if ((out_p != stdout) && (fclose(out_p) != 0)) {
+		perror("write text file");
+		ret = -1;
+	}
+	return ret;
+}
+
+/**
+ * binary dataset → text data file (tester format)
+ */
+static int
+to_text (void)
+{
+	int ret;
+	Dataset_t dataset;
+
+	ret = dataset_map(inFile_pG, &dataset);
+	if (ret == 1)
+		printf("%s is not a binary dataset\n", inFile_pG);
+	if (ret != 0)
+		return -1;
+
+	// both lists are in search order, so the alarms merge in one pass
+	ret = write_text(dataset.ids_p, dataset.count, dataset.bitSize, dataset.alarms_p, dataset.numAlarms);
+	dataset_unmap(&dataset);
+	return ret;
+}
+
+/**
+ * a new population (see generate.h), as a dataset or text
+ */
+static int
+generate (void)
+{
+	int ret;
+	uint64_t *ids_p;
+
+	ret = generate_ids(&genParams_G, &ids_p);
+	if (ret != 0)
+		return -1;
+	if (toText_G)
+		ret = write_text(ids_p, genParams_G.count, genParams_G.bitSize, NULL, 0);
+	else
+		ret = dataset_write(outFile_pG, ids_p, genParams_G.count, genParams_G.bitSize, NULL, 0);
+	free(ids_p);
+	return ret;
+}
+
+/**
+ * check the CRC8 of every ID in a text file or dataset, list the bad ones
+ */
+static int
+check_crc (void)
+{
+	int ret, bitSize, fnRtn = -1;
+	uint64_t *ids_p = NULL, *alarms_p = NULL;
+	const uint64_t *check_p;
+	size_t i, count, numAlarms, good;
+	uint8_t *valid_p = NULL;
+	Dataset_t dataset;
+	bool mapped = false;
+
+	ret = dataset_map(inFile_pG, &dataset);
+	if (ret == 0) {
+		mapped = true;
+		check_p = dataset.ids_p;
+		count = dataset.count;
+		bitSize = dataset.bitSize;
+	}
+	else if (ret == 1) {
+		ret = bussim_load_file(inFile_pG, &ids_p, &count, &bitSize, &alarms_p, &numAlarms);
+		if (ret != 0)
+			return -1;
+		check_p = ids_p;
+	}
+	else
+		return -1;
+
+	if (bitSize != CRC8_ROM_BITS) {
+		printf("%s holds %d-bit IDs, only %d-bit IDs have a CRC8\n", inFile_pG, bitSize, CRC8_ROM_BITS);
+		goto cleanup;
+	}
+	valid_p = (uint8_t*)malloc(count? count : 1);
+	if (valid_p == NULL) {
+		printf("can't allocate memory\n");
+		goto cleanup;
+	}
+
+	good = crc8_rom_check(check_p, count, valid_p);
+	for (i=0; i<count; ++i)
+		if (!valid_p[i])
+			printf("bad CRC8: 0x%016"PRIx64" (0x%02x, should be 0x%02x)\n", check_p[i],
+					(unsigned)(check_p[i] >> 56), (unsigned)(crc8_rom_fix(check_p[i]) >> 56));
+	printf("%zu of %zu IDs good (%s)\n", good, count, crc8_kernel_name());
+	fnRtn = (good == count)? 0 : -1;
+
+cleanup:
+	free(valid_p);
+	if (mapped)
+		dataset_unmap(&dataset);
+	free(ids_p);
+	free(alarms_p);
+	return fnRtn;
+}
+
+static void
+usage (const char *cmdline_p)
+{
+	if (cmdline_p == NULL) {
+		printf("bad usage\n");
+		return;
+	}
+
+	printf("usage: %s [<options>] <infile>\n", cmdline_p);
+	printf("       %s -g <d> [<options>]\n", cmdline_p);
+	printf("  where:\n");
+	printf("    <infile>                a tester data file to convert to a binary dataset\n");
+	printf("                            (or, with -T, a binary dataset to convert to text)\n");
+	printf("    <options>\n");
+	printf("      -h|--help             print information about this program and exit successfully\n");
+	printf("      -o|--output <file>    write the result to <file> (required unless -T, where\n");
+	printf("                            the default is stdout)\n");
+	printf("      -T|--to-text          convert a binary dataset back to the text format\n");
+	printf("      -C|--check-crc        check the CRC8 of every (64-bit) ID in <infile>, text or\n");
+	printf("                            dataset, and list the bad ones\n");
+	printf("      -g|--generate <d>     generate a population instead, with the IDs spread by <d>:\n");
+	printf("                              uniform  every bit random\n");
+	printf("                              family   a few family codes in the low %d bits\n", GEN_FAMILY_BITS);
+	printf("                              prefix   the low bits (searched first) shared by all\n");
+	printf("                              allfork  the low bits count up, every fork taken\n");
+	printf("      -n|--count <n>        generate <n> devices (default: 8)\n");
+	printf("      -b|--bitsize <b>      generate <b>-bit IDs (MIN:1 default:8 MAX:64)\n");
+	printf("      -s|--seed <s>         generate from seed <s> (default: 0), the same seed and\n");
+	printf("                            options always give the same devices\n");
+	printf("      -f|--families <f>     use <f> family codes with -g family (default: %d)\n", GEN_DEFAULT_FAMILIES);
+	printf("      -P|--prefix-bits <p>  share <p> bits with -g prefix (default: half the ID)\n");
+	printf("      -c|--crc              generate real 1-Wire IDs: the top byte the CRC8 of the\n");
+	printf("                            rest (needs -b 64)\n");
+}
+
+static int
+process_cmdline_args (int argc, char *argv[])
+{
+	int c;
+	char *end_p;
+	unsigned long long val;
+	struct option longOpts[] = {
+		{"help", no_argument, NULL, 'h'},
+		{"output", required_argument, NULL, 'o'},
+		{"to-text", no_argument, NULL, 'T'},
+		{"generate", required_argument, NULL, 'g'},
+		{"count", required_argument, NULL, 'n'},
+		{"bitsize", required_argument, NULL, 'b'},
+		{"seed", required_argument, NULL, 's'},
+		{"families", required_argument, NULL, 'f'},
+		{"prefix-bits", required_argument, NULL, 'P'},
+		{"crc", no_argument, NULL, 'c'},
+		{"check-crc", no_argument, NULL, 'C'},
+		{NULL, 0, NULL, 0},
+	};
+
+	generate_defaults(&genParams_G);
+	while (1) {
+		c = getopt_long(argc, argv, "ho:Tg:n:b:s:f:P:cC", longOpts, 0);
+		if (c == -1)
+			break;
+		switch (c) {
+			case 'h':
+				printf("%s\n", PACKAGE_STRING);
+				usage(argv[0]);
+				exit(0);
+
+			case 'o':
+				outFile_pG = optarg;
+				break;
+
+			case 'T':
+				toText_G = true;
+				break;
+
+			case 'g':
+				if (generate_parse_distribution(optarg, &genParams_G.distribution) != 0) {
+					usage(argv[0]);
+					return -1;
+				}
+				generate_G = true;
+				break;
+
+			case 'c':
+				genParams_G.crc = true;
+				break;
+
+			case 'C':
+				checkCrc_G = true;
+				break;
+
+			case 'n':
+			case 'b':
+			case 's':
+			case 'f':
+			case 'P':
+				val = strtoull(optarg, &end_p, 0);
+				if ((*optarg == '\0') || (*optarg == '-') || (*end_p != '\0')) {
+					usage(argv[0]);
+					return -1;
+				}
+				if (c == 'n')
+					genParams_G.count = (size_t)val;
+				else if (c == 's')
+					genParams_G.seed = val;
+				else if (val > 256) {
+					usage(argv[0]);
+					return -1;
+				}
+				else if (c == 'b')
+					genParams_G.bitSize = (int)val;
+				else if (c == 'f')
+					genParams_G.families = (unsigned)val;
+				else
+					genParams_G.prefixBits = (int)val;
+				break;
+
+			default:
+				printf("cmdline arg error: %c (0x%02x)\n", c, c);
+				usage(argv[0]);
+				return -1;
+		}
+	}
+
+	if (argc != (optind + (generate_G? 0 : 1))) {
+		usage(argv[0]);
+		return -1;
+	}
+	if (!generate_G)
+		inFile_pG = argv[optind];
+	else if ((genParams_G.count < 1) || (genParams_G.bitSize < 1) || (genParams_G.bitSize > 64)) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	if (!toText_G && !checkCrc_G && (outFile_pG == NULL)) {
+		printf("the binary dataset needs an output file (-o)\n");
+		usage(argv[0]);
+		return -1;
+	}
+
+	return 0;
+}
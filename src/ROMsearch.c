@@ -9,262 +9,1108 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <signal.h>
 #include <poll.h>
+#include <errno.h>
 #include <unistd.h>
 #include "common.h"
+#include "transport.h"
+#include "search.h"
+#include "bussim.h"
+#include "crc8.h"
+#include "config.h"
 
-static int toTesterFifoFd_G, fmTesterFifoFd_G;
-static DeviceNode_t *listHead_pG = NULL;
+static TransportType_e transportType_G = TRANSPORT_FIFO;
+static bool busyPoll_G = false;
+static bool pipelineReplay_G = true;
+static bool overdrive_G = false;
+static bool alarmOnly_G = false;
+static uint64_t patternValue_G = 0;
+static uint64_t patternMask_G = 0;
+static SearchEngine_e engine_G = ENGINE_FORK;
+static const char *cacheFile_pG = NULL;
+static const char *simData_pG = NULL;
+static int numBuses_G = 0;
+static int numJobs_G = 0;
+static int numReplicas_G = 0;
+static const char *statsFile_pG = NULL;
+static bool deviceStats_G = false;
+static bool verbose_G = false;
+static bool crcCheck_G = false;
+static int retries_G = BUS_DEFAULT_RETRIES;
+static int idWidth_G = 0;
+static int timeoutMs_G = 0;
+// -r, -w or -T given: only the fork engine can do anything with them
+static bool recoveryOpts_G = false;
+static BusSimFaults_t faults_G;
+static OutputFormat_e format_G = OUTPUT_DEC;
+static Output_t output_G;
+static int monitorMaxMs_G = 0;
+static int monitorMinMs_G = 0;
+// written to by the signal handler to wake the monitors up, never read
+static int stopPipe_G[2] = {-1, -1};
+static volatile sig_atomic_t stop_G = 0;
+static WorkPool_t pool_G;
 
-static int add_bit (DeviceID_t *device_p, uint8_t bit, bool send);
-static int find_one_device (DeviceID_t *device_p);
-static int get_next_digits (unsigned *digitsRet_p);
+// one per bus, handed out to the workers in order
+typedef struct {
+	Bus_t bus;
+	char cacheFile[PATH_MAX];
+	// the simulated bus behind a "sim" transport
+	char simData[PATH_MAX];
+	BusSim_t sim;
+	int ret;
+	// monitor mode, present is summed over the scans
+	uint64_t scans;
+	uint64_t present;
+	uint64_t added;
+	uint64_t removed;
+	int intervalMs;
+} BusJob_t;
+static BusJob_t *jobs_pG = NULL;
+static int numJobsQueued_G = 0;
+static atomic_int nextJob_G;
+
+static int process_cmdline_args (int argc, char *argv[]);
+static void *worker (void *arg_p);
+static int run_job (BusJob_t *job_p);
+static int open_sim (BusJob_t *job_p);
+static uint64_t job_devices (const BusJob_t *job_p);
+static int monitor_bus (BusJob_t *job_p);
+static int setup_stop_signals (void);
+static void report_bus (const BusJob_t *job_p);
+static void report_bus_time (const char *prefix_p, const BusSlots_t *slots_p, uint64_t devices);
+static int print_merged_results (void);
+static int write_stats (double elapsed);
 
 int
-main (void)
+main (int argc, char *argv[])
 {
-	char sendCh;
-	int ret, mainRet=1;
-	DeviceNode_t *curNode_p;
+	int i, ret, mainRet=1;
+	int numWorkers;
+	pthread_t *workers_p = NULL;
+	struct timespec start, end;
+	double elapsed;
+	uint64_t totalDevices;
+	BusSlots_t totalSlots;
 
-	ret = open_fifo(toTesterFifoName_p, &toTesterFifoFd_G);
-	if (ret != 0) {
-		perror("mkfifo to tester");
+	ret = process_cmdline_args(argc, argv);
+	if (ret != 0)
 		return 1;
+
+	// without -N (or -k) there is one unnumbered bus
+	numJobsQueued_G = 1;
+	if (numBuses_G != 0)
+		numJobsQueued_G = numBuses_G;
+	if (numReplicas_G != 0) {
+		numJobsQueued_G = numReplicas_G;
+		numBuses_G = numReplicas_G;
+		numJobs_G = numReplicas_G;
+		ret = workpool_init(&pool_G, numReplicas_G);
+		if (ret != 0)
+			return 1;
 	}
-	ret = open_fifo(fmTesterFifoName_p, &fmTesterFifoFd_G);
-	if (ret != 0) {
-		perror ("mkfifo fm tester");
-		goto closeToTesterFifo;
+	if (output_open(&output_G, stdout, format_G, OUTPUT_DEFAULT_BUFFER) != 0)
+		return 1;
+	if ((monitorMaxMs_G != 0) && (setup_stop_signals() != 0)) {
+		output_close(&output_G);
+		return 1;
+	}
+	jobs_pG = (BusJob_t*)calloc((size_t)numJobsQueued_G, sizeof(BusJob_t));
+	if (jobs_pG == NULL) {
+		perror("calloc");
+		output_close(&output_G);
+		return 1;
 	}
+	for (i=0; i<numJobsQueued_G; ++i) {
+		bus_init(&jobs_pG[i].bus, (numBuses_G == 0)? -1 : i);
+		jobs_pG[i].bus.engine = engine_G;
+		jobs_pG[i].bus.pipelineReplay = pipelineReplay_G;
+		jobs_pG[i].bus.overdrive = overdrive_G;
+		jobs_pG[i].bus.alarmOnly = alarmOnly_G;
+		jobs_pG[i].bus.pattern.value = patternValue_G;
+		jobs_pG[i].bus.pattern.mask = patternMask_G;
+		jobs_pG[i].bus.timeWaits = (statsFile_pG != NULL);
+		jobs_pG[i].bus.deviceStats = deviceStats_G;
+		jobs_pG[i].bus.crcCheck = crcCheck_G;
+		jobs_pG[i].bus.retries = retries_G;
+		jobs_pG[i].bus.expectBits = (size_t)idWidth_G;
+		jobs_pG[i].bus.output_p = &output_G;
+		if (monitorMaxMs_G != 0) {
+			jobs_pG[i].bus.keepInventory = true;
+			jobs_pG[i].bus.changesOnly = true;
+		}
+		if (cacheFile_pG != NULL) {
+			if (numBuses_G == 0)
+				snprintf(jobs_pG[i].cacheFile, sizeof(jobs_pG[i].cacheFile), "%s", cacheFile_pG);
+			else
+				snprintf(jobs_pG[i].cacheFile, sizeof(jobs_pG[i].cacheFile), "%s.%d", cacheFile_pG, i);
+			jobs_pG[i].bus.cacheFile_p = jobs_pG[i].cacheFile;
+		}
+		if (simData_pG != NULL) {
+			if ((numBuses_G == 0) || (numReplicas_G != 0))
+				snprintf(jobs_pG[i].simData, sizeof(jobs_pG[i].simData), "%s", simData_pG);
+			else
+				snprintf(jobs_pG[i].simData, sizeof(jobs_pG[i].simData), "%s.%d", simData_pG, i);
+		}
+		if (numReplicas_G != 0) {
+			jobs_pG[i].bus.pool_p = &pool_G;
+			jobs_pG[i].bus.poolSlot = i;
+			jobs_pG[i].bus.collect = true;
+		}
+	}
+	atomic_init(&nextJob_G, 0);
+
+	// the whole tree is the first piece of work
+	if (numReplicas_G != 0) {
+		DeviceID_t root;
 
-	listHead_pG = create_new_node();
-	if (listHead_pG == NULL) {
-		printf("failed to create head node\n");
-		goto exitFail;
+		memset(&root, 0, sizeof(root));
+		ret = workpool_push(&pool_G, 0, &root);
+		if (ret != 0)
+			goto cleanup;
 	}
 
-	// find_one_device() might add more nodes as it encounters 00
-	// therefore search the whole list from the start until no unfinished
-	// nodes remain
-	while (1) {
-		curNode_p = listHead_pG;
-		while (1) {
-			if (curNode_p == NULL)
-				break;
-			if (!(curNode_p->device.done))
+	numWorkers = (numJobs_G == 0)? numJobsQueued_G : numJobs_G;
+	if (numWorkers > numJobsQueued_G)
+		numWorkers = numJobsQueued_G;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (numWorkers == 1)
+		worker(NULL);
+	else {
+		workers_p = (pthread_t*)calloc((size_t)numWorkers, sizeof(pthread_t));
+		if (workers_p == NULL) {
+			perror("calloc");
+			goto cleanup;
+		}
+		for (i=0; i<numWorkers; ++i) {
+			ret = pthread_create(&workers_p[i], NULL, worker, NULL);
+			if (ret != 0) {
+				fprintf(stderr, "can't start worker %d\n", i);
+				numWorkers = i;
 				break;
-			curNode_p = curNode_p->next_p;
+			}
 		}
-		if (curNode_p == NULL)
+		for (i=0; i<numWorkers; ++i)
+			pthread_join(workers_p[i], NULL);
+
+		// whatever the workers that did start left, do here
+		worker(NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = (double)(end.tv_sec - start.tv_sec) + ((double)(end.tv_nsec - start.tv_nsec) / 1e9);
+
+	mainRet = 0;
+	totalDevices = 0;
+	memset(&totalSlots, 0, sizeof(totalSlots));
+	for (i=0; i<numJobsQueued_G; ++i) {
+		if (jobs_pG[i].ret != 0)
+			mainRet = 1;
+		report_bus(&jobs_pG[i]);
+		totalDevices += job_devices(&jobs_pG[i]);
+		busslots_merge(&totalSlots, &jobs_pG[i].bus.slots);
+	}
+	if (numReplicas_G != 0) {
+		// the merged list is the final one, it can't be missing what a
+		// connection that failed didn't get to keep
+		if (mainRet != 0)
+			fprintf(stderr, "a connection failed, the merged results aren't complete: not writing them\n");
+		else if (print_merged_results() != 0)
+			mainRet = 1;
+	}
+	// the results are all out before the stats and the totals
+	if (output_flush(&output_G) != 0)
+		mainRet = 1;
+	if (numBuses_G != 0) {
+		if (verbose_G)
+			report_bus_time("total ", &totalSlots, totalDevices);
+		fprintf(stderr, "total: %"PRIu64" device(s) on %d %s in %.3fs (%.1f devices/s)\n",
+				totalDevices, numJobsQueued_G, (numReplicas_G != 0)? "connection(s)" : "bus(es)",
+				elapsed, (elapsed > 0)? ((double)totalDevices / elapsed) : 0.0);
+	}
+	if ((statsFile_pG != NULL) && (write_stats(elapsed) != 0))
+		mainRet = 1;
+
+cleanup:
+	for (i=0; i<numJobsQueued_G; ++i)
+		bus_free(&jobs_pG[i].bus);
+	if (numReplicas_G != 0)
+		workpool_free(&pool_G);
+	free(workers_p);
+	free(jobs_pG);
+	if (output_close(&output_G) != 0)
+		mainRet = 1;
+	return mainRet;
+}
+
+/**
+ * keep taking the next bus off the queue until there are none left
+ */
+static void *
+worker (void *arg_p)
+{
+	int idx;
+
+	(void)arg_p;
+	while (1) {
+		idx = atomic_fetch_add(&nextJob_G, 1);
+		if (idx >= numJobsQueued_G)
 			break;
+		jobs_pG[idx].ret = run_job(&jobs_pG[idx]);
+	}
+
+	return NULL;
+}
 
-		ret = find_one_device(&(curNode_p->device));
+static int
+run_job (BusJob_t *job_p)
+{
+	int ret;
+	char sendCh;
+
+	/* preconds */
+	if (job_p == NULL)
+		return -1;
+
+	ret = transport_open(&job_p->bus.transport, transportType_G, TRANSPORT_MASTER, busyPoll_G, job_p->bus.busNum);
+	if (ret != 0)
+		return -1;
+	job_p->bus.transport.timeoutMs = timeoutMs_G;
+	if (transportType_G == TRANSPORT_SIM) {
+		ret = open_sim(job_p);
 		if (ret != 0) {
-			printf("failure in find_one_device\n");
-			goto cleanupNodes;
+			transport_close(&job_p->bus.transport);
+			return -1;
 		}
-		print_id(&(curNode_p->device), (int)curNode_p->device.bitLen);
-		printf("\n");
 	}
 
-	mainRet = 0;
-cleanupNodes:
-	free_nodes(listHead_pG);
-exitFail:
+	if (monitorMaxMs_G != 0)
+		ret = monitor_bus(job_p);
+	else
+		ret = bus_search(&job_p->bus);
+
 	sendCh = 'Q';
-	write(toTesterFifoFd_G, (void*)&sendCh, 1);
-	close(fmTesterFifoFd_G);
-	unlink(fmTesterFifoName_p);
-closeToTesterFifo:
-	close(toTesterFifoFd_G);
-	unlink(toTesterFifoName_p);
-	return mainRet;
+	transport_send(&job_p->bus.transport, &sendCh, 1);
+	transport_close(&job_p->bus.transport);
+	if (transportType_G == TRANSPORT_SIM)
+		bussim_free(&job_p->sim);
+	return ret;
 }
 
 /**
- * optionally add the specified bit to the given (non-NULL) device
- * optionally send this bit to the tester
- * bit is specified as a character: '0' or '1'
- *
- * the bits are given to us LSB first, but we put the first bit in bits[0]
- * therefore the bits array stores the bits backwards
+ * until told to stop: search the bus again and again, starting each time
+ * from what the last search found, and write out only the devices that come
+ * and go (the first search finds them all)
  *
- * return:
- *  0: ok
- * -1: failure
+ * the wait between searches drops to the shortest after a search that saw
+ * a change and doubles, up to the longest, after each one that didn't
  */
 static int
-add_bit (DeviceID_t *device_p, uint8_t bit, bool send)
+monitor_bus (BusJob_t *job_p)
 {
-	/* preconds */
-	if ((bit != '0') && (bit != '1'))
-		return -1;
+	int ret;
+	struct pollfd pollFd;
+
+	job_p->intervalMs = monitorMinMs_G;
+	while (!stop_G) {
+		ret = bus_search(&job_p->bus);
+		if (ret != 0)
+			return -1;
+		++job_p->scans;
+		job_p->present += job_p->bus.deltaConfirmed + job_p->bus.deltaAdded;
+		job_p->added += job_p->bus.deltaAdded;
+		job_p->removed += job_p->bus.deltaRemoved;
+		// the events have to get out now, not when the buffer fills
+		ret = output_flush(job_p->bus.output_p);
+		if (ret != 0)
+			return -1;
+
+		if ((job_p->bus.deltaAdded + job_p->bus.deltaRemoved) > 0)
+			job_p->intervalMs = monitorMinMs_G;
+		else if (job_p->intervalMs < monitorMaxMs_G)
+			job_p->intervalMs = ((job_p->intervalMs * 2) < monitorMaxMs_G)? (job_p->intervalMs * 2) : monitorMaxMs_G;
 
-	if (device_p != NULL) {
-		if (device_p->bitLen < sizeof(device_p->bits))
-			device_p->bits[device_p->bitLen++] = bit;
-		else {
-			printf("bitfield full\n");
+		// sleep, unless a signal comes in
+		pollFd.fd = stopPipe_G[0];
+		pollFd.events = POLLIN;
+		ret = poll(&pollFd, 1, job_p->intervalMs);
+		if ((ret == -1) && (errno != EINTR)) {
+			perror("poll");
 			return -1;
 		}
 	}
-	if (send)
-		write(toTesterFifoFd_G, (void*)&bit, sizeof(bit));
 
 	return 0;
 }
 
+static void
+stop_handler (int signo)
+{
+	char ch = 0;
+	ssize_t ret;
+
+	(void)signo;
+	stop_G = 1;
+	ret = write(stopPipe_G[1], &ch, 1);
+	(void)ret;
+}
+
 /**
- * interrogate the testing device over the fifo to find 1 device/serial number
- * (see the "Example of a ROM Search" section of the datasheet for the DS18B20
- * for an explanation of the algorithm)
- *
- * if a fork is found along the way, create a new node that is a copy of
- * the current device up to this point with "the other path" already added
- * to the ID of the new device
+ * SIGINT and SIGTERM end monitor mode after the search under way, a reader
+ * that goes away is a write error (that ends it too)
+ */
+static int
+setup_stop_signals (void)
+{
+	struct sigaction sig;
+
+	if (pipe(stopPipe_G) != 0) {
+		perror("pipe");
+		return -1;
+	}
+
+	memset(&sig, 0, sizeof(sig));
+	sig.sa_handler = stop_handler;
+	sig.sa_flags = SA_RESTART;
+	sigaction(SIGINT, &sig, NULL);
+	sigaction(SIGTERM, &sig, NULL);
+	sig.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &sig, NULL);
+	return 0;
+}
+
+/**
+ * load this job's device population into a simulator and hang it off the
+ * bus' transport
+ * every bus gets its own fault sequence (the seed plus the bus number)
  */
 static int
-find_one_device (DeviceID_t *device_p)
+open_sim (BusJob_t *job_p)
 {
 	int ret;
-	char sendCh;
-	unsigned nextDigits;
-	DeviceNode_t *newNode_p;
+	BusSimFaults_t faults;
 
-	/* preconds */
-	if (device_p == NULL)
+	ret = bussim_open(&job_p->sim, job_p->simData);
+	if (ret != 0) {
+		fprintf(stderr, "bad device population in %s\n", job_p->simData);
 		return -1;
+	}
+	if (faults_G.enabled) {
+		faults = faults_G;
+		if (job_p->bus.busNum > 0)
+			faults.state += (uint64_t)job_p->bus.busNum;
+		bussim_set_faults(&job_p->sim, &faults);
+	}
+	return transport_attach_sim(&job_p->bus.transport, &job_p->sim);
+}
 
-	// send reset
-	sendCh = 'R';
-	write(toTesterFifoFd_G, (void*)&sendCh, 1);
+/**
+ * the devices the bus' time went on: in monitor mode only the changes are
+ * written out but every scan walks the whole bus again
+ */
+static uint64_t
+job_devices (const BusJob_t *job_p)
+{
+	if (monitorMaxMs_G != 0)
+		return job_p->present;
+	return job_p->bus.devicesFound;
+}
 
-	// send ROM search command
-	sendCh = 'S';
-	write(toTesterFifoFd_G, (void*)&sendCh, 1);
+static uint64_t
+ops_total (const BusOps_t *ops_p)
+{
+	return ops_p->resets + ops_p->searches + ops_p->reads + ops_p->writes;
+}
 
-	// check if this is an already-started ID
-	// if it is, twiddle the tester with the current bits up to now so
-	// that all devices are at the correct state before continuing
-	if (device_p->bitLen > 0) {
-		size_t i;
+/**
+ * what getting over the faults cost, and (on a simulated bus) what was
+ * thrown at the search
+ * (unless verbose, only if there was anything)
+ */
+static void
+report_recovery (const char *prefix_p, const BusJob_t *job_p)
+{
+	int i;
+	const Bus_t *bus_p = &job_p->bus;
+	const BusStats_t *stats_p = &bus_p->stats;
+	uint64_t all = ops_total(&bus_p->ops);
+	uint64_t injected = 0;
+	bool faults = (transportType_G == TRANSPORT_SIM) && job_p->sim.faults.enabled;
 
-		for (i=0; i<device_p->bitLen; ++i) {
-			ret = get_next_digits(&nextDigits);
-			if (ret != 0)
-				return -1;
-			ret = add_bit(NULL, device_p->bits[i], true);
-			if (ret != 0)
-				return -1;
+	if (faults)
+		for (i=0; i<BUSSIM_FAULTS; ++i)
+			injected += job_p->sim.faults.injected[i];
+	if (!verbose_G && (injected == 0) && (ops_total(&stats_p->recoveryOps) == 0) && (stats_p->timeouts == 0) &&
+			(stats_p->badReplies == 0) && (stats_p->missingForks == 0) && (stats_p->lostSubtrees == 0))
+		return;
+
+	fprintf(stderr, "%srecovery: %"PRIu64" timeout(s) (%"PRIu64" node(s) given up), %"PRIu64" bad repl(ies), "
+			"%"PRIu64" bit / %"PRIu64" node / %"PRIu64" path retries, %"PRIu64" missing fork(s), %"PRIu64" lost subtree(s), "
+			"%"PRIu64" op(s) (%.2f%% of all)\n",
+			prefix_p, stats_p->timeouts, stats_p->timedOutNodes, stats_p->badReplies, stats_p->bitRetries, stats_p->nodeRetries, stats_p->pathRetries,
+			stats_p->missingForks, stats_p->lostSubtrees, ops_total(&stats_p->recoveryOps),
+			(all > 0)? (100.0 * (double)ops_total(&stats_p->recoveryOps) / (double)all) : 0.0);
+	if (faults) {
+		fprintf(stderr, "%sinjected:", prefix_p);
+		for (i=0; i<BUSSIM_FAULTS; ++i)
+			fprintf(stderr, " %"PRIu64" %s", job_p->sim.faults.injected[i], bussim_fault_name((BusSimFault_e)i));
+		fprintf(stderr, "\n");
+	}
+}
+
+static void
+report_bus (const BusJob_t *job_p)
+{
+	char prefix[32];
+	const Bus_t *bus_p;
+
+	/* preconds */
+	if (job_p == NULL)
+		return;
+
+	bus_p = &job_p->bus;
+
+	prefix[0] = 0;
+	if (bus_p->busNum >= 0)
+		snprintf(prefix, sizeof(prefix), "bus%d: ", bus_p->busNum);
+	if (job_p->ret != 0)
+		fprintf(stderr, "%sthe search failed%s\n", prefix, verbose_G? ", this is how far it got:" : "");
+
+	// what it cost is for -v (and -s), what went wrong is always worth a line
+	if (!verbose_G) {
+		if (bus_p->engine == ENGINE_FORK)
+			report_recovery(prefix, job_p);
+		return;
+	}
+
+	if (bus_p->pipelineReplay)
+		fprintf(stderr, "%sreplay: %"PRIu64" round trip(s) saved\n", prefix, bus_p->roundTripsSaved);
+	fprintf(stderr, "%sbus ops: %"PRIu64" reset(s) %"PRIu64" search(es) %"PRIu64" read(s) %"PRIu64" write(s)\n",
+			prefix, bus_p->ops.resets, bus_p->ops.searches, bus_p->ops.reads, bus_p->ops.writes);
+	// (a monitor's scans start from what the last one found, there's
+	// hardly anything pending)
+	if ((bus_p->engine == ENGINE_FORK) && (bus_p->pool_p == NULL) && (monitorMaxMs_G == 0))
+		fprintf(stderr, "%spending: peak %zu node(s)\n", prefix, bus_p->peakPending);
+	if (bus_p->pool_p != NULL)
+		fprintf(stderr, "%sworker: %"PRIu64" device(s) %"PRIu64" steal(s)\n", prefix, bus_p->devicesFound, bus_p->steals);
+	if (bus_p->pattern.mask != 0) {
+		BusSlots_t avoided;
+
+		bus_pattern_avoided(bus_p, &avoided);
+		fprintf(stderr, "%spattern: %"PRIu64" subtree(s) skipped %"PRIu64" dead end(s), "
+				"at least %"PRIu64" slot(s) and %"PRIu64" reset(s) (%.3f ms) avoided\n",
+				prefix, bus_p->pattern.skippedSubtrees, bus_p->pattern.deadEnds,
+				busslots_reads(&avoided) + busslots_writes(&avoided), busslots_resets(&avoided),
+				busslots_time_us(&avoided) / 1000.0);
+	}
+	if (bus_p->crcCheck)
+		fprintf(stderr, "%scrc: %"PRIu64" bad CRC8(s), %"PRIu64" subtree(s) searched again, %"PRIu64" ID(s) rejected\n",
+				prefix, bus_p->stats.crcFailures, bus_p->stats.crcResearches, bus_p->stats.crcRejected);
+	if (bus_p->engine == ENGINE_FORK)
+		report_recovery(prefix, job_p);
+	if (monitorMaxMs_G != 0)
+		fprintf(stderr, "%smonitor: %"PRIu64" scan(s), %"PRIu64" added, %"PRIu64" removed, interval %d ms\n",
+				prefix, job_p->scans, job_p->added, job_p->removed, job_p->intervalMs);
+	report_bus_time(prefix, &bus_p->slots, job_devices(job_p));
+}
+
+/**
+ * projected time on a real wire: as it was run, then all at one speed
+ */
+static void
+report_bus_time (const char *prefix_p, const BusSlots_t *slots_p, uint64_t devices)
+{
+	BusSpeed_e speed;
+	double us;
+
+	us = busslots_time_us(slots_p);
+	fprintf(stderr, "%sbus time: %.3f ms", prefix_p, us / 1000.0);
+	if (devices > 0)
+		fprintf(stderr, " (%.1f us/device)", us / (double)devices);
+	fprintf(stderr, "\n");
+
+	for (speed=BUS_STANDARD; speed<BUS_SPEEDS; ++speed) {
+		us = busslots_time_at_us(slots_p, speed);
+		fprintf(stderr, "%sbus time: all %s %.3f ms", prefix_p, bus_speed_name(speed), us / 1000.0);
+		if (devices > 0)
+			fprintf(stderr, " (%.1f us/device)", us / (double)devices);
+		fprintf(stderr, "\n");
+	}
+}
+
+static void
+json_ops (FILE *out_p, const BusOps_t *ops_p)
+{
+	fprintf(out_p, "{\"resets\": %"PRIu64", \"searches\": %"PRIu64", \"reads\": %"PRIu64", \"writes\": %"PRIu64"}",
+			ops_p->resets, ops_p->searches, ops_p->reads, ops_p->writes);
+}
+
+static void
+json_bus (FILE *out_p, const BusJob_t *job_p)
+{
+	int i, last;
+	size_t j;
+	const Bus_t *bus_p = &job_p->bus;
+	const TransportStats_t *ts_p = &bus_p->transport.stats;
+	const Log2Hist_t *wait_p = &bus_p->stats.recvWait;
+	const BusDeviceStats_t *dev_p;
+
+	fprintf(out_p, "    {\n");
+	fprintf(out_p, "      \"bus\": %d,\n", bus_p->busNum);
+	fprintf(out_p, "      \"ok\": %s,\n", (job_p->ret == 0)? "true" : "false");
+	fprintf(out_p, "      \"devices\": %"PRIu64",\n", bus_p->devicesFound);
+	fprintf(out_p, "      \"ops\": ");
+	json_ops(out_p, &bus_p->ops);
+	fprintf(out_p, ",\n");
+	fprintf(out_p, "      \"read_pairs\": %"PRIu64",\n", bus_p->stats.readPairs);
+	fprintf(out_p, "      \"bits_replayed\": %"PRIu64",\n", bus_p->stats.bitsReplayed);
+	fprintf(out_p, "      \"bits_discovered\": %"PRIu64",\n", bus_p->stats.bitsDiscovered);
+	fprintf(out_p, "      \"forks\": %"PRIu64",\n", bus_p->stats.forks);
+	fprintf(out_p, "      \"peak_pending\": %zu,\n", bus_p->peakPending);
+	fprintf(out_p, "      \"round_trips_saved\": %"PRIu64",\n", bus_p->roundTripsSaved);
+	fprintf(out_p, "      \"steals\": %"PRIu64",\n", bus_p->steals);
+	fprintf(out_p, "      \"pattern\": {\"skipped_subtrees\": %"PRIu64", \"dead_ends\": %"PRIu64"},\n",
+			bus_p->pattern.skippedSubtrees, bus_p->pattern.deadEnds);
+	fprintf(out_p, "      \"crc\": {\"failures\": %"PRIu64", \"researches\": %"PRIu64", \"rejected\": %"PRIu64"},\n",
+			bus_p->stats.crcFailures, bus_p->stats.crcResearches, bus_p->stats.crcRejected);
+	fprintf(out_p, "      \"recovery\": {\"timeouts\": %"PRIu64", \"timed_out_nodes\": %"PRIu64", \"bad_replies\": %"PRIu64", "
+			"\"bit_retries\": %"PRIu64", \"node_retries\": %"PRIu64", \"path_retries\": %"PRIu64", \"missing_forks\": %"PRIu64", "
+			"\"lost_subtrees\": %"PRIu64", \"ops\": ",
+			bus_p->stats.timeouts, bus_p->stats.timedOutNodes, bus_p->stats.badReplies, bus_p->stats.bitRetries, bus_p->stats.nodeRetries, bus_p->stats.pathRetries,
+			bus_p->stats.missingForks, bus_p->stats.lostSubtrees);
+	json_ops(out_p, &bus_p->stats.recoveryOps);
+	if ((transportType_G == TRANSPORT_SIM) && job_p->sim.faults.enabled) {
+		fprintf(out_p, ", \"injected\": {");
+		for (i=0; i<BUSSIM_FAULTS; ++i)
+			fprintf(out_p, "%s\"%s\": %"PRIu64, (i == 0)? "" : ", ", bussim_fault_name((BusSimFault_e)i),
+					job_p->sim.faults.injected[i]);
+		fprintf(out_p, "}");
+	}
+	fprintf(out_p, "},\n");
+	if (monitorMaxMs_G != 0)
+		fprintf(out_p, "      \"monitor\": {\"scans\": %"PRIu64", \"added\": %"PRIu64", \"removed\": %"PRIu64", \"interval_ms\": %d},\n",
+				job_p->scans, job_p->added, job_p->removed, job_p->intervalMs);
+	fprintf(out_p, "      \"syscalls\": {\"total\": %"PRIu64", \"poll\": %"PRIu64", \"read\": %"PRIu64", "
+			"\"write\": %"PRIu64", \"futex_wait\": %"PRIu64", \"futex_wake\": %"PRIu64"},\n",
+			transport_syscalls(ts_p), ts_p->polls, ts_p->reads, ts_p->writes, ts_p->futexWaits, ts_p->futexWakes);
+	fprintf(out_p, "      \"bytes\": {\"sent\": %"PRIu64", \"received\": %"PRIu64"},\n",
+			ts_p->bytesSent, ts_p->bytesRecv);
+	fprintf(out_p, "      \"bus_time_us\": {\"as_run\": %.3f, \"standard\": %.3f, \"overdrive\": %.3f},\n",
+			busslots_time_us(&bus_p->slots), busslots_time_at_us(&bus_p->slots, BUS_STANDARD),
+			busslots_time_at_us(&bus_p->slots, BUS_OVERDRIVE));
+
+	// the histogram stops at the last bucket with anything in it
+	last = -1;
+	for (i=0; i<LOG2_HIST_BUCKETS; ++i)
+		if (wait_p->buckets[i] != 0)
+			last = i;
+	fprintf(out_p, "      \"recv_wait_ns\": {\"count\": %"PRIu64", \"total\": %"PRIu64", \"max\": %"PRIu64", \"log2_histogram\": [",
+			wait_p->count, wait_p->sum, wait_p->max);
+	for (i=0; i<=last; ++i)
+		fprintf(out_p, "%s%"PRIu64, (i == 0)? "" : ", ", wait_p->buckets[i]);
+	fprintf(out_p, "]}");
+
+	if (bus_p->deviceStats) {
+		fprintf(out_p, ",\n      \"per_device\": [");
+		for (j=0; j<bus_p->numDevStats; ++j) {
+			dev_p = &bus_p->devStats_p[j];
+			fprintf(out_p, "%s\n        {\"id\": \"%"PRIu64"\", \"bits\": %zu, \"ops\": ", (j == 0)? "" : ",",
+					device_value(&dev_p->device), dev_p->device.bitLen);
+			json_ops(out_p, &dev_p->ops);
+			fprintf(out_p, ", \"bits_replayed\": %"PRIu64", \"bits_discovered\": %"PRIu64", \"wait_ns\": %"PRIu64"}",
+					dev_p->bitsReplayed, dev_p->bitsDiscovered, dev_p->waitNs);
 		}
+		fprintf(out_p, "%s]", (bus_p->numDevStats == 0)? "" : "\n      ");
 	}
+	fprintf(out_p, "\n    }");
+}
 
-	while (!(device_p->done)) {
-		ret = get_next_digits(&nextDigits);
-		if (ret != 0) {
-			printf("error fetching next digits\n");
+/**
+ * everything counted during the run, as JSON, to statsFile_pG ("-" for
+ * stdout)
+ */
+static int
+write_stats (double elapsed)
+{
+	int i;
+	FILE *out_p;
+	uint64_t totalDevices = 0;
+
+	if (strcmp(statsFile_pG, "-") == 0)
+		out_p = stdout;
+	else {
+		out_p = fopen(statsFile_pG, "w");
+		if (out_p == NULL) {
+			perror("open stats file");
 			return -1;
 		}
-		switch (nextDigits) {
-			case 0: // 00
-				// send someone off to do the '1' case
-				newNode_p = create_node_copy_device(device_p);
-				if (newNode_p != NULL) {
-					add_bit(&(newNode_p->device), '1', false);
-					ret = add_node_to_list(listHead_pG, newNode_p);
-					if (ret != 0)
-						free_nodes(newNode_p);
-				}
+	}
 
-				// we'll do the '0' case here
-				ret = add_bit(device_p, '0', true);
-				if (ret != 0)
-					return ret;
-				break;
+	for (i=0; i<numJobsQueued_G; ++i)
+		totalDevices += jobs_pG[i].bus.devicesFound;
 
-			case 1: // 01
-				ret = add_bit(device_p, '0', true);
-				if (ret != 0)
-					return ret;
-				break;
+	fprintf(out_p, "{\n");
+	fprintf(out_p, "  \"version\": 1,\n");
+	fprintf(out_p, "  \"transport\": \"%s\",\n", (transportType_G == TRANSPORT_SHM)? "shm" :
+			(transportType_G == TRANSPORT_SIM)? "sim" : "fifo");
+	fprintf(out_p, "  \"engine\": \"%s\",\n", (engine_G == ENGINE_LD)? "ld" : ((cacheFile_pG != NULL) || (monitorMaxMs_G != 0))? "delta" : "fork");
+	fprintf(out_p, "  \"pipeline_replay\": %s,\n", pipelineReplay_G? "true" : "false");
+	fprintf(out_p, "  \"elapsed_s\": %.6f,\n", elapsed);
+	fprintf(out_p, "  \"devices\": %"PRIu64",\n", totalDevices);
+	fprintf(out_p, "  \"wait_histogram_unit\": \"bucket n counts waits of [2^n, 2^(n+1)) ns\",\n");
+	fprintf(out_p, "  \"buses\": [\n");
+	for (i=0; i<numJobsQueued_G; ++i) {
+		json_bus(out_p, &jobs_pG[i]);
+		fprintf(out_p, "%s\n", (i == (numJobsQueued_G - 1))? "" : ",");
+	}
+	fprintf(out_p, "  ]\n");
+	fprintf(out_p, "}\n");
 
-			case 2: // 10
-				ret = add_bit(device_p, '1', true);
-				if (ret != 0)
-					return ret;
-				break;
+	if (out_p == stdout)
+		return (fflush(out_p) == 0)? 0 : -1;
+	if (fclose(out_p) != 0) {
+		perror("write stats file");
+		return -1;
+	}
+	return 0;
+}
 
-			case 3: // 11
-				device_p->done = true;
-				break;
+static int
+result_cmp (const void *a_p, const void *b_p)
+{
+	uint64_t a = bit_reverse64(device_value((const DeviceID_t*)a_p));
+	uint64_t b = bit_reverse64(device_value((const DeviceID_t*)b_p));
 
-			default:
-				printf("unhandled reply from tester: %c (0x%02x)\n", nextDigits, nextDigits);
-				return -1;
-		}
+	if (a < b)
+		return -1;
+	if (a > b)
+		return 1;
+	return 0;
+}
+
+/**
+ * the replicated connections all see the same devices, gather what each
+ * found and print it once, in search order
+ */
+static int
+print_merged_results (void)
+{
+	int i;
+	size_t j, total, pos;
+	DeviceID_t *all_p;
+
+	total = 0;
+	for (i=0; i<numJobsQueued_G; ++i)
+		total += jobs_pG[i].bus.numResults;
+	if (total == 0)
+		return 0;
+
+	all_p = (DeviceID_t*)malloc(total * sizeof(DeviceID_t));
+	if (all_p == NULL) {
+		perror("malloc");
+		return 1;
 	}
+	pos = 0;
+	for (i=0; i<numJobsQueued_G; ++i)
+		for (j=0; j<jobs_pG[i].bus.numResults; ++j)
+			all_p[pos++] = jobs_pG[i].bus.results_p[j];
 
+	qsort(all_p, total, sizeof(DeviceID_t), result_cmp);
+	for (j=0; j<total; ++j) {
+		if ((j > 0) && (result_cmp(&all_p[j-1], &all_p[j]) == 0))
+			continue;
+		output_device(&output_G, -1, OUTPUT_TAG_NONE, &all_p[j]);
+	}
+
+	free(all_p);
 	return 0;
 }
 
+static void
+usage (const char *cmdline_p)
+{
+	/* preconds */
+	//none
+
+	if (cmdline_p == NULL) {
+		printf("bad usage\n");
+		return;
+	}
+
+	printf("usage: %s [<options>]\n", cmdline_p);
+	printf("  where:\n");
+	printf("    <options>\n");
+	printf("      -h|--help             print information about this program and exit successfully\n");
+	printf("      -l|--lockstep-replay  replay the prefix of a forked device one bit at a time\n");
+	printf("                            (default: send the whole prefix in one burst)\n");
+	printf("      -o|--overdrive        switch every device to overdrive speed (Overdrive Skip\n");
+	printf("                            ROM) before searching and keep the bus there\n");
+	printf("      -a|--alarm            conditional search: only find the devices with their\n");
+	printf("                            alarm flag set\n");
+	printf("      -p|--pattern <v>/<m>  only look for IDs that have the bits of <v> where <m>\n");
+	printf("                            has a 1 (bit 0 is the first bit searched); branches\n");
+	printf("                            that can't match are never followed (fork engine only)\n");
+	printf("      -F|--family <f>       only look for family code <f>, same as -p <f>/0xff\n");
+	printf("      -t|--transport <t>    talk to the tester over <t>: fifo or shm (default: fifo),\n");
+	printf("                            or sim to search a simulated bus in this process (see -d)\n");
+	printf("      -B|--busy-poll        spin instead of sleeping while waiting on the shm transport\n");
+	printf("      -d|--data <file>      device population for -t sim, a tester data file or\n");
+	printf("                            binary dataset (with -N bus <n> uses <file>.<n>)\n");
+	printf("      -e|--engine <e>       search algorithm: fork (fork list, default) or\n");
+	printf("                            ld (last discrepancy, ROM order)\n");
+	printf("      -c|--cache <file>     verify the devices listed in <file> and only search the\n");
+	printf("                            parts of the bus they don't account for; report added (+),\n");
+	printf("                            confirmed (=) and removed (-) devices and update <file>\n");
+	printf("                            (fork engine only; with -N bus <n> uses <file>.<n>)\n");
+	printf("      -N|--buses <n>        search buses 0..<n>-1 (one tester per bus, started with\n");
+	printf("                            --bus) and report the overall throughput\n");
+	printf("      -j|--jobs <j>         number of buses to search at the same time\n");
+	printf("                            (default: all of them)\n");
+	printf("      -k|--replicas <k>     search one device population through <k> connections\n");
+	printf("                            (testers 0..<k>-1 started with --bus and the same data\n");
+	printf("                            file) at the same time, sharing out the pending forks\n");
+	printf("                            (fork engine only)\n");
+	printf("      -s|--stats <file>     write counters, system calls and a histogram of the time\n");
+	printf("                            spent waiting on replies to <file> as JSON (- for stdout)\n");
+	printf("      -D|--stats-devices    with -s, also break the counters down per device found\n");
+	printf("      -v|--verbose          report what each search cost on stderr: bus operations,\n");
+	printf("                            recovery and the projected time on a real bus (default:\n");
+	printf("                            only failures and recovery that was needed)\n");
+	printf("      -C|--crc              only report 64-bit IDs with a good CRC8; after a bad one\n");
+	printf("                            search again from the first bit of its path nobody has\n");
+	printf("                            (a misread) instead of reporting it (fork engine only)\n");
+	printf("      -r|--retries <n>      how many times to try again when a reply can't be right\n");
+	printf("                            or a path has gone (default: %d); 0 fails the search at\n", BUS_DEFAULT_RETRIES);
+	printf("                            the first one instead (fork engine only)\n");
+	printf("      -w|--width <bits>     the width of the IDs on the bus: nobody answering (11)\n");
+	printf("                            before then is a fault, read again (default: believe it;\n");
+	printf("                            -C implies 64; fork engine only)\n");
+	printf("      -T|--timeout <ms>     give up on a reply after <ms> (default: wait forever);\n");
+	printf("                            it counts as a fault, like a bad reply (fork engine only)\n");
+	printf("      -f|--format <f>       write the devices found as: dec (the bits and the value\n");
+	printf("                            in decimal, default), hex (the value, MSB first), jsonl\n");
+	printf("                            (a JSON object per line) or binary (the values as raw\n");
+	printf("                            host-order uint64s, no bus numbers or changes)\n");
+	printf("      -m|--monitor <ms>     keep searching, at most <ms> apart, and write out only\n");
+	printf("                            the devices that come (+) and go (-) until SIGINT or\n");
+	printf("                            SIGTERM (fork engine only)\n");
+	printf("      -M|--min-interval <ms> search again after <ms> when something changed, the wait\n");
+	printf("                            doubles with every quiet search up to -m (default: 1/8\n");
+	printf("                            of -m)\n");
+	printf("      -i|--inject <spec>    with -t sim, make the simulated bus misbehave, <spec> is a\n");
+	printf("                            comma separated list of <fault>=<ppm> (in a million per\n");
+	printf("                            read) and seed=<n>, the faults are: flip (the reply is\n");
+	printf("                            inverted), drop (it never arrives), ones (both halves of\n");
+	printf("                            the pair read 1) and vanish (a device drops off until the\n");
+	printf("                            next reset)\n");
+}
+
 /**
- * perform 2 "reads" on the "device" (i.e. send two 'r' commands down the
- * fifo) to obtain the all the current bits of all devices and the complement
- * of all the current bits of all devices
- *
- * the first received bit is the MSB
- *
- * the return value indicates error:
- * 0  → okay
- * -1 → error
- *
- * the digitsRet_p is set to the value from the tester:
- * 0b00
- * 0b01
- * 0b10
- * 0b11
+ * <value>/<mask>, each in any base strtoull() understands
  */
 static int
-get_next_digits (unsigned *digitsRet_p)
+parse_pattern (const char *arg_p)
 {
-	int i, ret;
-	char sendCh, recvCh;
-	struct pollfd pollFd[1];
-	ssize_t retRead;
+	char *end_p;
 
 	/* preconds */
-	if (digitsRet_p == NULL)
+	if (arg_p == NULL)
 		return -1;
 
-	pollFd[0].fd = fmTesterFifoFd_G;
-	pollFd[0].events = POLLIN;
+	patternValue_G = strtoull(arg_p, &end_p, 0);
+	if ((end_p == arg_p) || (*end_p != '/'))
+		return -1;
+	arg_p = end_p + 1;
+	patternMask_G = strtoull(arg_p, &end_p, 0);
+	if ((end_p == arg_p) || (*end_p != '\0'))
+		return -1;
+	patternValue_G &= patternMask_G;
+	return 0;
+}
+
+static int
+process_cmdline_args (int argc, char *argv[])
+{
+	int c, ret;
+	char *end_p;
+	struct option longOpts[] = {
+		{"help", no_argument, NULL, 'h'},
+		{"lockstep-replay", no_argument, NULL, 'l'},
+		{"overdrive", no_argument, NULL, 'o'},
+		{"alarm", no_argument, NULL, 'a'},
+		{"pattern", required_argument, NULL, 'p'},
+		{"family", required_argument, NULL, 'F'},
+		{"transport", required_argument, NULL, 't'},
+		{"busy-poll", no_argument, NULL, 'B'},
+		{"data", required_argument, NULL, 'd'},
+		{"engine", required_argument, NULL, 'e'},
+		{"cache", required_argument, NULL, 'c'},
+		{"buses", required_argument, NULL, 'N'},
+		{"jobs", required_argument, NULL, 'j'},
+		{"replicas", required_argument, NULL, 'k'},
+		{"stats", required_argument, NULL, 's'},
+		{"stats-devices", no_argument, NULL, 'D'},
+		{"verbose", no_argument, NULL, 'v'},
+		{"crc", no_argument, NULL, 'C'},
+		{"retries", required_argument, NULL, 'r'},
+		{"width", required_argument, NULL, 'w'},
+		{"timeout", required_argument, NULL, 'T'},
+		{"inject", required_argument, NULL, 'i'},
+		{"format", required_argument, NULL, 'f'},
+		{"monitor", required_argument, NULL, 'm'},
+		{"min-interval", required_argument, NULL, 'M'},
+		{NULL, 0, NULL, 0},
+	};
+
+	while (1) {
+		c = getopt_long(argc, argv, "hloap:F:t:Bd:e:c:N:j:k:s:DvCr:w:T:i:f:m:M:", longOpts, 0);
+		if (c == -1)
+			break;
+		switch (c) {
+			case 'h':
+				printf("%s\n", PACKAGE_STRING);
+				usage(argv[0]);
+				exit(0);
+
+			case 'l':
+				pipelineReplay_G = false;
+				break;
+
+			case 'o':
+				overdrive_G = true;
+				break;
+
+			case 'a':
+				alarmOnly_G = true;
+				break;
+
+			case 'p':
+				ret = parse_pattern(optarg);
+				if (ret != 0) {
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+
+			case 'F':
+				patternValue_G = strtoull(optarg, &end_p, 0);
+				if ((*optarg == '\0') || (*end_p != '\0') || (patternValue_G > 0xff)) {
+					usage(argv[0]);
+					return -1;
+				}
+				patternMask_G = 0xff;
+				break;
 
-	*digitsRet_p = 0;
-	for (i=1; i>-1; --i) {
-		// send 'r'
-		sendCh = 'r';
-		write(toTesterFifoFd_G, (void*)&sendCh, 1);
+			case 't':
+				if (transport_parse_type(optarg, &transportType_G) != 0) {
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+
+			case 'B':
+				busyPoll_G = true;
+				break;
 
-		ret = poll(pollFd, 1, -1);
-		if ((ret == 1) && (pollFd[0].revents == POLLIN)) {
-			retRead = read(pollFd[0].fd, &recvCh, sizeof(recvCh));
-			if (retRead <= 0)
+			case 'd':
+				simData_pG = optarg;
+				break;
+
+			case 'e':
+				if (strcmp(optarg, "fork") == 0)
+					engine_G = ENGINE_FORK;
+				else if (strcmp(optarg, "ld") == 0)
+					engine_G = ENGINE_LD;
+				else {
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+
+			case 'c':
+				cacheFile_pG = optarg;
+				break;
+
+			case 'N':
+				if ((sscanf(optarg, "%i", &ret) != 1) || (ret < 1)) {
+					usage(argv[0]);
+					return -1;
+				}
+				numBuses_G = ret;
+				break;
+
+			case 'j':
+				if ((sscanf(optarg, "%i", &ret) != 1) || (ret < 1)) {
+					usage(argv[0]);
+					return -1;
+				}
+				numJobs_G = ret;
+				break;
+
+			case 'k':
+				if ((sscanf(optarg, "%i", &ret) != 1) || (ret < 1)) {
+					usage(argv[0]);
+					return -1;
+				}
+				numReplicas_G = ret;
+				break;
+
+			case 's':
+				statsFile_pG = optarg;
+				break;
+
+			case 'D':
+				deviceStats_G = true;
+				break;
+
+			case 'v':
+				verbose_G = true;
+				break;
+
+			case 'C':
+				crcCheck_G = true;
+				break;
+
+			case 'r':
+				if ((sscanf(optarg, "%i", &ret) != 1) || (ret < 0)) {
+					usage(argv[0]);
+					return -1;
+				}
+				retries_G = ret;
+				recoveryOpts_G = true;
+				break;
+
+			case 'w':
+				if ((sscanf(optarg, "%i", &ret) != 1) || (ret < 1) || (ret > DEVICE_ID_MAX_BITS)) {
+					usage(argv[0]);
+					return -1;
+				}
+				idWidth_G = ret;
+				recoveryOpts_G = true;
+				break;
+
+			case 'T':
+				if ((sscanf(optarg, "%i", &ret) != 1) || (ret < 1)) {
+					usage(argv[0]);
+					return -1;
+				}
+				timeoutMs_G = ret;
+				recoveryOpts_G = true;
+				break;
+
+			case 'i':
+				if (bussim_parse_faults(optarg, &faults_G) != 0) {
+					fprintf(stderr, "bad fault spec: %s\n", optarg);
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+
+			case 'f':
+				if (output_parse_format(optarg, &format_G) != 0) {
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+
+			case 'm':
+			case 'M':
+				if ((sscanf(optarg, "%i", &ret) != 1) || (ret < 1)) {
+					usage(argv[0]);
+					return -1;
+				}
+				if (c == 'm')
+					monitorMaxMs_G = ret;
+				else
+					monitorMinMs_G = ret;
+				break;
+
+			default:
+				usage(argv[0]);
 				return -1;
-			switch (recvCh) {
-				case '0':
-					break;
-				case '1':
-					*digitsRet_p += (unsigned)(1 << i);
-					break;
-				default:
-					return 0;
-			}
+		}
+	}
 
+	if (argc != optind) {
+		usage(argv[0]);
+		return -1;
+	}
+	if ((transportType_G == TRANSPORT_SIM) != (simData_pG != NULL)) {
+		fprintf(stderr, "the sim transport needs a device population (-d) and -d needs the sim transport\n");
+		return -1;
+	}
+	if ((patternMask_G != 0) && ((engine_G != ENGINE_FORK) || (cacheFile_pG != NULL))) {
+		fprintf(stderr, "a pattern can only be used with a plain fork search\n");
+		return -1;
+	}
+	if ((cacheFile_pG != NULL) && alarmOnly_G) {
+		fprintf(stderr, "the device cache holds the whole bus, it can't be used with -a\n");
+		return -1;
+	}
+	if ((cacheFile_pG != NULL) && (engine_G != ENGINE_FORK)) {
+		fprintf(stderr, "the device cache can only be used with the fork engine\n");
+		return -1;
+	}
+	if (numReplicas_G != 0) {
+		if ((engine_G != ENGINE_FORK) || (cacheFile_pG != NULL) || (numBuses_G != 0)) {
+			fprintf(stderr, "replicated connections only work with a plain fork search of one bus\n");
+			return -1;
+		}
+	}
+	if (crcCheck_G && (engine_G != ENGINE_FORK)) {
+		fprintf(stderr, "the CRC8 check (-C) only works with the fork engine\n");
+		return -1;
+	}
+	if (recoveryOpts_G && (engine_G != ENGINE_FORK)) {
+		fprintf(stderr, "only the fork engine recovers from bad replies (-r, -w, -T)\n");
+		return -1;
+	}
+	if (faults_G.enabled && (transportType_G != TRANSPORT_SIM)) {
+		fprintf(stderr, "faults (-i) can only be injected into the sim transport\n");
+		return -1;
+	}
+	if (crcCheck_G && (idWidth_G == 0))
+		idWidth_G = CRC8_ROM_BITS;
+	if ((format_G == OUTPUT_BINARY) && (cacheFile_pG != NULL)) {
+		fprintf(stderr, "the binary format has no room for the changes a cache (-c) reports\n");
+		return -1;
+	}
+	if ((format_G == OUTPUT_BINARY) && (statsFile_pG != NULL) && (strcmp(statsFile_pG, "-") == 0)) {
+		fprintf(stderr, "binary results and the stats can't both go to stdout\n");
+		return -1;
+	}
+	if ((monitorMinMs_G != 0) && (monitorMaxMs_G == 0)) {
+		fprintf(stderr, "the minimum interval (-M) only means something with -m\n");
+		return -1;
+	}
+	if (monitorMaxMs_G != 0) {
+		if ((engine_G != ENGINE_FORK) || alarmOnly_G || (patternMask_G != 0) || (numReplicas_G != 0)) {
+			fprintf(stderr, "monitor mode only works with a plain fork search of the whole bus\n");
+			return -1;
 		}
-		else {
+		// every bus is searched forever, none of them can wait its turn
+		if ((numJobs_G != 0) && (numJobs_G < numBuses_G)) {
+			fprintf(stderr, "monitor mode needs a job (-j) for every bus (-N)\n");
 			return -1;
 		}
+		if (format_G == OUTPUT_BINARY) {
+			fprintf(stderr, "the binary format has no room for the changes monitor mode reports\n");
+			return -1;
+		}
+		if (monitorMinMs_G == 0)
+			monitorMinMs_G = (monitorMaxMs_G >= 8)? monitorMaxMs_G / 8 : 1;
+		if (monitorMinMs_G > monitorMaxMs_G)
+			monitorMinMs_G = monitorMaxMs_G;
+	}
+	if (deviceStats_G && (statsFile_pG == NULL)) {
+		fprintf(stderr, "per-device stats (-D) go in the stats file (-s)\n");
+		return -1;
 	}
 
 	return 0;
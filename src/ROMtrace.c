@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <string.h>
+
+#include "common.h"
+#include "bussim.h"
+#include "trace.h"
+#include "config.h"
+
+static const char *traceFile_pG = NULL;
+static const char *dataFile_pG = NULL;
+static bool summary_G = false;
+
+static int process_cmdline_args (int argc, char *argv[]);
+static void print_devices (BusSim_t *sim_p, const TraceEvent_t *event_p);
+
+int
+main (int argc, char *argv[])
+{
+	int ret, fnRtn = 1;
+	uint64_t n, first;
+	uint64_t counts[256];
+	const TraceEvent_t *event_p;
+	Trace_t trace;
+	BusSim_t sim;
+	bool replay = false;
+	char reply;
+	int i;
+
+	ret = process_cmdline_args(argc, argv);
+	if (ret != 0)
+		return 1;
+
+	ret = trace_map(&trace, traceFile_pG);
+	if (ret != 0)
+		return 1;
+	first = trace_first(&trace);
+
+	// with the population, run the commands again to show the devices the
+	// way the tester's verbose mode does; this only works from the start
+	if (dataFile_pG != NULL) {
+		if (first != 0) {
+			printf("the trace has wrapped (the first %"PRIu64" event(s) are gone), can't replay it\n", first);
+			goto traceClose;
+		}
+		ret = bussim_open(&sim, dataFile_pG);
+		if (ret != 0) {
+			printf("bad device population in %s\n", dataFile_pG);
+			goto traceClose;
+		}
+		replay = true;
+	}
+
+	memset(counts, 0, sizeof(counts));
+	for (n=first; n<trace.hdr_p->written; ++n) {
+		event_p = trace_event(&trace, n);
+		if (event_p == NULL)
+			break;
+		++counts[(unsigned char)event_p->cmd];
+		if (summary_G)
+			continue;
+
+		printf("%12.3f us  transport: 0x%02x (%c) bitPos:%d active:%"PRIu32"\n",
+				(double)event_p->ns / 1000.0, (unsigned char)event_p->cmd, event_p->cmd,
+				event_p->bitPos, event_p->active);
+		if (replay)
+			print_devices(&sim, event_p);
+		if (event_p->reply != 0)
+			printf("  <= %c\n", event_p->reply);
+		if (replay)
+			bussim_process(&sim, &event_p->cmd, 1, &reply);
+	}
+
+	printf("events: %"PRIu64" recorded, %"PRIu64" in the trace\n", trace.hdr_p->written,
+			trace.hdr_p->written - first);
+	for (i=0; i<256; ++i)
+		if (counts[i] > 0)
+			printf("  %c: %"PRIu64"\n", (char)i, counts[i]);
+	fnRtn = 0;
+
+	if (replay)
+		bussim_free(&sim);
+traceClose:
+	trace_close(&trace);
+	return fnRtn;
+}
+
+/**
+ * the devices a read or write is about to touch, as the tester's verbose
+ * mode shows them
+ */
+static void
+print_devices (BusSim_t *sim_p, const TraceEvent_t *event_p)
+{
+	size_t idx;
+	int bit;
+	DevSet_t *set_p = sim_p->listening_p;
+
+	if ((event_p->cmd == 'r') && (sim_p->function == BUSSIM_SEARCH) && (sim_p->readState < 2)) {
+		printf(" readState:%d bitPos:%d\n", sim_p->readState, set_p->bitPos);
+		for (idx=set_p->lo; idx<set_p->hi; ++idx) {
+			bit = (set_p->ids_p[idx] & (1llu << set_p->bitPos))? 1 : 0;
+			if (sim_p->readState == 1)
+				bit = !bit;
+			printf("  in search [%02zu] %cbit:%d\n", idx, (sim_p->readState==0? ' ' : '~'), bit);
+		}
+	}
+	if (((event_p->cmd == '0') || (event_p->cmd == '1')) &&
+			((sim_p->function == BUSSIM_MATCH) || (sim_p->function == BUSSIM_OD_MATCH) ||
+			 ((sim_p->function == BUSSIM_SEARCH) && (sim_p->readState == 2)))) {
+		printf(" readState:%d bitPos:%d\n", sim_p->readState, set_p->bitPos);
+		for (idx=set_p->lo; idx<set_p->hi; ++idx) {
+			bit = (set_p->ids_p[idx] & (1llu << set_p->bitPos))? 1 : 0;
+			if (bit != (event_p->cmd - '0'))
+				printf("   removing: %02zu\n", idx);
+		}
+	}
+}
+
+static void
+usage (const char *cmdline_p)
+{
+	if (cmdline_p == NULL) {
+		printf("bad usage\n");
+		return;
+	}
+
+	printf("usage: %s [<options>] <tracefile>\n", cmdline_p);
+	printf("  where:\n");
+	printf("    <tracefile>             a trace recorded with tester -T\n");
+	printf("    <options>\n");
+	printf("      -h|--help             print information about this program and exit successfully\n");
+	printf("      -d|--data <file>      the tester's population: replay the trace against it and\n");
+	printf("                            show the devices each read and write touches\n");
+	printf("      -s|--summary          only count the commands\n");
+}
+
+static int
+process_cmdline_args (int argc, char *argv[])
+{
+	int c;
+	struct option longOpts[] = {
+		{"help", no_argument, NULL, 'h'},
+		{"data", required_argument, NULL, 'd'},
+		{"summary", no_argument, NULL, 's'},
+		{NULL, 0, NULL, 0},
+	};
+
+	while (1) {
+		c = getopt_long(argc, argv, "hd:s", longOpts, 0);
+		if (c == -1)
+			break;
+		switch (c) {
+			case 'h':
+				printf("%s\n", PACKAGE_STRING);
+				usage(argv[0]);
+				exit(0);
+
+			case 'd':
+				dataFile_pG = optarg;
+				break;
+
+			case 's':
+				summary_G = true;
+				break;
+
+			default:
+				printf("cmdline arg error: %c (0x%02x)\n", c, c);
+				usage(argv[0]);
+				return -1;
+		}
+	}
+
+	if (argc != (optind + 1)) {
+		usage(argv[0]);
+		return -1;
+	}
+	traceFile_pG = argv[optind];
+
+	return 0;
+}
@@ -0,0 +1,899 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+/*
+ * time the hot paths of the search and of the tester in isolation
+ *
+ * every run uses the same seed, so the same populations are searched every
+ * time and the numbers can be compared between commits. one CSV line is
+ * written per measurement:
+ *	benchmark,transport,devices,bits,ops,ns_per_op,ops_per_sec
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include "common.h"
+#include "transport.h"
+#include "devset.h"
+#include "bussim.h"
+#include "search.h"
+#include "crc8.h"
+#include "romsearch.h"
+#include "config.h"
+
+#define DEFAULT_SEED 0x524f4d7365617263llu
+#define DEFAULT_OUTPUT "bench_output.txt"
+// roughly how many operations to time per measurement
+#define OPS_BUDGET (1u << 20)
+// building a list is quadratic, don't go past this
+#define MAX_LIST_SIZE 10000
+
+static const size_t sizes_G[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+static const int widths_G[] = {8, 16, 32, 64};
+static uint64_t seed_G = DEFAULT_SEED;
+static const char *output_pG = DEFAULT_OUTPUT;
+static size_t maxLocal_G = 1000000;
+static size_t maxRemote_G = 1000;
+static FILE *out_pG;
+
+// the found-device list that bench_list() builds
+typedef struct _devicenode {
+	struct _devicenode *next_p;
+	DeviceID_t device;
+} DeviceNode_t;
+
+// the other end of the link for the framing and search benchmarks
+typedef struct {
+	Transport_t transport;
+	BusSim_t *sim_p;
+} Responder_t;
+
+// the bus libromsearch searches in bench_library(): a simulator behind its
+// I/O functions, and when the devices turned up
+typedef struct {
+	BusSim_t *sim_p;
+	char *replies_p;
+	size_t repliesPos;
+	size_t repliesLen;
+	size_t repliesMax;
+	size_t found;
+	size_t stopAt;
+	double firstNs;
+} LibBus_t;
+
+static int process_cmdline_args (int argc, char *argv[]);
+static void usage (const char *cmdline_p);
+static double now_ns (void);
+static void report (const char *name_p, const char *transport_p, size_t devices, int bits, uint64_t ops, double ns);
+static uint64_t *make_ids (uint64_t *state_p, size_t count, int bits);
+static bool fits (size_t count, int bits);
+static void bench_tester (size_t count, int bits);
+static void bench_workstack (size_t count, int bits);
+static void bench_list (size_t count, int bits);
+static void free_nodes (DeviceNode_t *startNode_p);
+static DeviceNode_t *create_new_node (void);
+static DeviceNode_t *create_node_copy_device (DeviceID_t *deviceToCopy_p);
+static int add_node_to_list (DeviceNode_t *startNode_p, DeviceNode_t *nodeToAdd_p);
+static void bench_print_id (int bits);
+static void bench_output (int bits);
+static void bench_crc8 (size_t count);
+static void bench_remote (TransportType_e type, size_t count, int bits);
+static void bench_library (size_t count, int bits);
+static void *responder (void *arg_p);
+
+int
+main (int argc, char *argv[])
+{
+	size_t s, w;
+	int ret;
+
+	ret = process_cmdline_args(argc, argv);
+	if (ret != 0)
+		return 1;
+
+	if (strcmp(output_pG, "-") == 0)
+		out_pG = stdout;
+	else {
+		out_pG = fopen(output_pG, "w");
+		if (out_pG == NULL) {
+			perror("fopen output");
+			return 1;
+		}
+	}
+	fprintf(out_pG, "benchmark,transport,devices,bits,ops,ns_per_op,ops_per_sec\n");
+
+	for (w=0; w<sizeof(widths_G)/sizeof(widths_G[0]); ++w) {
+		bench_print_id(widths_G[w]);
+		bench_output(widths_G[w]);
+		for (s=0; s<sizeof(sizes_G)/sizeof(sizes_G[0]); ++s) {
+			if (!fits(sizes_G[s], widths_G[w]))
+				continue;
+			if (sizes_G[s] <= maxLocal_G) {
+				bench_tester(sizes_G[s], widths_G[w]);
+				bench_workstack(sizes_G[s], widths_G[w]);
+			}
+			if ((sizes_G[s] <= maxLocal_G) && (sizes_G[s] <= MAX_LIST_SIZE))
+				bench_list(sizes_G[s], widths_G[w]);
+			if (sizes_G[s] <= maxRemote_G) {
+				bench_remote(TRANSPORT_FIFO, sizes_G[s], widths_G[w]);
+				bench_remote(TRANSPORT_SHM, sizes_G[s], widths_G[w]);
+			}
+			if (sizes_G[s] <= maxLocal_G) {
+				bench_remote(TRANSPORT_SIM, sizes_G[s], widths_G[w]);
+				bench_library(sizes_G[s], widths_G[w]);
+			}
+			if ((widths_G[w] == CRC8_ROM_BITS) && (sizes_G[s] <= maxLocal_G))
+				bench_crc8(sizes_G[s]);
+		}
+	}
+
+	if (out_pG != stdout) {
+		fclose(out_pG);
+		fprintf(stderr, "results written to %s\n", output_pG);
+	}
+	return 0;
+}
+
+static double
+now_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void
+report (const char *name_p, const char *transport_p, size_t devices, int bits, uint64_t ops, double ns)
+{
+	double perOp;
+
+	/* preconds */
+	if (ops == 0)
+		return;
+
+	perOp = ns / (double)ops;
+	fprintf(out_pG, "%s,%s,%zu,%d,%"PRIu64",%.2f,%.0f\n", name_p, transport_p,
+			devices, bits, ops, perOp, (perOp > 0)? 1e9 / perOp : 0);
+	fflush(out_pG);
+	fprintf(stderr, "%-18s %-5s %8zu devices %2d bits: %10.2f ns/op\n",
+			name_p, transport_p, devices, bits, perOp);
+}
+
+/**
+ * only populations that are at most half of the ID space; anything denser
+ * takes too long to fill with unique IDs and isn't realistic anyway
+ */
+static bool
+fits (size_t count, int bits)
+{
+	if (bits >= 40)
+		return true;
+	return (uint64_t)count * 2 <= (1llu << bits);
+}
+
+static int
+u64_cmp (const void *a_p, const void *b_p)
+{
+	uint64_t a = *(const uint64_t*)a_p;
+	uint64_t b = *(const uint64_t*)b_p;
+
+	return (a > b) - (a < b);
+}
+
+/**
+ * <count> unique random <bits>-bit IDs, in random order
+ */
+static uint64_t *
+make_ids (uint64_t *state_p, size_t count, int bits)
+{
+	uint64_t *ids_p, *sorted_p;
+	uint64_t mask;
+	size_t have, i, j;
+
+	mask = (bits >= 64)? ~0llu : (1llu << bits) - 1;
+	ids_p = malloc(count * sizeof(*ids_p));
+	sorted_p = malloc(count * sizeof(*sorted_p));
+	if ((ids_p == NULL) || (sorted_p == NULL)) {
+		free(ids_p);
+		free(sorted_p);
+		return NULL;
+	}
+
+	// draw, sort, drop duplicates and top up until there are enough
+	have = 0;
+	while (have < count) {
+		for (i=have; i<count; ++i)
+			sorted_p[i] = prng_next(state_p) & mask;
+		qsort(sorted_p, count, sizeof(*sorted_p), u64_cmp);
+		for (i=1, j=1; i<count; ++i)
+			if (sorted_p[i] != sorted_p[j-1])
+				sorted_p[j++] = sorted_p[i];
+		have = j;
+	}
+
+	// shuffle so the walks below don't follow the search order
+	memcpy(ids_p, sorted_p, count * sizeof(*ids_p));
+	for (i=count; i>1; --i) {
+		j = (size_t)(prng_next(state_p) % i);
+		mask = ids_p[i-1];
+		ids_p[i-1] = ids_p[j];
+		ids_p[j] = mask;
+	}
+	free(sorted_p);
+	return ids_p;
+}
+
+/**
+ * the tester's 'r' and '0'/'1' handlers: walk the bus down to single devices
+ * once doing the two reads and the direction bit at every position, then the
+ * same walks again with only the direction bits; the difference is the reads
+ */
+static void
+bench_tester (size_t count, int bits)
+{
+	uint64_t state = seed_G;
+	uint64_t *ids_p, *set_p;
+	DevSet_t set;
+	size_t walks, walk;
+	uint64_t id;
+	int pos, sink;
+	double start, both, selectOnly;
+
+	ids_p = make_ids(&state, count, bits);
+	if (ids_p == NULL)
+		return;
+	set_p = malloc(count * sizeof(*set_p));
+	if (set_p == NULL) {
+		free(ids_p);
+		return;
+	}
+	memcpy(set_p, ids_p, count * sizeof(*set_p));
+	if (devset_init(&set, set_p, count, bits) != 0) {
+		free(ids_p);
+		free(set_p);
+		return;
+	}
+
+	walks = OPS_BUDGET / (size_t)bits;
+	sink = 0;
+
+	start = now_ns();
+	for (walk=0; walk<walks; ++walk) {
+		id = ids_p[walk % count];
+		devset_reset(&set);
+		for (pos=0; pos<bits; ++pos) {
+			sink += devset_read(&set, false);
+			sink += devset_read(&set, true);
+			devset_select(&set, (int)((id >> pos) & 1));
+		}
+	}
+	both = now_ns() - start;
+
+	start = now_ns();
+	for (walk=0; walk<walks; ++walk) {
+		id = ids_p[walk % count];
+		devset_reset(&set);
+		for (pos=0; pos<bits; ++pos)
+			devset_select(&set, (int)((id >> pos) & 1));
+	}
+	selectOnly = now_ns() - start;
+
+	if (sink == -1)
+		printf("\n");
+	report("tester_read", "-", count, bits, (uint64_t)walks * (uint64_t)bits * 2,
+			(both > selectOnly)? both - selectOnly : 0);
+	report("tester_direction", "-", count, bits, (uint64_t)walks * (uint64_t)bits, selectOnly);
+
+	free(ids_p);
+	free(set.ids_p);
+}
+
+/**
+ * check the CRC8 of <count> IDs (half of them good) with each kernel this
+ * CPU can run; the kernel goes in the transport column
+ */
+static void
+bench_crc8 (size_t count)
+{
+	uint64_t state = seed_G;
+	uint64_t *ids_p;
+	size_t rounds, round, i, good;
+	Crc8Kernel_e kernel;
+	double start;
+
+	ids_p = make_ids(&state, count, CRC8_ROM_BITS);
+	if (ids_p == NULL)
+		return;
+	for (i=0; i<count; ++i) {
+		ids_p[i] = crc8_rom_fix(ids_p[i]);
+		if (i & 1)
+			ids_p[i] ^= (uint64_t)1 << 56;
+	}
+	rounds = (OPS_BUDGET + count - 1) / count;
+
+	for (kernel=CRC8_KERNEL_SCALAR; kernel<=CRC8_KERNEL_SSSE3; ++kernel) {
+		if (crc8_set_kernel(kernel) != 0)
+			continue;
+		good = 0;
+		start = now_ns();
+		for (round=0; round<rounds; ++round)
+			good += crc8_rom_check(ids_p, count, NULL);
+		if (good != rounds * ((count + 1) / 2))
+			fprintf(stderr, "crc8 %s: %zu good, expected %zu\n", crc8_kernel_name(), good, rounds * ((count + 1) / 2));
+		report("crc8_check", crc8_kernel_name(), count, CRC8_ROM_BITS, (uint64_t)rounds * count, now_ns() - start);
+	}
+	crc8_set_kernel(CRC8_KERNEL_AUTO);
+
+	free(ids_p);
+}
+
+/**
+ * push <count> pending forks, then pop them all
+ */
+static void
+bench_workstack (size_t count, int bits)
+{
+	uint64_t state = seed_G;
+	WorkStack_t stack;
+	DeviceID_t device;
+	size_t rounds, round, i;
+	double start;
+
+	rounds = (OPS_BUDGET + count - 1) / count;
+	memset(&device, 0, sizeof(device));
+	workstack_init(&stack);
+
+	start = now_ns();
+	for (round=0; round<rounds; ++round) {
+		for (i=0; i<count; ++i) {
+			device_set_value(&device, prng_next(&state), (size_t)bits);
+			workstack_push(&stack, &device);
+		}
+		while (workstack_pop(&stack, &device))
+			;
+	}
+	report("workstack_push_pop", "-", count, bits, (uint64_t)rounds * count, now_ns() - start);
+
+	workstack_free(&stack);
+}
+
+// the found-device list the fork engine kept before the work stack (and
+// the output) took over, only here for bench_list() to measure against
+static void
+free_nodes (DeviceNode_t *startNode_p)
+{
+	DeviceNode_t *next_p;
+
+	/* preconds */
+	if (startNode_p == NULL)
+		return;
+
+	while (startNode_p != NULL) {
+		next_p = startNode_p->next_p;
+		free(startNode_p);
+		startNode_p = next_p;
+	}
+}
+
+static DeviceNode_t *
+create_new_node (void)
+{
+	DeviceNode_t *newNode_p;
+
+	/* preconds */
+	// none
+
+	// node
+	newNode_p = (DeviceNode_t*)malloc(sizeof(DeviceNode_t));
+	if (newNode_p == NULL) {
+		perror("malloc");
+		return NULL;
+	}
+
+	// device
+	newNode_p->device.value = 0;
+	newNode_p->device.bitLen = 0;
+	newNode_p->device.done = false;
+
+	// list
+	newNode_p->next_p = NULL;
+
+	return newNode_p;
+}
+
+static DeviceNode_t *
+create_node_copy_device (DeviceID_t *deviceToCopy_p)
+{
+	DeviceNode_t *newNode_p;
+
+	/* preconds */
+	if (deviceToCopy_p == NULL)
+		return NULL;
+
+	newNode_p = create_new_node();
+	if (newNode_p == NULL)
+		return NULL;
+
+	newNode_p->device = *deviceToCopy_p;
+
+	return newNode_p;
+}
+
+static int
+add_node_to_list (DeviceNode_t *startNode_p, DeviceNode_t *nodeToAdd_p)
+{
+	DeviceNode_t *curNode_p;
+
+	/* preconds */
+	if (startNode_p == NULL)
+		return -1;
+	if (nodeToAdd_p == NULL)
+		return -1;
+
+	curNode_p = startNode_p;
+	while (curNode_p->next_p != NULL)
+		curNode_p = curNode_p->next_p;
+	curNode_p->next_p = nodeToAdd_p;
+
+	return 0;
+}
+
+/**
+ * build a found-device list of <count> entries the way the fork engine used to
+ */
+static void
+bench_list (size_t count, int bits)
+{
+	uint64_t state = seed_G;
+	DeviceNode_t head;
+	DeviceNode_t *node_p;
+	DeviceID_t device;
+	size_t rounds, round, i;
+	double start, elapsed;
+
+	rounds = OPS_BUDGET / (count * count);
+	if (rounds == 0)
+		rounds = 1;
+	memset(&device, 0, sizeof(device));
+
+	elapsed = 0;
+	for (round=0; round<rounds; ++round) {
+		memset(&head, 0, sizeof(head));
+		start = now_ns();
+		for (i=0; i<count; ++i) {
+			device_set_value(&device, prng_next(&state), (size_t)bits);
+			node_p = create_node_copy_device(&device);
+			if (node_p == NULL)
+				break;
+			add_node_to_list(&head, node_p);
+		}
+		elapsed += now_ns() - start;
+		free_nodes(head.next_p);
+	}
+	report("list_copy_add", "-", count, bits, (uint64_t)rounds * count, elapsed);
+}
+
+/**
+ * print_id() with stdout pointed at /dev/null
+ */
+static void
+bench_print_id (int bits)
+{
+	uint64_t state = seed_G;
+	DeviceID_t device;
+	int savedFd, nullFd;
+	size_t ops, i;
+	double start, elapsed;
+
+	fflush(stdout);
+	savedFd = dup(STDOUT_FILENO);
+	nullFd = open("/dev/null", O_WRONLY);
+	if ((savedFd == -1) || (nullFd == -1)) {
+		perror("open /dev/null");
+		goto cleanup;
+	}
+	dup2(nullFd, STDOUT_FILENO);
+
+	ops = OPS_BUDGET / 8;
+	memset(&device, 0, sizeof(device));
+	start = now_ns();
+	for (i=0; i<ops; ++i) {
+		device_set_value(&device, prng_next(&state), (size_t)bits);
+		print_id(&device, bits);
+		putchar('\n');
+	}
+	fflush(stdout);
+	elapsed = now_ns() - start;
+
+	dup2(savedFd, STDOUT_FILENO);
+	report("print_id", "-", 1, bits, ops, elapsed);
+
+cleanup:
+	if (nullFd != -1)
+		close(nullFd);
+	if (savedFd != -1)
+		close(savedFd);
+}
+
+/**
+ * the result output in each format, into /dev/null
+ */
+static void
+bench_output (int bits)
+{
+	uint64_t state;
+	DeviceID_t device;
+	FILE *null_p;
+	Output_t output;
+	OutputFormat_e format;
+	size_t ops, i;
+	double start, elapsed;
+	char name[32];
+
+	null_p = fopen("/dev/null", "w");
+	if (null_p == NULL) {
+		perror("open /dev/null");
+		return;
+	}
+
+	ops = OPS_BUDGET / 8;
+	memset(&device, 0, sizeof(device));
+	for (format=OUTPUT_DEC; format<OUTPUT_FORMATS; ++format) {
+		if (output_open(&output, null_p, format, OUTPUT_DEFAULT_BUFFER) != 0)
+			break;
+		state = seed_G;
+		start = now_ns();
+		for (i=0; i<ops; ++i) {
+			device_set_value(&device, prng_next(&state), (size_t)bits);
+			output_device(&output, -1, OUTPUT_TAG_NONE, &device);
+		}
+		output_close(&output);
+		elapsed = now_ns() - start;
+
+		snprintf(name, sizeof(name), "output_%s", output_format_name(format));
+		report(name, "-", 1, bits, ops, elapsed);
+	}
+
+	fclose(null_p);
+}
+
+/**
+ * get_next_digits() walking the bus one direction bit at a time, then a full
+ * fork-engine search: the time per find_one_device()
+ *
+ * for fifo and shm the bus is run by a responder thread at the other end of
+ * the link, for sim it's called directly
+ */
+static void
+bench_remote (TransportType_e type, size_t count, int bits)
+{
+	uint64_t state = seed_G;
+	const char *name_p;
+	Responder_t resp;
+	pthread_t thread;
+	Bus_t bus;
+	BusSim_t sim;
+	uint64_t *ids_p;
+	unsigned digits;
+	size_t ops, i;
+	double start, elapsed;
+	char sendCh;
+	int pass;
+
+	name_p = (type == TRANSPORT_SHM)? "shm" : (type == TRANSPORT_SIM)? "sim" : "fifo";
+	ids_p = make_ids(&state, count, bits);
+	if (ids_p == NULL)
+		return;
+	if (bussim_init(&sim, ids_p, count, bits) != 0) {
+		free(ids_p);
+		return;
+	}
+
+	for (pass=0; pass<2; ++pass) {
+		memset(&resp, 0, sizeof(resp));
+		resp.sim_p = &sim;
+		bus_init(&bus, (int)getpid());
+		bus.collect = true;
+
+		// the tester side of an shm link has to be there first
+		if (type != TRANSPORT_SIM)
+			if (transport_open(&resp.transport, type, TRANSPORT_TESTER, false, bus.busNum) != 0)
+				break;
+		if (transport_open(&bus.transport, type, TRANSPORT_MASTER, false, bus.busNum) != 0) {
+			if (type != TRANSPORT_SIM)
+				transport_close(&resp.transport);
+			break;
+		}
+		if (type == TRANSPORT_SIM)
+			transport_attach_sim(&bus.transport, &sim);
+		else if (pthread_create(&thread, NULL, responder, &resp) != 0) {
+			transport_close(&bus.transport);
+			transport_close(&resp.transport);
+			break;
+		}
+
+		if (pass == 0) {
+			ops = OPS_BUDGET / 256;
+			transport_send(&bus.transport, "RS", 2);
+			start = now_ns();
+			for (i=0; i<ops; ++i) {
+				if (bus_next_digits(&bus, &digits) != 0)
+					break;
+				// follow any device down, start over at the end
+				if (digits == 3)
+					transport_send(&bus.transport, "RS", 2);
+				else
+					transport_send(&bus.transport, (digits == 2)? "1" : "0", 1);
+			}
+			elapsed = now_ns() - start;
+			report("get_next_digits", name_p, count, bits, i, elapsed);
+		}
+		else {
+			start = now_ns();
+			bus_search(&bus);
+			elapsed = now_ns() - start;
+			report("find_one_device", name_p, count, bits, bus.devicesFound, elapsed);
+			if (bus.devicesFound != count)
+				fprintf(stderr, "find_one_device: found %"PRIu64" of %zu devices\n", bus.devicesFound, count);
+		}
+
+		sendCh = 'Q';
+		transport_send(&bus.transport, &sendCh, 1);
+		if (type != TRANSPORT_SIM)
+			pthread_join(thread, NULL);
+		transport_close(&bus.transport);
+		if (type != TRANSPORT_SIM)
+			transport_close(&resp.transport);
+		bus_free(&bus);
+	}
+
+	bussim_free(&sim);
+}
+
+static int
+lib_send (void *ctx_p, const char *buf_p, size_t len)
+{
+	LibBus_t *lib_p = (LibBus_t*)ctx_p;
+	char *newReplies_p;
+	size_t newMax;
+
+	if (lib_p->repliesPos == lib_p->repliesLen)
+		lib_p->repliesPos = lib_p->repliesLen = 0;
+	if (lib_p->repliesLen + len > lib_p->repliesMax) {
+		newMax = lib_p->repliesMax? lib_p->repliesMax : 256;
+		while (lib_p->repliesLen + len > newMax)
+			newMax *= 2;
+		newReplies_p = realloc(lib_p->replies_p, newMax);
+		if (newReplies_p == NULL)
+			return -1;
+		lib_p->replies_p = newReplies_p;
+		lib_p->repliesMax = newMax;
+	}
+	lib_p->repliesLen += bussim_process(lib_p->sim_p, buf_p, len, lib_p->replies_p + lib_p->repliesLen);
+	return 0;
+}
+
+static ssize_t
+lib_recv (void *ctx_p, char *buf_p, size_t len, int timeoutMs)
+{
+	LibBus_t *lib_p = (LibBus_t*)ctx_p;
+	size_t avail;
+
+	(void)timeoutMs;
+	avail = lib_p->repliesLen - lib_p->repliesPos;
+	if (avail == 0)
+		return ROMSEARCH_IO_TIMEOUT;
+	if (len > avail)
+		len = avail;
+	memcpy(buf_p, lib_p->replies_p + lib_p->repliesPos, len);
+	lib_p->repliesPos += len;
+	return (ssize_t)len;
+}
+
+static int
+lib_device (void *ctx_p, uint64_t id, unsigned bits)
+{
+	LibBus_t *lib_p = (LibBus_t*)ctx_p;
+
+	(void)id;
+	(void)bits;
+	if (lib_p->found++ == 0)
+		lib_p->firstNs = now_ns();
+	return (lib_p->found == lib_p->stopAt)? 1 : 0;
+}
+
+/**
+ * libromsearch searching a simulated bus through its own I/O functions:
+ * how soon the first device comes out, the time per device for the whole
+ * bus, and a search cancelled half way
+ */
+static void
+bench_library (size_t count, int bits)
+{
+	uint64_t state = seed_G;
+	uint64_t *ids_p;
+	BusSim_t sim;
+	LibBus_t lib;
+	RomSearch_t *rs_p;
+	RomSearchIo_t io;
+	RomSearchResult_e ret;
+	double start, elapsed;
+
+	ids_p = make_ids(&state, count, bits);
+	if (ids_p == NULL)
+		return;
+	if (bussim_init(&sim, ids_p, count, bits) != 0) {
+		free(ids_p);
+		return;
+	}
+	rs_p = romsearch_new(NULL);
+	if (rs_p == NULL) {
+		bussim_free(&sim);
+		return;
+	}
+
+	memset(&lib, 0, sizeof(lib));
+	lib.sim_p = &sim;
+	io.send_p = lib_send;
+	io.recv_p = lib_recv;
+	io.ctx_p = &lib;
+	if (romsearch_set_io(rs_p, &io) != 0)
+		goto cleanup;
+	romsearch_set_callback(rs_p, lib_device, &lib);
+
+	start = now_ns();
+	ret = romsearch_run(rs_p);
+	elapsed = now_ns() - start;
+	if ((ret != ROMSEARCH_OK) || (lib.found != count))
+		fprintf(stderr, "library_search: found %zu of %zu devices\n", lib.found, count);
+	report("library_first", "sim", count, bits, 1, lib.firstNs - start);
+	report("library_search", "sim", count, bits, lib.found, elapsed);
+
+	if (count > 1) {
+		lib.found = 0;
+		lib.stopAt = count / 2;
+		ret = romsearch_run(rs_p);
+		if ((ret != ROMSEARCH_CANCELLED) || (lib.found != lib.stopAt))
+			fprintf(stderr, "library_cancel: stopped after %zu of %zu devices\n", lib.found, lib.stopAt);
+	}
+
+cleanup:
+	romsearch_free(rs_p);
+	free(lib.replies_p);
+	bussim_free(&sim);
+}
+
+/**
+ * the tester's protocol loop, cut down to what the search uses
+ */
+static void *
+responder (void *arg_p)
+{
+	Responder_t *resp_p = (Responder_t*)arg_p;
+	char rxBuf[256], txBuf[256];
+	ssize_t retRead;
+	size_t len, txLen;
+	char *quit_p;
+
+	while (1) {
+		retRead = transport_recv(&resp_p->transport, rxBuf, sizeof(rxBuf));
+		if (retRead <= 0)
+			break;
+		len = (size_t)retRead;
+		quit_p = memchr(rxBuf, 'Q', len);
+		if (quit_p != NULL)
+			len = (size_t)(quit_p - rxBuf);
+
+		txLen = bussim_process(resp_p->sim_p, rxBuf, len, txBuf);
+		if (txLen > 0)
+			transport_send(&resp_p->transport, txBuf, txLen);
+		if (quit_p != NULL)
+			break;
+	}
+
+	return NULL;
+}
+
+static void
+usage (const char *cmdline_p)
+{
+	/* preconds */
+	//none
+
+	if (cmdline_p == NULL) {
+		printf("bad usage\n");
+		return;
+	}
+
+	printf("usage: %s [<options>]\n", cmdline_p);
+	printf("  where:\n");
+	printf("    <options>\n");
+	printf("      -h|--help             print information about this program and exit successfully\n");
+	printf("      -o|--output <file>    write the CSV results to <file>, '-' for stdout\n");
+	printf("                            (default: %s)\n", DEFAULT_OUTPUT);
+	printf("      -s|--seed <n>         seed for the device populations (default: fixed)\n");
+	printf("      -m|--max-local <n>    largest population for the in-memory benchmarks and the\n");
+	printf("                            searches over the sim transport\n");
+	printf("                            (default: 1000000)\n");
+	printf("      -M|--max-remote <n>   largest population to search over fifo and shm\n");
+	printf("                            (default: 1000)\n");
+	printf("      -q|--quick            small populations only (-m 10000 -M 100)\n");
+}
+
+static int
+process_cmdline_args (int argc, char *argv[])
+{
+	int c;
+	unsigned long long val;
+	char *end_p;
+	struct option longOpts[] = {
+		{"help", no_argument, NULL, 'h'},
+		{"output", required_argument, NULL, 'o'},
+		{"seed", required_argument, NULL, 's'},
+		{"max-local", required_argument, NULL, 'm'},
+		{"max-remote", required_argument, NULL, 'M'},
+		{"quick", no_argument, NULL, 'q'},
+		{NULL, 0, NULL, 0},
+	};
+
+	while (1) {
+		c = getopt_long(argc, argv, "ho:s:m:M:q", longOpts, 0);
+		if (c == -1)
+			break;
+		switch (c) {
+			case 'h':
+				printf("%s\n", PACKAGE_STRING);
+				usage(argv[0]);
+				exit(0);
+
+			case 'o':
+				output_pG = optarg;
+				break;
+
+			case 's':
+				val = strtoull(optarg, &end_p, 0);
+				if ((*optarg == '\0') || (*end_p != '\0')) {
+					usage(argv[0]);
+					return -1;
+				}
+				seed_G = val;
+				break;
+
+			case 'm':
+			case 'M':
+				val = strtoull(optarg, &end_p, 0);
+				if ((*optarg == '\0') || (*end_p != '\0')) {
+					usage(argv[0]);
+					return -1;
+				}
+				if (c == 'm')
+					maxLocal_G = (size_t)val;
+				else
+					maxRemote_G = (size_t)val;
+				break;
+
+			case 'q':
+				maxLocal_G = 10000;
+				maxRemote_G = 100;
+				break;
+
+			default:
+				usage(argv[0]);
+				return -1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,686 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "common.h"
+#include "devset.h"
+#include "bussim.h"
+
+static int bussim_setup (BusSim_t *sim_p);
+static int fault_read (BusSim_t *sim_p, bool complement, int bit);
+
+static const char *faultNames_pG[BUSSIM_FAULTS] = {
+	"flip",
+	"drop",
+	"ones",
+	"vanish",
+};
+
+/**
+ * take over the given array of IDs (see devset_init())
+ */
+int
+bussim_init (BusSim_t *sim_p, uint64_t *ids_p, size_t count, int bitSize)
+{
+	/* preconds */
+	if (sim_p == NULL)
+		return -1;
+
+	memset(sim_p, 0, sizeof(*sim_p));
+	if (devset_init(&sim_p->devices, ids_p, count, bitSize) != 0)
+		return -1;
+	return bussim_setup(sim_p);
+}
+
+/**
+ * a population from a data file: a binary dataset is mapped and used in
+ * place, anything else is read as the text format (see bussim_load_file())
+ */
+int
+bussim_open (BusSim_t *sim_p, const char *fileName_p)
+{
+	int ret;
+	uint64_t *ids_p, *alarms_p;
+	size_t count, numAlarms;
+	int bitSize;
+
+	/* preconds */
+	if ((sim_p == NULL) || (fileName_p == NULL))
+		return -1;
+
+	memset(sim_p, 0, sizeof(*sim_p));
+	ret = dataset_map(fileName_p, &sim_p->dataset);
+	if (ret == -1)
+		return -1;
+	if (ret == 0) {
+		devset_init_sorted(&sim_p->devices, sim_p->dataset.ids_p, sim_p->dataset.count, sim_p->dataset.bitSize);
+		ret = bussim_setup(sim_p);
+		if (ret == 0)
+			ret = devset_init_sorted(&sim_p->alarmDevices, sim_p->dataset.alarms_p,
+					sim_p->dataset.numAlarms, sim_p->dataset.bitSize);
+		if (ret != 0)
+			bussim_free(sim_p);
+		return ret;
+	}
+
+	ret = bussim_load_file(fileName_p, &ids_p, &count, &bitSize, &alarms_p, &numAlarms);
+	if (ret != 0)
+		return -1;
+	ret = bussim_init(sim_p, ids_p, count, bitSize);
+	if (ret != 0) {
+		free(ids_p);
+		free(alarms_p);
+		return -1;
+	}
+	ret = bussim_set_alarms(sim_p, alarms_p, numAlarms);
+	if (ret != 0) {
+		free(alarms_p);
+		bussim_free(sim_p);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * everything but the devices themselves
+ */
+static int
+bussim_setup (BusSim_t *sim_p)
+{
+	size_t count = sim_p->devices.count;
+	int bitSize = sim_p->devices.bitSize;
+
+	sim_p->overdrive_p = (bool*)calloc(count? count : 1, sizeof(bool));
+	if (sim_p->overdrive_p == NULL)
+		return -1;
+	devset_init(&sim_p->odDevices, NULL, 0, bitSize);
+	devset_init(&sim_p->alarmDevices, NULL, 0, bitSize);
+	devset_init(&sim_p->odAlarmDevices, NULL, 0, bitSize);
+	sim_p->faults.vanished = SIZE_MAX;
+	bussim_reset(sim_p);
+	memset(&sim_p->slots, 0, sizeof(sim_p->slots));
+	return 0;
+}
+
+void
+bussim_free (BusSim_t *sim_p)
+{
+	/* preconds */
+	if (sim_p == NULL)
+		return;
+
+	if (sim_p->dataset.map_p != NULL) {
+		// the devices (and maybe the alarms) are in the mapping
+		if (sim_p->alarmDevices.ids_p == sim_p->dataset.alarms_p)
+			sim_p->alarmDevices.ids_p = NULL;
+		dataset_unmap(&sim_p->dataset);
+	}
+	else
+		free(sim_p->devices.ids_p);
+	sim_p->devices.ids_p = NULL;
+	sim_p->devices.count = 0;
+	free(sim_p->odDevices.ids_p);
+	sim_p->odDevices.ids_p = NULL;
+	sim_p->odDevices.count = 0;
+	free(sim_p->overdrive_p);
+	sim_p->overdrive_p = NULL;
+	free(sim_p->alarmDevices.ids_p);
+	sim_p->alarmDevices.ids_p = NULL;
+	sim_p->alarmDevices.count = 0;
+	free(sim_p->odAlarmDevices.ids_p);
+	sim_p->odAlarmDevices.ids_p = NULL;
+	sim_p->odAlarmDevices.count = 0;
+}
+
+/**
+ * take over the list of devices that have their alarm flag set
+ * IDs that aren't on the bus are dropped
+ */
+int
+bussim_set_alarms (BusSim_t *sim_p, uint64_t *alarmIds_p, size_t numAlarms)
+{
+	size_t i, n;
+
+	/* preconds */
+	if (sim_p == NULL)
+		return -1;
+	if ((alarmIds_p == NULL) && (numAlarms > 0))
+		return -1;
+
+	for (i=0, n=0; i<numAlarms; ++i)
+		if (devset_find(&sim_p->devices, alarmIds_p[i]) != sim_p->devices.count)
+			alarmIds_p[n++] = alarmIds_p[i];
+
+	if ((sim_p->dataset.map_p == NULL) || (sim_p->alarmDevices.ids_p != sim_p->dataset.alarms_p))
+		free(sim_p->alarmDevices.ids_p);
+	return devset_init(&sim_p->alarmDevices, alarmIds_p, n, sim_p->devices.bitSize);
+}
+
+/**
+ * input file format:
+ * <number of entries>
+ * <number of bits>
+ * <unique serial id> [A]… * N
+ *
+ * an 'A' after the ID means the device's alarm flag is set
+ * the alarmed IDs are returned separately (if alarmsOut_p isn't NULL)
+ */
+int
+bussim_load_file (const char *fileName_p, uint64_t **idsOut_p, size_t *countOut_p, int *bitSizeOut_p,
+		uint64_t **alarmsOut_p, size_t *numAlarmsOut_p)
+{
+	int numEntries, bitSize, i;
+	int fnRtn = -1;
+	FILE *dataFile_p = NULL;
+	char dataBuf[48];
+	char flag;
+	uint64_t *ids_p = NULL;
+	uint64_t *alarms_p = NULL;
+	size_t numAlarms = 0;
+
+	/* preconds */
+	if (fileName_p == NULL)
+		return -1;
+	if ((idsOut_p == NULL) || (countOut_p == NULL) || (bitSizeOut_p == NULL))
+		return -1;
+	if ((alarmsOut_p != NULL) && (numAlarmsOut_p == NULL))
+		return -1;
+
+	dataFile_p = fopen(fileName_p, "r");
+	if (dataFile_p == NULL) {
+		perror("open data file");
+		return -1;
+	}
+
+	// 1st line → entries
+	if (fgets(dataBuf, sizeof(dataBuf), dataFile_p) == NULL) {
+		perror("reading 1st line");
+		goto closeDataFile;
+	}
+	if ((sscanf(dataBuf, "%i", &numEntries) != 1) || (numEntries < 0)) {
+		perror("parsing numEntries");
+		goto closeDataFile;
+	}
+
+	// 2nd line → bit size
+	if (fgets(dataBuf, sizeof(dataBuf), dataFile_p) == NULL) {
+		perror("reading 2nd line");
+		goto closeDataFile;
+	}
+	if ((sscanf(dataBuf, "%i", &bitSize) != 1) || (bitSize < 1) || (bitSize > 64)) {
+		perror("parsing bitSize");
+		goto closeDataFile;
+	}
+
+	ids_p = (uint64_t*)malloc((size_t)(numEntries? numEntries : 1) * sizeof(uint64_t));
+	alarms_p = (uint64_t*)malloc((size_t)(numEntries? numEntries : 1) * sizeof(uint64_t));
+	if ((ids_p == NULL) || (alarms_p == NULL)) {
+		fprintf(stderr, "can't allocate memory\n");
+		goto postAllocFail;
+	}
+	for (i=0; i<numEntries; ++i) {
+		if (fgets(dataBuf, sizeof(dataBuf), dataFile_p) == NULL) {
+			fprintf(stderr, "error getting entry %i from data file\n", i);
+			goto postAllocFail;
+		}
+		flag = 0;
+		if (sscanf(dataBuf, "%"SCNu64" %c", &ids_p[i], &flag) < 1) {
+			fprintf(stderr, "error converting entry %i from data file\n", i);
+			goto postAllocFail;
+		}
+		if ((flag == 'A') || (flag == 'a'))
+			alarms_p[numAlarms++] = ids_p[i];
+	}
+
+	*idsOut_p = ids_p;
+	*countOut_p = (size_t)numEntries;
+	*bitSizeOut_p = bitSize;
+	if (alarmsOut_p != NULL) {
+		*alarmsOut_p = alarms_p;
+		*numAlarmsOut_p = numAlarms;
+	}
+	else
+		free(alarms_p);
+	fnRtn = 0;
+	goto closeDataFile;
+
+postAllocFail:
+	free(ids_p);
+	free(alarms_p);
+closeDataFile:
+	if (dataFile_p != NULL)
+		fclose(dataFile_p);
+	return fnRtn;
+}
+
+/**
+ * bus reset: all devices back in the running at standard speed, no ROM
+ * function selected
+ */
+void
+bussim_reset (BusSim_t *sim_p)
+{
+	/* preconds */
+	if (sim_p == NULL)
+		return;
+
+	busslots_add_cmd(&sim_p->slots, 'R');
+	if (sim_p->numOverdrive > 0) {
+		memset(sim_p->overdrive_p, 0, sim_p->devices.count * sizeof(bool));
+		sim_p->numOverdrive = 0;
+		sim_p->odDirty = true;
+	}
+	sim_p->function = BUSSIM_NONE;
+	sim_p->readState = 0;
+	sim_p->listening_p = &sim_p->devices;
+	devset_reset(sim_p->listening_p);
+	sim_p->faults.onesPending = false;
+	sim_p->faults.vanished = SIZE_MAX;
+}
+
+/**
+ * gather the overdrive devices into their own set
+ */
+static int
+rebuild_od_devices (BusSim_t *sim_p)
+{
+	uint64_t *ids_p;
+	size_t i, n;
+
+	ids_p = (uint64_t*)malloc((sim_p->numOverdrive? sim_p->numOverdrive : 1) * sizeof(uint64_t));
+	if (ids_p == NULL)
+		return -1;
+	for (i=0, n=0; i<sim_p->devices.count; ++i)
+		if (sim_p->overdrive_p[i])
+			ids_p[n++] = sim_p->devices.ids_p[i];
+
+	free(sim_p->odDevices.ids_p);
+	devset_init(&sim_p->odDevices, ids_p, n, sim_p->devices.bitSize);
+	sim_p->odDirty = false;
+	return 0;
+}
+
+/**
+ * overdrive reset: too short for devices at standard speed, only the ones
+ * in overdrive take part in what follows
+ */
+void
+bussim_reset_overdrive (BusSim_t *sim_p)
+{
+	/* preconds */
+	if (sim_p == NULL)
+		return;
+
+	busslots_add_cmd(&sim_p->slots, 'D');
+	sim_p->function = BUSSIM_NONE;
+	sim_p->readState = 0;
+	if (sim_p->numOverdrive == sim_p->devices.count)
+		sim_p->listening_p = &sim_p->devices;
+	else {
+		if (sim_p->odDirty && (rebuild_od_devices(sim_p) != 0))
+			sim_p->odDevices.count = 0;
+		sim_p->listening_p = &sim_p->odDevices;
+	}
+	devset_reset(sim_p->listening_p);
+	sim_p->faults.onesPending = false;
+	sim_p->faults.vanished = SIZE_MAX;
+}
+
+/**
+ * the alarmed devices that are also in overdrive
+ */
+static int
+rebuild_od_alarm_devices (BusSim_t *sim_p)
+{
+	uint64_t *ids_p;
+	size_t i, n, idx;
+
+	ids_p = (uint64_t*)malloc((sim_p->alarmDevices.count? sim_p->alarmDevices.count : 1) * sizeof(uint64_t));
+	if (ids_p == NULL)
+		return -1;
+	for (i=0, n=0; i<sim_p->alarmDevices.count; ++i) {
+		idx = devset_find(&sim_p->devices, sim_p->alarmDevices.ids_p[i]);
+		if ((idx < sim_p->devices.count) && sim_p->overdrive_p[idx])
+			ids_p[n++] = sim_p->alarmDevices.ids_p[i];
+	}
+
+	free(sim_p->odAlarmDevices.ids_p);
+	return devset_init(&sim_p->odAlarmDevices, ids_p, n, sim_p->devices.bitSize);
+}
+
+static void
+set_overdrive (BusSim_t *sim_p, size_t idx)
+{
+	if ((idx >= sim_p->devices.count) || sim_p->overdrive_p[idx])
+		return;
+	sim_p->overdrive_p[idx] = true;
+	++sim_p->numOverdrive;
+	sim_p->odDirty = true;
+}
+
+void
+bussim_function (BusSim_t *sim_p, BusSimFunction_e function)
+{
+	size_t i;
+	static const char cmds[] = {
+		[BUSSIM_NONE] = 0,
+		[BUSSIM_SEARCH] = 'S',
+		[BUSSIM_MATCH] = 'M',
+		[BUSSIM_OD_SKIP] = 'O',
+		[BUSSIM_OD_MATCH] = 'P',
+		[BUSSIM_ALARM_SEARCH] = 'A',
+	};
+
+	/* preconds */
+	if (sim_p == NULL)
+		return;
+	if ((unsigned)function >= sizeof(cmds))
+		return;
+
+	busslots_add_cmd(&sim_p->slots, cmds[function]);
+	sim_p->function = function;
+
+	// skip ROM addresses everyone who is listening
+	if (function == BUSSIM_OD_SKIP) {
+		if (sim_p->listening_p == &sim_p->devices)
+			for (i=0; i<sim_p->devices.count; ++i)
+				set_overdrive(sim_p, i);
+		sim_p->function = BUSSIM_NONE;
+	}
+
+	// a conditional search is a search among the alarmed devices, of those
+	// that are listening
+	if (function == BUSSIM_ALARM_SEARCH) {
+		if (sim_p->listening_p == &sim_p->devices)
+			sim_p->listening_p = &sim_p->alarmDevices;
+		else if (sim_p->listening_p == &sim_p->odDevices) {
+			if (rebuild_od_alarm_devices(sim_p) != 0)
+				sim_p->odAlarmDevices.count = 0;
+			sim_p->listening_p = &sim_p->odAlarmDevices;
+		}
+		devset_reset(sim_p->listening_p);
+		sim_p->function = BUSSIM_SEARCH;
+	}
+}
+
+/**
+ * one read slot of a search: the bit, then its complement
+ * returns -1 if a read doesn't make sense now, or its reply was dropped
+ * (the master gets no reply)
+ */
+int
+bussim_read_bit (BusSim_t *sim_p)
+{
+	int bit;
+	bool complement;
+
+	/* preconds */
+	if (sim_p == NULL)
+		return -1;
+
+	busslots_add_cmd(&sim_p->slots, 'r');
+	if (sim_p->function != BUSSIM_SEARCH)
+		return -1;
+	if ((sim_p->readState != 0) && (sim_p->readState != 1))
+		return -1;
+
+	// the default is pull-up
+	complement = (sim_p->readState == 1);
+	bit = devset_read(sim_p->listening_p, complement);
+	if (sim_p->faults.enabled)
+		bit = fault_read(sim_p, complement, bit);
+	++sim_p->readState;
+	return bit;
+}
+
+static bool
+fault_hits (BusSimFaults_t *faults_p, BusSimFault_e fault)
+{
+	if (faults_p->ppm[fault] == 0)
+		return false;
+	if ((prng_next(&faults_p->state) % 1000000) >= faults_p->ppm[fault])
+		return false;
+	++faults_p->injected[fault];
+	return true;
+}
+
+/**
+ * what a read looks like with the faults
+ * (-1: the reply is dropped)
+ */
+static int
+fault_read (BusSim_t *sim_p, bool complement, int bit)
+{
+	BusSimFaults_t *faults_p = &sim_p->faults;
+	DevSet_t *set_p = sim_p->listening_p;
+	size_t active;
+	int driven;
+
+	// someone drops off: it stays quiet until the next reset
+	active = devset_active(set_p);
+	if (!complement && (faults_p->vanished == SIZE_MAX) && (active > 0) &&
+			fault_hits(faults_p, BUSSIM_FAULT_VANISH))
+		faults_p->vanished = set_p->lo + (size_t)(prng_next(&faults_p->state) % active);
+
+	// if the device that's gone was the only one pulling the bus low, it
+	// reads as 1
+	if ((bit == 0) && (faults_p->vanished >= set_p->lo) && (faults_p->vanished < set_p->hi) &&
+			(set_p->bitPos < set_p->bitSize)) {
+		driven = (int)((set_p->ids_p[faults_p->vanished] >> set_p->bitPos) & 1);
+		if ((driven == (complement? 1 : 0)) && (devset_side(set_p, driven) == 1))
+			bit = 1;
+	}
+
+	if (!complement && fault_hits(faults_p, BUSSIM_FAULT_ONES))
+		faults_p->onesPending = true;
+	if (faults_p->onesPending) {
+		bit = 1;
+		if (complement)
+			faults_p->onesPending = false;
+	}
+
+	if (fault_hits(faults_p, BUSSIM_FAULT_FLIP))
+		bit = !bit;
+	if (fault_hits(faults_p, BUSSIM_FAULT_DROP))
+		return -1;
+	return bit;
+}
+
+/**
+ * <fault>=<ppm>[,<fault>=<ppm>…][,seed=<n>], e.g. "flip=100,drop=10"
+ * (see BusSimFault_e)
+ */
+int
+bussim_parse_faults (const char *spec_p, BusSimFaults_t *faultsOut_p)
+{
+	const char *p;
+	char *end_p;
+	size_t len;
+	unsigned long long val;
+	int i;
+
+	/* preconds */
+	if ((spec_p == NULL) || (faultsOut_p == NULL))
+		return -1;
+
+	memset(faultsOut_p, 0, sizeof(*faultsOut_p));
+	faultsOut_p->vanished = SIZE_MAX;
+	p = spec_p;
+	while (*p != '\0') {
+		end_p = strchr(p, '=');
+		if (end_p == NULL)
+			return -1;
+		len = (size_t)(end_p - p);
+		val = strtoull(end_p + 1, &end_p, 0);
+		if ((*end_p != '\0') && (*end_p != ','))
+			return -1;
+
+		if ((len == 4) && (strncmp(p, "seed", len) == 0))
+			faultsOut_p->state = val;
+		else {
+			for (i=0; i<BUSSIM_FAULTS; ++i)
+				if ((strlen(faultNames_pG[i]) == len) && (strncmp(p, faultNames_pG[i], len) == 0))
+					break;
+			if ((i == BUSSIM_FAULTS) || (val > 1000000))
+				return -1;
+			faultsOut_p->ppm[i] = (uint32_t)val;
+			if (val > 0)
+				faultsOut_p->enabled = true;
+		}
+
+		p = (*end_p == ',')? end_p + 1 : end_p;
+	}
+	return 0;
+}
+
+void
+bussim_set_faults (BusSim_t *sim_p, const BusSimFaults_t *faults_p)
+{
+	/* preconds */
+	if ((sim_p == NULL) || (faults_p == NULL))
+		return;
+
+	sim_p->faults = *faults_p;
+	sim_p->faults.onesPending = false;
+	sim_p->faults.vanished = SIZE_MAX;
+	memset(sim_p->faults.injected, 0, sizeof(sim_p->faults.injected));
+}
+
+const char *
+bussim_fault_name (BusSimFault_e fault)
+{
+	if ((unsigned)fault >= BUSSIM_FAULTS)
+		return "unknown";
+	return faultNames_pG[fault];
+}
+
+/**
+ * a write slot: the direction bit of a search or the next bit of a match
+ * returns -1 if it was ignored
+ */
+int
+bussim_write_bit (BusSim_t *sim_p, int bit)
+{
+	/* preconds */
+	if (sim_p == NULL)
+		return -1;
+
+	busslots_add_cmd(&sim_p->slots, bit? '1' : '0');
+	switch (sim_p->function) {
+		case BUSSIM_SEARCH:
+			if (sim_p->readState != 2)
+				return -1;
+			break;
+		case BUSSIM_MATCH:
+		case BUSSIM_OD_MATCH:
+			break;
+		default:
+			return -1;
+	}
+
+	devset_select(sim_p->listening_p, bit);
+	sim_p->readState = 0;
+
+	// a complete overdrive match: whoever is left switches speed
+	if ((sim_p->function == BUSSIM_OD_MATCH) &&
+			(sim_p->listening_p->bitPos == sim_p->listening_p->bitSize) &&
+			(devset_active(sim_p->listening_p) == 1))
+		set_overdrive(sim_p, devset_find(&sim_p->devices,
+					sim_p->listening_p->ids_p[sim_p->listening_p->lo]));
+	return 0;
+}
+
+/**
+ * record a command about to run in the trace (if there is one)
+ */
+TraceEvent_t *
+bussim_trace (BusSim_t *sim_p, char cmd)
+{
+	/* preconds */
+	if ((sim_p == NULL) || (sim_p->trace_p == NULL))
+		return NULL;
+
+	return trace_begin(sim_p->trace_p, cmd, sim_p->listening_p->bitPos, sim_p->readState,
+			devset_active(sim_p->listening_p));
+}
+
+/**
+ * run a string of protocol commands ('R', 'D', 'S', 'A', 'M', 'O', 'P', 'r',
+ * '0', '1'), anything else is ignored (but shown to the hook); replies_p needs
+ * room for one reply per command
+ * returns the number of replies
+ */
+size_t
+bussim_process (BusSim_t *sim_p, const char *cmds_p, size_t len, char *replies_p)
+{
+	size_t i, replies = 0;
+	int bit;
+	TraceEvent_t *event_p;
+
+	/* preconds */
+	if ((sim_p == NULL) || (cmds_p == NULL) || (replies_p == NULL))
+		return 0;
+
+	for (i=0; i<len; ++i) {
+		if (sim_p->hook_p != NULL)
+			sim_p->hook_p(sim_p, cmds_p[i], -1);
+		event_p = bussim_trace(sim_p, cmds_p[i]);
+		switch (cmds_p[i]) {
+			case 'R':
+				bussim_reset(sim_p);
+				break;
+
+			case 'D':
+				bussim_reset_overdrive(sim_p);
+				break;
+
+			case 'S':
+				bussim_function(sim_p, BUSSIM_SEARCH);
+				break;
+
+			case 'A':
+				bussim_function(sim_p, BUSSIM_ALARM_SEARCH);
+				break;
+
+			case 'M':
+				bussim_function(sim_p, BUSSIM_MATCH);
+				break;
+
+			case 'O':
+				bussim_function(sim_p, BUSSIM_OD_SKIP);
+				break;
+
+			case 'P':
+				bussim_function(sim_p, BUSSIM_OD_MATCH);
+				break;
+
+			case 'r':
+				bit = bussim_read_bit(sim_p);
+				if (bit != -1) {
+					replies_p[replies++] = (char)('0' + bit);
+					if (event_p != NULL)
+						event_p->reply = (char)('0' + bit);
+					if (sim_p->hook_p != NULL)
+						sim_p->hook_p(sim_p, 'r', bit);
+				}
+				break;
+
+			case '0':
+			case '1':
+				bussim_write_bit(sim_p, cmds_p[i] - '0');
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	return replies;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#ifndef ROM_SEARCH_BUSSIM__H
+#define ROM_SEARCH_BUSSIM__H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "devset.h"
+#include "bustime.h"
+#include "dataset.h"
+#include "trace.h"
+
+/**
+ * a simulated bus: a device population and the state of the ROM function
+ * the master is running on it
+ *
+ * this is the protocol end of the tester with the transport taken away, so
+ * it can be driven from another process (tester) or called directly from
+ * the master (the "sim" transport)
+ */
+typedef enum {
+	BUSSIM_NONE,
+	BUSSIM_SEARCH,
+	BUSSIM_MATCH,
+	// overdrive skip ROM: everyone listening goes to overdrive speed
+	BUSSIM_OD_SKIP,
+	// overdrive match ROM: the ID follows at overdrive speed, the device
+	// it matches goes to overdrive speed
+	BUSSIM_OD_MATCH,
+	// conditional search: a search only the alarmed devices take part in
+	BUSSIM_ALARM_SEARCH,
+} BusSimFunction_e;
+
+/**
+ * faults injected into the read slots of a search, each with its own chance
+ * in a million per read
+ *	flip    the reply is inverted
+ *	drop    the read happens but its reply never gets to the master
+ *	ones    a spurious 11: the bit and its complement both read as 1, as
+ *	        if nobody was there
+ *	vanish  an active device drops off the bus until the next reset
+ */
+typedef enum {
+	BUSSIM_FAULT_FLIP,
+	BUSSIM_FAULT_DROP,
+	BUSSIM_FAULT_ONES,
+	BUSSIM_FAULT_VANISH,
+	BUSSIM_FAULTS,
+} BusSimFault_e;
+
+typedef struct {
+	bool enabled;
+	uint32_t ppm[BUSSIM_FAULTS];
+	uint64_t state;
+	uint64_t injected[BUSSIM_FAULTS];
+
+	// a spurious 11 is under way (the complement read is still to come)
+	bool onesPending;
+	// the device (an index into listening_p) that has dropped off, or
+	// SIZE_MAX
+	size_t vanished;
+} BusSimFaults_t;
+
+struct _bussim;
+/**
+ * called by bussim_process() before every command it's given (reply < 0),
+ * the ones it doesn't know included, and again after a read with the reply
+ * that went back
+ */
+typedef void (*BusSimHook_t) (struct _bussim *sim_p, char cmd, int reply);
+
+typedef struct _bussim {
+	DevSet_t devices;
+	// set if the IDs are those of a mapped binary dataset
+	Dataset_t dataset;
+	BusSimFunction_e function;
+	// where we are in a search step: 0 = bit read next, 1 = complement read
+	// next, 2 = waiting for the direction bit
+	int readState;
+
+	// speed state of each device (in the order of devices.ids_p)
+	// a standard reset puts everyone back to standard speed, an overdrive
+	// reset is only seen by the devices already in overdrive
+	bool *overdrive_p;
+	size_t numOverdrive;
+	// the overdrive devices on their own, rebuilt when that changes
+	DevSet_t odDevices;
+	bool odDirty;
+	// who took part in the last reset: devices or odDevices
+	// (or one of the alarm sets once a conditional search starts)
+	DevSet_t *listening_p;
+
+	// the devices with their alarm flag set, and those of them that are in
+	// overdrive (for a conditional search after an overdrive reset)
+	DevSet_t alarmDevices;
+	DevSet_t odAlarmDevices;
+
+	// everything that went over the wire, whether the devices cared or not
+	BusSlots_t slots;
+
+	// if set, every command is recorded here (not owned by the sim)
+	Trace_t *trace_p;
+	// if set, shown every command (e.g. the tester's verbose mode)
+	BusSimHook_t hook_p;
+
+	BusSimFaults_t faults;
+} BusSim_t;
+
+int bussim_init (BusSim_t *sim_p, uint64_t *ids_p, size_t count, int bitSize);
+int bussim_open (BusSim_t *sim_p, const char *fileName_p);
+void bussim_free (BusSim_t *sim_p);
+int bussim_set_alarms (BusSim_t *sim_p, uint64_t *alarmIds_p, size_t numAlarms);
+int bussim_load_file (const char *fileName_p, uint64_t **idsOut_p, size_t *countOut_p, int *bitSizeOut_p,
+		uint64_t **alarmsOut_p, size_t *numAlarmsOut_p);
+
+void bussim_reset (BusSim_t *sim_p);
+void bussim_reset_overdrive (BusSim_t *sim_p);
+void bussim_function (BusSim_t *sim_p, BusSimFunction_e function);
+int bussim_read_bit (BusSim_t *sim_p);
+int bussim_write_bit (BusSim_t *sim_p, int bit);
+TraceEvent_t *bussim_trace (BusSim_t *sim_p, char cmd);
+int bussim_parse_faults (const char *spec_p, BusSimFaults_t *faultsOut_p);
+void bussim_set_faults (BusSim_t *sim_p, const BusSimFaults_t *faults_p);
+const char *bussim_fault_name (BusSimFault_e fault);
+size_t bussim_process (BusSim_t *sim_p, const char *cmds_p, size_t len, char *replies_p);
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "bustime.h"
+
+// µs, recommended values from AN126
+// reset: G+H+I+J, read: A+E+F, write 0: C+D, write 1: A+B
+static const struct {
+	double reset;
+	double read;
+	double write0;
+	double write1;
+} slotTimes_G[BUS_SPEEDS] = {
+	[BUS_STANDARD] = {960.0, 70.0, 70.0, 70.0},
+	[BUS_OVERDRIVE] = {121.0, 9.0, 10.0, 8.5},
+};
+
+/**
+ * a byte written to the bus: 8 write slots, one per bit
+ */
+void
+busslots_add_byte (BusSlots_t *slots_p, uint8_t byte)
+{
+	int ones;
+
+	/* preconds */
+	if (slots_p == NULL)
+		return;
+
+	ones = __builtin_popcount(byte);
+	slots_p->write1Slots[slots_p->speed] += (uint64_t)ones;
+	slots_p->write0Slots[slots_p->speed] += (uint64_t)(8 - ones);
+}
+
+/**
+ * account for one command of the tester protocol
+ */
+void
+busslots_add_cmd (BusSlots_t *slots_p, char cmd)
+{
+	/* preconds */
+	if (slots_p == NULL)
+		return;
+
+	switch (cmd) {
+		case 'R':
+			slots_p->speed = BUS_STANDARD;
+			++slots_p->resets[BUS_STANDARD];
+			break;
+		case 'D':
+			slots_p->speed = BUS_OVERDRIVE;
+			++slots_p->resets[BUS_OVERDRIVE];
+			break;
+		case 'S':
+			busslots_add_byte(slots_p, ROM_CMD_SEARCH);
+			break;
+		case 'A':
+			busslots_add_byte(slots_p, ROM_CMD_ALARM_SEARCH);
+			break;
+		case 'M':
+			busslots_add_byte(slots_p, ROM_CMD_MATCH);
+			break;
+		case 'O':
+			// the command goes out at the old speed, the rest at the new
+			busslots_add_byte(slots_p, ROM_CMD_OD_SKIP);
+			slots_p->speed = BUS_OVERDRIVE;
+			break;
+		case 'P':
+			busslots_add_byte(slots_p, ROM_CMD_OD_MATCH);
+			slots_p->speed = BUS_OVERDRIVE;
+			break;
+		case 'r':
+			++slots_p->readSlots[slots_p->speed];
+			break;
+		case '0':
+			++slots_p->write0Slots[slots_p->speed];
+			break;
+		case '1':
+			++slots_p->write1Slots[slots_p->speed];
+			break;
+		default:
+			break;
+	}
+}
+
+void
+busslots_merge (BusSlots_t *total_p, const BusSlots_t *slots_p)
+{
+	int speed;
+
+	/* preconds */
+	if ((total_p == NULL) || (slots_p == NULL))
+		return;
+
+	for (speed=0; speed<BUS_SPEEDS; ++speed) {
+		total_p->resets[speed] += slots_p->resets[speed];
+		total_p->readSlots[speed] += slots_p->readSlots[speed];
+		total_p->write0Slots[speed] += slots_p->write0Slots[speed];
+		total_p->write1Slots[speed] += slots_p->write1Slots[speed];
+	}
+}
+
+uint64_t
+busslots_resets (const BusSlots_t *slots_p)
+{
+	/* preconds */
+	if (slots_p == NULL)
+		return 0;
+
+	return slots_p->resets[BUS_STANDARD] + slots_p->resets[BUS_OVERDRIVE];
+}
+
+uint64_t
+busslots_reads (const BusSlots_t *slots_p)
+{
+	/* preconds */
+	if (slots_p == NULL)
+		return 0;
+
+	return slots_p->readSlots[BUS_STANDARD] + slots_p->readSlots[BUS_OVERDRIVE];
+}
+
+uint64_t
+busslots_writes (const BusSlots_t *slots_p)
+{
+	/* preconds */
+	if (slots_p == NULL)
+		return 0;
+
+	return slots_p->write0Slots[BUS_STANDARD] + slots_p->write0Slots[BUS_OVERDRIVE] +
+		slots_p->write1Slots[BUS_STANDARD] + slots_p->write1Slots[BUS_OVERDRIVE];
+}
+
+/**
+ * every slot at the speed it actually ran at
+ */
+double
+busslots_time_us (const BusSlots_t *slots_p)
+{
+	int speed;
+	double us = 0;
+
+	/* preconds */
+	if (slots_p == NULL)
+		return 0;
+
+	for (speed=0; speed<BUS_SPEEDS; ++speed)
+		us += ((double)slots_p->resets[speed] * slotTimes_G[speed].reset) +
+			((double)slots_p->readSlots[speed] * slotTimes_G[speed].read) +
+			((double)slots_p->write0Slots[speed] * slotTimes_G[speed].write0) +
+			((double)slots_p->write1Slots[speed] * slotTimes_G[speed].write1);
+	return us;
+}
+
+/**
+ * what the same slots would have cost had the whole run been at <speed>
+ */
+double
+busslots_time_at_us (const BusSlots_t *slots_p, BusSpeed_e speed)
+{
+	int s;
+	double us = 0;
+
+	/* preconds */
+	if (slots_p == NULL)
+		return 0;
+	if ((unsigned)speed >= BUS_SPEEDS)
+		return 0;
+
+	for (s=0; s<BUS_SPEEDS; ++s)
+		us += ((double)slots_p->resets[s] * slotTimes_G[speed].reset) +
+			((double)slots_p->readSlots[s] * slotTimes_G[speed].read) +
+			((double)slots_p->write0Slots[s] * slotTimes_G[speed].write0) +
+			((double)slots_p->write1Slots[s] * slotTimes_G[speed].write1);
+	return us;
+}
+
+const char *
+bus_speed_name (BusSpeed_e speed)
+{
+	switch (speed) {
+		case BUS_STANDARD:
+			return "standard";
+		case BUS_OVERDRIVE:
+			return "overdrive";
+		default:
+			return "unknown";
+	}
+}
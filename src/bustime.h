@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#ifndef ROM_SEARCH_BUSTIME__H
+#define ROM_SEARCH_BUSTIME__H
+
+#include <stdint.h>
+
+/**
+ * what a search would cost on a real 1-Wire bus
+ *
+ * the wire only knows resets and time slots: a read slot, or a write slot
+ * for a 0 or a 1 (a ROM command byte is 8 write slots, LSB first). count
+ * those and multiply by the recommended slot timings (Maxim AN126)
+ *
+ * slots are counted against the speed the bus is running at: a standard
+ * reset ('R') drops it to standard speed, an overdrive reset ('D') and the
+ * overdrive ROM commands ('O' skip, 'P' match) put it in overdrive
+ */
+typedef enum {
+	BUS_STANDARD,
+	BUS_OVERDRIVE,
+	BUS_SPEEDS,
+} BusSpeed_e;
+
+// ROM command bytes, as they go out on the wire
+#define ROM_CMD_SEARCH 0xf0
+#define ROM_CMD_MATCH 0x55
+#define ROM_CMD_OD_SKIP 0x3c
+#define ROM_CMD_OD_MATCH 0x69
+#define ROM_CMD_ALARM_SEARCH 0xec
+
+typedef struct {
+	BusSpeed_e speed;
+	uint64_t resets[BUS_SPEEDS];
+	uint64_t readSlots[BUS_SPEEDS];
+	uint64_t write0Slots[BUS_SPEEDS];
+	uint64_t write1Slots[BUS_SPEEDS];
+} BusSlots_t;
+
+void busslots_add_byte (BusSlots_t *slots_p, uint8_t byte);
+void busslots_add_cmd (BusSlots_t *slots_p, char cmd);
+void busslots_merge (BusSlots_t *total_p, const BusSlots_t *slots_p);
+uint64_t busslots_resets (const BusSlots_t *slots_p);
+uint64_t busslots_reads (const BusSlots_t *slots_p);
+uint64_t busslots_writes (const BusSlots_t *slots_p);
+double busslots_time_us (const BusSlots_t *slots_p);
+double busslots_time_at_us (const BusSlots_t *slots_p, BusSpeed_e speed);
+const char *bus_speed_name (BusSpeed_e speed);
+
+#endif
@@ -9,11 +9,37 @@
 #include <string.h>
 #include <inttypes.h>
 #include <errno.h>
+#include <time.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include "common.h"
 
+// device
+uint64_t
+device_value (const DeviceID_t *device_p)
+{
+	/* preconds */
+	if (device_p == NULL)
+		return 0;
+
+	return device_p->value;
+}
+
+void
+device_set_value (DeviceID_t *device_p, uint64_t val, size_t bitLen)
+{
+	/* preconds */
+	if (device_p == NULL)
+		return;
+	if (bitLen > DEVICE_ID_MAX_BITS)
+		bitLen = DEVICE_ID_MAX_BITS;
+
+	device_p->value = val;
+	device_truncate(device_p, bitLen);
+	device_p->done = false;
+}
+
 // fifos
 int
 open_fifo (const char *name_p, int *fdOut_p)
@@ -49,60 +75,97 @@ open_fifo (const char *name_p, int *fdOut_p)
 
 // misc
 /**
- * NOTE: the bits are stored in the array backwards
- * since they are given to us LSB first
- * i.e. LSB is in bits[0]
+ * print the bits MSB first, then the value
  */
 void
-print_id (DeviceID_t *device_p, int maxbits)
+print_id (const DeviceID_t *device_p, int maxbits)
 {
-	int i;
-	size_t j;
-	size_t pos;
-	uint64_t val = 0;
+	char buf[FORMAT_ID_MAX];
+	size_t len;
+
+	len = format_id(buf, device_p, maxbits);
+	if (len > 0)
+		fwrite(buf, 1, len, stdout);
+}
+
+void
+print_bits (uint64_t val, int startPos, int cnt)
+{
+	char buf[DEVICE_ID_MAX_BITS];
+	size_t len;
+
+	len = format_bits(buf, val, startPos, cnt);
+	if (len > 0)
+		fwrite(buf, 1, len, stdout);
+}
+
+/**
+ * print_id() into buf_p (at least FORMAT_ID_MAX bytes, not terminated)
+ * returns the length, 0 if there's nothing to print
+ */
+size_t
+format_id (char *buf_p, const DeviceID_t *device_p, int maxbits)
+{
+	size_t len;
 
 	/* preconds */
-	if (device_p == NULL)
-		return;
+	if ((buf_p == NULL) || (device_p == NULL))
+		return 0;
 	if (maxbits <= 0)
-		return;
+		return 0;
 	if (maxbits > (int)device_p->bitLen)
-		return;
-
-	// reverse-print bits
-	for (i=0,pos=device_p->bitLen; i<(int)device_p->bitLen; ++i,--pos)
-		if (device_p->bits[pos] == '1')
-			printf("1");
-		else
-			printf("0");
-	printf("...");
+		return 0;
 
-	// convert and print value
-	for (j=0; j<device_p->bitLen; ++j)
-		val += ((uint64_t)(device_p->bits[j] - 0x30) << j);
-	printf("%0*"PRIu64, dwidth(maxbits), val);
+	len = format_bits(buf_p, device_p->value, (int)device_p->bitLen - 1, (int)device_p->bitLen);
+	memcpy(buf_p + len, "...", 3);
+	len += 3;
+	len += format_u64(buf_p + len, device_p->value, dwidth(maxbits));
+	return len;
 }
 
-void
-print_bits (uint64_t val, int startPos, int cnt)
+/**
+ * cnt bits of val, from startPos down, as '0'/'1' into buf_p (not terminated)
+ */
+size_t
+format_bits (char *buf_p, uint64_t val, int startPos, int cnt)
 {
 	int i;
 	int pos;
 
 	/* preconds */
+	if (buf_p == NULL)
+		return 0;
 	if ((startPos - cnt + 1) < 0)
-		return;
+		return 0;
 	if (startPos < 0)
-		return;
+		return 0;
 	if (cnt <= 0)
-		return;
+		return 0;
 
-	for (i=0,pos=startPos; i<cnt; ++i,--pos) {
-		if (val & (uint64_t)(1llu<<pos))
-			printf("1");
-		else
-			printf("0");
-	}
+	for (i=0,pos=startPos; i<cnt; ++i,--pos)
+		buf_p[i] = (char)('0' + ((val >> pos) & 1));
+	return (size_t)cnt;
+}
+
+/**
+ * val in decimal, zero-padded to at least width digits, into buf_p (at least
+ * 20 bytes or width, not terminated)
+ */
+size_t
+format_u64 (char *buf_p, uint64_t val, int width)
+{
+	char digits[20];
+	size_t n = 0, len = 0;
+
+	do {
+		digits[n++] = (char)('0' + (val % 10));
+		val /= 10;
+	} while (val != 0);
+	while ((int)(len + n) < width)
+		buf_p[len++] = '0';
+	while (n > 0)
+		buf_p[len++] = digits[--n];
+	return len;
 }
 
 /**
@@ -150,84 +213,155 @@ dwidth (int maxbits)
 
 }
 
-// single linked list
-void
-free_nodes (DeviceNode_t *startNode_p)
+/**
+ * mirror the bits of a 64-bit value (bit 0 ↔ bit 63, ...)
+ */
+uint64_t
+bit_reverse64 (uint64_t val)
 {
-	DeviceNode_t *next_p;
+	val = ((val >> 1) & 0x5555555555555555llu) | ((val & 0x5555555555555555llu) << 1);
+	val = ((val >> 2) & 0x3333333333333333llu) | ((val & 0x3333333333333333llu) << 2);
+	val = ((val >> 4) & 0x0f0f0f0f0f0f0f0fllu) | ((val & 0x0f0f0f0f0f0f0f0fllu) << 4);
+	return __builtin_bswap64(val);
+}
 
-	/* preconds */
-	if (startNode_p == NULL)
-		return;
+/**
+ * splitmix64: small, fast, and the same seed always gives the same sequence
+ */
+uint64_t
+prng_next (uint64_t *state_p)
+{
+	uint64_t z;
 
-	next_p = startNode_p->next_p;
-	free(startNode_p);
+	z = (*state_p += 0x9e3779b97f4a7c15llu);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9llu;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebllu;
+	return z ^ (z >> 31);
+}
 
-	if (next_p != NULL)
-		free_nodes(next_p);
+uint64_t
+monotonic_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000llu) + (uint64_t)ts.tv_nsec;
 }
 
-DeviceNode_t *
-create_new_node (void)
+void
+log2hist_add (Log2Hist_t *hist_p, uint64_t val)
 {
-	DeviceNode_t *newNode_p;
+	int bucket;
 
 	/* preconds */
-	// none
-
-	// node
-	newNode_p = (DeviceNode_t*)malloc(sizeof(DeviceNode_t));
-	if (newNode_p == NULL) {
-		perror("malloc");
-		return NULL;
-	}
+	if (hist_p == NULL)
+		return;
 
-	// device
-	newNode_p->device.bitLen = 0;
-	newNode_p->device.done = false;
+	bucket = (val < 2)? 0 : (63 - __builtin_clzll(val));
+	if (bucket >= LOG2_HIST_BUCKETS)
+		bucket = LOG2_HIST_BUCKETS - 1;
+	++hist_p->buckets[bucket];
+	++hist_p->count;
+	hist_p->sum += val;
+	if (val > hist_p->max)
+		hist_p->max = val;
+}
 
-	// list
-	newNode_p->next_p = NULL;
+// work stack
+void
+workstack_init (WorkStack_t *stack_p)
+{
+	/* preconds */
+	if (stack_p == NULL)
+		return;
 
-	return newNode_p;
+	memset(stack_p, 0, sizeof(*stack_p));
 }
 
-DeviceNode_t *
-create_node_copy_device (DeviceID_t *deviceToCopy_p)
+void
+workstack_free (WorkStack_t *stack_p)
 {
-	DeviceNode_t *newNode_p;
+	WorkBlock_t *prev_p;
 
 	/* preconds */
-	if (deviceToCopy_p == NULL)
-		return NULL;
-
-	newNode_p = create_new_node();
-	if (newNode_p == NULL)
-		return NULL;
-
-	newNode_p->device.bitLen = deviceToCopy_p->bitLen;
-	if (deviceToCopy_p->bitLen > 0)
-		memcpy(&(newNode_p->device.bits), &(deviceToCopy_p->bits), deviceToCopy_p->bitLen);
-	newNode_p->device.done = deviceToCopy_p->done;
+	if (stack_p == NULL)
+		return;
 
-	return newNode_p;
+	while (stack_p->top_p != NULL) {
+		prev_p = stack_p->top_p->prev_p;
+		free(stack_p->top_p);
+		stack_p->top_p = prev_p;
+	}
+	free(stack_p->spare_p);
+	workstack_init(stack_p);
 }
 
 int
-add_node_to_list (DeviceNode_t *startNode_p, DeviceNode_t *nodeToAdd_p)
+workstack_push (WorkStack_t *stack_p, const DeviceID_t *device_p)
 {
-	DeviceNode_t *curNode_p;
+	WorkBlock_t *block_p;
 
 	/* preconds */
-	if (startNode_p == NULL)
+	if (stack_p == NULL)
 		return -1;
-	if (nodeToAdd_p == NULL)
+	if (device_p == NULL)
 		return -1;
 
-	curNode_p = startNode_p;
-	while (curNode_p->next_p != NULL)
-		curNode_p = curNode_p->next_p;
-	curNode_p->next_p = nodeToAdd_p;
+	if ((stack_p->top_p == NULL) || (stack_p->topCount == WORKSTACK_BLOCK_ENTRIES)) {
+		if (stack_p->spare_p != NULL) {
+			block_p = stack_p->spare_p;
+			stack_p->spare_p = NULL;
+		}
+		else {
+			block_p = (WorkBlock_t*)malloc(sizeof(WorkBlock_t));
+			if (block_p == NULL) {
+				perror("malloc");
+				return -1;
+			}
+		}
+		block_p->prev_p = stack_p->top_p;
+		stack_p->top_p = block_p;
+		stack_p->topCount = 0;
+	}
+
+	stack_p->top_p->entries[stack_p->topCount++] = *device_p;
+	++stack_p->depth;
+	if (stack_p->depth > stack_p->peakDepth)
+		stack_p->peakDepth = stack_p->depth;
 
 	return 0;
 }
+
+/**
+ * return:
+ * true:  *deviceOut_p holds what was on top of the stack
+ * false: the stack is empty
+ */
+bool
+workstack_pop (WorkStack_t *stack_p, DeviceID_t *deviceOut_p)
+{
+	WorkBlock_t *block_p;
+
+	/* preconds */
+	if (stack_p == NULL)
+		return false;
+	if (deviceOut_p == NULL)
+		return false;
+
+	if (stack_p->depth == 0)
+		return false;
+
+	*deviceOut_p = stack_p->top_p->entries[--stack_p->topCount];
+	--stack_p->depth;
+
+	// retire an emptied block (keeping one spare)
+	if ((stack_p->topCount == 0) && (stack_p->depth > 0)) {
+		block_p = stack_p->top_p;
+		stack_p->top_p = block_p->prev_p;
+		stack_p->topCount = WORKSTACK_BLOCK_ENTRIES;
+		free(stack_p->spare_p);
+		stack_p->spare_p = block_p;
+	}
+
+	return true;
+}
@@ -10,30 +10,87 @@
 #include <stdbool.h>
 
 // device
+// the bits are given to us LSB first: the first bit found is bit 0 of value
+// bits at and above bitLen are always 0
+#define DEVICE_ID_MAX_BITS 64
 typedef struct {
-	uint8_t bits[64];
+	uint64_t value;
 	size_t bitLen;
 	bool done;
 } DeviceID_t;
 
+static inline int
+device_bit (const DeviceID_t *device_p, size_t pos)
+{
+	return (int)((device_p->value >> pos) & 1);
+}
+
+static inline void
+device_append_bit (DeviceID_t *device_p, int bit)
+{
+	device_p->value |= (uint64_t)(bit & 1) << device_p->bitLen;
+	++device_p->bitLen;
+}
+
+static inline void
+device_truncate (DeviceID_t *device_p, size_t bitLen)
+{
+	if (bitLen < DEVICE_ID_MAX_BITS)
+		device_p->value &= ((uint64_t)1 << bitLen) - 1;
+	device_p->bitLen = bitLen;
+}
+
+uint64_t device_value (const DeviceID_t *device_p);
+void device_set_value (DeviceID_t *device_p, uint64_t val, size_t bitLen);
+
 // fifos
 #define toTesterFifoName_p "toTesterFifoFd"
 #define fmTesterFifoName_p "fmTesterFifoFd"
 int open_fifo (const char *name_p, int *fdOut_p);
 
 // misc
-void print_id (DeviceID_t *device_p, int maxbits);
+// the longest print_id(): the bits, "..." and the value
+#define FORMAT_ID_MAX (DEVICE_ID_MAX_BITS + 3 + 20)
+void print_id (const DeviceID_t *device_p, int maxbits);
 void print_bits (uint64_t val, int startPos, int cnt);
+size_t format_id (char *buf_p, const DeviceID_t *device_p, int maxbits);
+size_t format_bits (char *buf_p, uint64_t val, int startPos, int cnt);
+size_t format_u64 (char *buf_p, uint64_t val, int width);
 int dwidth (int maxbits);
+uint64_t bit_reverse64 (uint64_t val);
+uint64_t prng_next (uint64_t *state_p);
+uint64_t monotonic_ns (void);
 
-// single linked list
-typedef struct _devicenode {
-	struct _devicenode *next_p;
-	DeviceID_t device;
-} DeviceNode_t;
-void free_nodes (DeviceNode_t *startNode_p);
-DeviceNode_t *create_new_node (void);
-DeviceNode_t *create_node_copy_device (DeviceID_t *deviceToCopy_p);
-int add_node_to_list (DeviceNode_t *startNode_p, DeviceNode_t *nodeToAdd_p);
+// log2 histogram: bucket n counts the values in [2^n, 2^(n+1)), bucket 0
+// also takes 0; the last bucket takes everything above
+#define LOG2_HIST_BUCKETS 40
+typedef struct {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[LOG2_HIST_BUCKETS];
+} Log2Hist_t;
+void log2hist_add (Log2Hist_t *hist_p, uint64_t val);
+
+// work stack
+// pending (partial) IDs, last in first out, stored in fixed-size blocks
+// one emptied block is kept as a spare so pushing/popping across a block
+// boundary doesn't thrash malloc
+#define WORKSTACK_BLOCK_ENTRIES 256
+typedef struct _workblock {
+	struct _workblock *prev_p;
+	DeviceID_t entries[WORKSTACK_BLOCK_ENTRIES];
+} WorkBlock_t;
+typedef struct {
+	WorkBlock_t *top_p;
+	size_t topCount;
+	WorkBlock_t *spare_p;
+	size_t depth;
+	size_t peakDepth;
+} WorkStack_t;
+void workstack_init (WorkStack_t *stack_p);
+void workstack_free (WorkStack_t *stack_p);
+int workstack_push (WorkStack_t *stack_p, const DeviceID_t *device_p);
+bool workstack_pop (WorkStack_t *stack_p, DeviceID_t *deviceOut_p);
 
 #endif
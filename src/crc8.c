@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC8_HAVE_SSSE3
+#endif
+#include "crc8.h"
+
+// crc = crc8Table_G[crc ^ byte]
+static const uint8_t crc8Table_G[256] = {
+	0x00, 0x5e, 0xbc, 0xe2, 0x61, 0x3f, 0xdd, 0x83,
+	0xc2, 0x9c, 0x7e, 0x20, 0xa3, 0xfd, 0x1f, 0x41,
+	0x9d, 0xc3, 0x21, 0x7f, 0xfc, 0xa2, 0x40, 0x1e,
+	0x5f, 0x01, 0xe3, 0xbd, 0x3e, 0x60, 0x82, 0xdc,
+	0x23, 0x7d, 0x9f, 0xc1, 0x42, 0x1c, 0xfe, 0xa0,
+	0xe1, 0xbf, 0x5d, 0x03, 0x80, 0xde, 0x3c, 0x62,
+	0xbe, 0xe0, 0x02, 0x5c, 0xdf, 0x81, 0x63, 0x3d,
+	0x7c, 0x22, 0xc0, 0x9e, 0x1d, 0x43, 0xa1, 0xff,
+	0x46, 0x18, 0xfa, 0xa4, 0x27, 0x79, 0x9b, 0xc5,
+	0x84, 0xda, 0x38, 0x66, 0xe5, 0xbb, 0x59, 0x07,
+	0xdb, 0x85, 0x67, 0x39, 0xba, 0xe4, 0x06, 0x58,
+	0x19, 0x47, 0xa5, 0xfb, 0x78, 0x26, 0xc4, 0x9a,
+	0x65, 0x3b, 0xd9, 0x87, 0x04, 0x5a, 0xb8, 0xe6,
+	0xa7, 0xf9, 0x1b, 0x45, 0xc6, 0x98, 0x7a, 0x24,
+	0xf8, 0xa6, 0x44, 0x1a, 0x99, 0xc7, 0x25, 0x7b,
+	0x3a, 0x64, 0x86, 0xd8, 0x5b, 0x05, 0xe7, 0xb9,
+	0x8c, 0xd2, 0x30, 0x6e, 0xed, 0xb3, 0x51, 0x0f,
+	0x4e, 0x10, 0xf2, 0xac, 0x2f, 0x71, 0x93, 0xcd,
+	0x11, 0x4f, 0xad, 0xf3, 0x70, 0x2e, 0xcc, 0x92,
+	0xd3, 0x8d, 0x6f, 0x31, 0xb2, 0xec, 0x0e, 0x50,
+	0xaf, 0xf1, 0x13, 0x4d, 0xce, 0x90, 0x72, 0x2c,
+	0x6d, 0x33, 0xd1, 0x8f, 0x0c, 0x52, 0xb0, 0xee,
+	0x32, 0x6c, 0x8e, 0xd0, 0x53, 0x0d, 0xef, 0xb1,
+	0xf0, 0xae, 0x4c, 0x12, 0x91, 0xcf, 0x2d, 0x73,
+	0xca, 0x94, 0x76, 0x28, 0xab, 0xf5, 0x17, 0x49,
+	0x08, 0x56, 0xb4, 0xea, 0x69, 0x37, 0xd5, 0x8b,
+	0x57, 0x09, 0xeb, 0xb5, 0x36, 0x68, 0x8a, 0xd4,
+	0x95, 0xcb, 0x29, 0x77, 0xf4, 0xaa, 0x48, 0x16,
+	0xe9, 0xb7, 0x55, 0x0b, 0x88, 0xd6, 0x34, 0x6a,
+	0x2b, 0x75, 0x97, 0xc9, 0x4a, 0x14, 0xf6, 0xa8,
+	0x74, 0x2a, 0xc8, 0x96, 0x15, 0x4b, 0xa9, 0xf7,
+	0xb6, 0xe8, 0x0a, 0x54, 0xd7, 0x89, 0x6b, 0x35,
+};
+
+// the CRC8 is linear and starts at 0, so the CRC8 of an 8-byte ID is the XOR
+// of what each byte contributes on its own at its position; here that's
+// split by nibble so each is a 16-entry lookup (a pshufb):
+// crc8Nibbles_G[pos][0][n] is byte pos == n, [pos][1][n] is byte pos == n << 4
+static const uint8_t crc8Nibbles_G[8][2][16] __attribute__((aligned(16))) = {
+	{ // byte 0
+		{ 0x00, 0x43, 0x86, 0xc5, 0x15, 0x56, 0x93, 0xd0, 0x2a, 0x69, 0xac, 0xef, 0x3f, 0x7c, 0xb9, 0xfa },
+		{ 0x00, 0x54, 0xa8, 0xfc, 0x49, 0x1d, 0xe1, 0xb5, 0x92, 0xc6, 0x3a, 0x6e, 0xdb, 0x8f, 0x73, 0x27 },
+	},
+	{ // byte 1
+		{ 0x00, 0x3d, 0x7a, 0x47, 0xf4, 0xc9, 0x8e, 0xb3, 0xf1, 0xcc, 0x8b, 0xb6, 0x05, 0x38, 0x7f, 0x42 },
+		{ 0x00, 0xfb, 0xef, 0x14, 0xc7, 0x3c, 0x28, 0xd3, 0x97, 0x6c, 0x78, 0x83, 0x50, 0xab, 0xbf, 0x44 },
+	},
+	{ // byte 2
+		{ 0x00, 0x37, 0x6e, 0x59, 0xdc, 0xeb, 0xb2, 0x85, 0xa1, 0x96, 0xcf, 0xf8, 0x7d, 0x4a, 0x13, 0x24 },
+		{ 0x00, 0x5b, 0xb6, 0xed, 0x75, 0x2e, 0xc3, 0x98, 0xea, 0xb1, 0x5c, 0x07, 0x9f, 0xc4, 0x29, 0x72 },
+	},
+	{ // byte 3
+		{ 0x00, 0xcd, 0x83, 0x4e, 0x1f, 0xd2, 0x9c, 0x51, 0x3e, 0xf3, 0xbd, 0x70, 0x21, 0xec, 0xa2, 0x6f },
+		{ 0x00, 0x7c, 0xf8, 0x84, 0xe9, 0x95, 0x11, 0x6d, 0xcb, 0xb7, 0x33, 0x4f, 0x22, 0x5e, 0xda, 0xa6 },
+	},
+	{ // byte 4
+		{ 0x00, 0x8f, 0x07, 0x88, 0x0e, 0x81, 0x09, 0x86, 0x1c, 0x93, 0x1b, 0x94, 0x12, 0x9d, 0x15, 0x9a },
+		{ 0x00, 0x38, 0x70, 0x48, 0xe0, 0xd8, 0x90, 0xa8, 0xd9, 0xe1, 0xa9, 0x91, 0x39, 0x01, 0x49, 0x71 },
+	},
+	{ // byte 5
+		{ 0x00, 0xab, 0x4f, 0xe4, 0x9e, 0x35, 0xd1, 0x7a, 0x25, 0x8e, 0x6a, 0xc1, 0xbb, 0x10, 0xf4, 0x5f },
+		{ 0x00, 0x4a, 0x94, 0xde, 0x31, 0x7b, 0xa5, 0xef, 0x62, 0x28, 0xf6, 0xbc, 0x53, 0x19, 0xc7, 0x8d },
+	},
+	{ // byte 6
+		{ 0x00, 0xc4, 0x91, 0x55, 0x3b, 0xff, 0xaa, 0x6e, 0x76, 0xb2, 0xe7, 0x23, 0x4d, 0x89, 0xdc, 0x18 },
+		{ 0x00, 0xec, 0xc1, 0x2d, 0x9b, 0x77, 0x5a, 0xb6, 0x2f, 0xc3, 0xee, 0x02, 0xb4, 0x58, 0x75, 0x99 },
+	},
+	{ // byte 7
+		{ 0x00, 0x5e, 0xbc, 0xe2, 0x61, 0x3f, 0xdd, 0x83, 0xc2, 0x9c, 0x7e, 0x20, 0xa3, 0xfd, 0x1f, 0x41 },
+		{ 0x00, 0x9d, 0x23, 0xbe, 0x46, 0xdb, 0x65, 0xf8, 0x8c, 0x11, 0xaf, 0x32, 0xca, 0x57, 0xe9, 0x74 },
+	},
+};
+
+static Crc8Kernel_e kernel_G = CRC8_KERNEL_AUTO;
+
+static size_t check_scalar (const uint64_t *ids_p, size_t count, uint8_t *validOut_p);
+#ifdef CRC8_HAVE_SSSE3
+static size_t check_ssse3 (const uint64_t *ids_p, size_t count, uint8_t *validOut_p);
+#endif
+
+/**
+ * continue a CRC8 over len more bytes
+ */
+uint8_t
+crc8_update (uint8_t crc, const uint8_t *buf_p, size_t len)
+{
+	size_t i;
+
+	/* preconds */
+	if (buf_p == NULL)
+		return crc;
+
+	for (i=0; i<len; ++i)
+		crc = crc8Table_G[crc ^ buf_p[i]];
+	return crc;
+}
+
+/**
+ * the CRC8 of all 8 bytes of the ID, LSB first (0 for a good ROM ID)
+ */
+uint8_t
+crc8_rom (uint64_t id)
+{
+	uint8_t crc = 0;
+	int i;
+
+	for (i=0; i<8; ++i) {
+		crc = crc8Table_G[crc ^ (uint8_t)id];
+		id >>= 8;
+	}
+	return crc;
+}
+
+/**
+ * the ID with its top byte replaced by the CRC8 of the other 7
+ */
+uint64_t
+crc8_rom_fix (uint64_t id)
+{
+	uint8_t crc = 0;
+	int i;
+
+	id &= ((uint64_t)1 << 56) - 1;
+	for (i=0; i<7; ++i)
+		crc = crc8Table_G[crc ^ (uint8_t)(id >> (8 * i))];
+	return id | ((uint64_t)crc << 56);
+}
+
+bool
+crc8_rom_valid (uint64_t id)
+{
+	return crc8_rom(id) == 0;
+}
+
+/**
+ * pick the kernel crc8_rom_check() uses
+ * AUTO takes the fastest one this CPU can run
+ *
+ * return:
+ *  0: ok
+ * -1: this CPU (or build) can't run that kernel
+ */
+int
+crc8_set_kernel (Crc8Kernel_e kernel)
+{
+	switch (kernel) {
+		case CRC8_KERNEL_AUTO:
+		case CRC8_KERNEL_SCALAR:
+			break;
+
+		case CRC8_KERNEL_SSSE3:
+#ifdef CRC8_HAVE_SSSE3
+			if (__builtin_cpu_supports("ssse3"))
+				break;
+#endif
+			return -1;
+
+		default:
+			return -1;
+	}
+
+	kernel_G = kernel;
+	return 0;
+}
+
+static Crc8Kernel_e
+kernel_in_use (void)
+{
+	if (kernel_G != CRC8_KERNEL_AUTO)
+		return kernel_G;
+#ifdef CRC8_HAVE_SSSE3
+	if (__builtin_cpu_supports("ssse3"))
+		return CRC8_KERNEL_SSSE3;
+#endif
+	return CRC8_KERNEL_SCALAR;
+}
+
+const char *
+crc8_kernel_name (void)
+{
+	return (kernel_in_use() == CRC8_KERNEL_SSSE3)? "ssse3" : "scalar";
+}
+
+/**
+ * check a batch of 64-bit ROM IDs
+ * if validOut_p is given, validOut_p[i] is set to 1 if ids_p[i] is good and
+ * to 0 if not
+ *
+ * return: the number of good IDs
+ */
+size_t
+crc8_rom_check (const uint64_t *ids_p, size_t count, uint8_t *validOut_p)
+{
+	/* preconds */
+	if ((ids_p == NULL) || (count == 0))
+		return 0;
+
+#ifdef CRC8_HAVE_SSSE3
+	if (kernel_in_use() == CRC8_KERNEL_SSSE3)
+		return check_ssse3(ids_p, count, validOut_p);
+#endif
+	return check_scalar(ids_p, count, validOut_p);
+}
+
+static size_t
+check_scalar (const uint64_t *ids_p, size_t count, uint8_t *validOut_p)
+{
+	size_t i, good = 0;
+	bool valid;
+
+	for (i=0; i<count; ++i) {
+		valid = (crc8_rom(ids_p[i]) == 0);
+		if (validOut_p != NULL)
+			validOut_p[i] = valid;
+		good += valid;
+	}
+	return good;
+}
+
+#ifdef CRC8_HAVE_SSSE3
+/**
+ * 16 IDs at a time: the IDs are transposed so that register k holds byte k
+ * of all 16, then each byte position is 2 nibble lookups (pshufb) XORed
+ * into the 16 CRCs
+ */
+__attribute__((target("ssse3")))
+static size_t
+check_ssse3 (const uint64_t *ids_p, size_t count, uint8_t *validOut_p)
+{
+	size_t i, good = 0;
+	int k;
+	unsigned mask;
+	__m128i r[8], t[8], lo, hi, crc;
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	const __m128i zero = _mm_setzero_si128();
+	// [a0 a1 .. a7 b0 b1 .. b7] → [a0 b0 a1 b1 .. a7 b7]
+	const __m128i pairBytes = _mm_setr_epi8(0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15);
+
+	for (i=0; (i+16)<=count; i+=16) {
+		// r[j]: IDs 2j and 2j+1, as 8 16-bit pairs (pair k is byte k of both)
+		for (k=0; k<8; ++k)
+			r[k] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&ids_p[i + (2 * (size_t)k)]), pairBytes);
+
+		// 8x8 transpose of the 16-bit pairs: afterwards r[k] holds byte k
+		// of all 16 IDs (in the order 0,1,2,..,15)
+		t[0] = _mm_unpacklo_epi16(r[0], r[1]);
+		t[1] = _mm_unpackhi_epi16(r[0], r[1]);
+		t[2] = _mm_unpacklo_epi16(r[2], r[3]);
+		t[3] = _mm_unpackhi_epi16(r[2], r[3]);
+		t[4] = _mm_unpacklo_epi16(r[4], r[5]);
+		t[5] = _mm_unpackhi_epi16(r[4], r[5]);
+		t[6] = _mm_unpacklo_epi16(r[6], r[7]);
+		t[7] = _mm_unpackhi_epi16(r[6], r[7]);
+
+		r[0] = _mm_unpacklo_epi32(t[0], t[2]);
+		r[1] = _mm_unpackhi_epi32(t[0], t[2]);
+		r[2] = _mm_unpacklo_epi32(t[1], t[3]);
+		r[3] = _mm_unpackhi_epi32(t[1], t[3]);
+		r[4] = _mm_unpacklo_epi32(t[4], t[6]);
+		r[5] = _mm_unpackhi_epi32(t[4], t[6]);
+		r[6] = _mm_unpacklo_epi32(t[5], t[7]);
+		r[7] = _mm_unpackhi_epi32(t[5], t[7]);
+
+		t[0] = _mm_unpacklo_epi64(r[0], r[4]);
+		t[1] = _mm_unpackhi_epi64(r[0], r[4]);
+		t[2] = _mm_unpacklo_epi64(r[1], r[5]);
+		t[3] = _mm_unpackhi_epi64(r[1], r[5]);
+		t[4] = _mm_unpacklo_epi64(r[2], r[6]);
+		t[5] = _mm_unpackhi_epi64(r[2], r[6]);
+		t[6] = _mm_unpacklo_epi64(r[3], r[7]);
+		t[7] = _mm_unpackhi_epi64(r[3], r[7]);
+
+		crc = zero;
+		for (k=0; k<8; ++k) {
+			lo = _mm_and_si128(t[k], nibble);
+			hi = _mm_and_si128(_mm_srli_epi16(t[k], 4), nibble);
+			crc = _mm_xor_si128(crc, _mm_shuffle_epi8(_mm_load_si128((const __m128i*)crc8Nibbles_G[k][0]), lo));
+			crc = _mm_xor_si128(crc, _mm_shuffle_epi8(_mm_load_si128((const __m128i*)crc8Nibbles_G[k][1]), hi));
+		}
+
+		mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(crc, zero));
+		good += (size_t)__builtin_popcount(mask);
+		if (validOut_p != NULL)
+			for (k=0; k<16; ++k)
+				validOut_p[i + (size_t)k] = (uint8_t)((mask >> k) & 1);
+	}
+
+	// the rest, one at a time
+	if (i < count)
+		good += check_scalar(&ids_p[i], count - i, (validOut_p != NULL)? &validOut_p[i] : NULL);
+	return good;
+}
+#endif
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#ifndef ROM_SEARCH_CRC8__H
+#define ROM_SEARCH_CRC8__H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * the Dallas/Maxim CRC8 (x^8 + x^5 + x^4 + 1, reflected, initial value 0)
+ * that guards every 1-Wire ROM ID
+ *
+ * a 64-bit ROM ID is sent LSB first: byte 0 is the family code, bytes 1-6
+ * the serial number and byte 7 (the top byte of the value) the CRC8 of the
+ * first 7 bytes, so the CRC8 over all 8 bytes of a good ID is 0
+ */
+#define CRC8_ROM_BITS 64
+
+typedef enum {
+	CRC8_KERNEL_AUTO,
+	CRC8_KERNEL_SCALAR,
+	CRC8_KERNEL_SSSE3,
+} Crc8Kernel_e;
+
+uint8_t crc8_update (uint8_t crc, const uint8_t *buf_p, size_t len);
+uint8_t crc8_rom (uint64_t id);
+uint64_t crc8_rom_fix (uint64_t id);
+bool crc8_rom_valid (uint64_t id);
+int crc8_set_kernel (Crc8Kernel_e kernel);
+const char *crc8_kernel_name (void);
+size_t crc8_rom_check (const uint64_t *ids_p, size_t count, uint8_t *validOut_p);
+
+#endif
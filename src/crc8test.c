@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+/*
+ * "make check": the CRC8 against the worked example in Maxim application
+ * note 27, and every batch kernel this CPU can run against the scalar one
+ *
+ * the IDs are random but seeded, so a failure can be run again; a batch
+ * that isn't a multiple of 16 makes the SIMD kernels do their tail too
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "common.h"
+#include "crc8.h"
+
+#define SEED 0x6372633874657374llu
+#define BATCH_IDS 4099
+
+// AN27: family code 02, serial number 1C B8 01 00 00 00, CRC8 A2
+#define AN27_ID 0xa200000001b81c02llu
+#define AN27_CRC 0xa2
+
+static int check_an27 (void);
+static int check_kernel (Crc8Kernel_e kernel, const char *name_p, const uint64_t *ids_p, size_t count);
+
+int
+main (void)
+{
+	int fails = 0;
+	size_t i;
+	uint64_t state = SEED;
+	uint64_t *ids_p;
+
+	fails += check_an27();
+
+	// a third of them good, a third one bit off good, a third random
+	ids_p = (uint64_t*)malloc(BATCH_IDS * sizeof(uint64_t));
+	if (ids_p == NULL) {
+		perror("malloc");
+		return 1;
+	}
+	for (i=0; i<BATCH_IDS; ++i) {
+		ids_p[i] = prng_next(&state);
+		if ((i % 3) != 2)
+			ids_p[i] = crc8_rom_fix(ids_p[i]);
+		if ((i % 3) == 1)
+			ids_p[i] ^= (uint64_t)1 << (prng_next(&state) % 64);
+	}
+
+	fails += check_kernel(CRC8_KERNEL_SCALAR, "scalar", ids_p, BATCH_IDS);
+	fails += check_kernel(CRC8_KERNEL_SSSE3, "ssse3", ids_p, BATCH_IDS);
+	free(ids_p);
+
+	if (fails != 0) {
+		fprintf(stderr, "crc8: %d check(s) failed\n", fails);
+		return 1;
+	}
+	return 0;
+}
+
+static int
+check_an27 (void)
+{
+	int fails = 0;
+	uint8_t bytes[7];
+	size_t i;
+
+	for (i=0; i<sizeof(bytes); ++i)
+		bytes[i] = (uint8_t)(AN27_ID >> (8 * i));
+
+	if (crc8_update(0, bytes, sizeof(bytes)) != AN27_CRC) {
+		fprintf(stderr, "crc8: AN27 serial number gives 0x%02x, not 0x%02x\n",
+				crc8_update(0, bytes, sizeof(bytes)), AN27_CRC);
+		++fails;
+	}
+	if (!crc8_rom_valid(AN27_ID)) {
+		fprintf(stderr, "crc8: AN27 ID 0x%016"PRIx64" isn't valid\n", (uint64_t)AN27_ID);
+		++fails;
+	}
+	if (crc8_rom_fix(AN27_ID & (((uint64_t)1 << 56) - 1)) != AN27_ID) {
+		fprintf(stderr, "crc8: fixing the AN27 ID gives 0x%016"PRIx64"\n",
+				crc8_rom_fix(AN27_ID & (((uint64_t)1 << 56) - 1)));
+		++fails;
+	}
+	if (crc8_rom_valid(AN27_ID ^ 1)) {
+		fprintf(stderr, "crc8: the AN27 ID with a bit flipped is valid\n");
+		++fails;
+	}
+	return fails;
+}
+
+/**
+ * the kernel's verdicts have to be crc8_rom()'s, ID for ID, for the whole
+ * batch and for every length of tail
+ * (a kernel this CPU can't run passes)
+ */
+static int
+check_kernel (Crc8Kernel_e kernel, const char *name_p, const uint64_t *ids_p, size_t count)
+{
+	int fails = 0;
+	size_t i, len, good, expect;
+	bool wrong;
+	uint8_t *valid_p;
+
+	if (crc8_set_kernel(kernel) != 0) {
+		printf("crc8: %s: not on this CPU, skipped\n", name_p);
+		return 0;
+	}
+
+	valid_p = (uint8_t*)malloc(count);
+	if (valid_p == NULL) {
+		perror("malloc");
+		return 1;
+	}
+
+	for (len=count-32; len<=count; ++len) {
+		good = crc8_rom_check(ids_p, len, valid_p);
+		expect = 0;
+		wrong = false;
+		for (i=0; i<len; ++i) {
+			expect += crc8_rom_valid(ids_p[i]);
+			if (!wrong && (valid_p[i] != crc8_rom_valid(ids_p[i]))) {
+				fprintf(stderr, "crc8: %s: ID %zu of %zu (0x%016"PRIx64") is %s, it isn't\n", name_p, i, len,
+						ids_p[i], valid_p[i]? "good" : "bad");
+				++fails;
+				wrong = true;
+			}
+		}
+		if (good != expect) {
+			fprintf(stderr, "crc8: %s: %zu of %zu good, not %zu\n", name_p, good, len, expect);
+			++fails;
+		}
+	}
+	if (fails == 0)
+		printf("crc8: %s: ok (%zu IDs)\n", name_p, count);
+
+	free(valid_p);
+	crc8_set_kernel(CRC8_KERNEL_AUTO);
+	return fails;
+}
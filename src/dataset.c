@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "common.h"
+#include "devset.h"
+#include "dataset.h"
+
+/**
+ * map a binary dataset; nothing is read or copied, the IDs are used where
+ * they lie in the mapping (private, so nothing ever gets written back)
+ *
+ * returns 1 if the file isn't a binary dataset (i.e. try the text format)
+ */
+int
+dataset_map (const char *fileName_p, Dataset_t *dataset_p)
+{
+	int fd;
+	struct stat st;
+	DatasetHeader_t *hdr_p;
+	size_t need;
+
+	/* preconds */
+	if ((fileName_p == NULL) || (dataset_p == NULL))
+		return -1;
+
+	memset(dataset_p, 0, sizeof(*dataset_p));
+	fd = open(fileName_p, O_RDONLY);
+	if (fd == -1) {
+		perror("open data file");
+		return -1;
+	}
+	if (fstat(fd, &st) != 0) {
+		perror("stat data file");
+		close(fd);
+		return -1;
+	}
+	if ((size_t)st.st_size < sizeof(DatasetHeader_t)) {
+		close(fd);
+		return 1;
+	}
+
+	dataset_p->mapLen = (size_t)st.st_size;
+	dataset_p->map_p = mmap(NULL, dataset_p->mapLen, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (dataset_p->map_p == MAP_FAILED) {
+		perror("mmap data file");
+		dataset_p->map_p = NULL;
+		return -1;
+	}
+
+	hdr_p = (DatasetHeader_t*)dataset_p->map_p;
+	if (memcmp(hdr_p->magic, DATASET_MAGIC, sizeof(hdr_p->magic)) != 0) {
+		dataset_unmap(dataset_p);
+		return 1;
+	}
+	if ((hdr_p->version != DATASET_VERSION) || !(hdr_p->flags & DATASET_FLAG_SORTED) ||
+			(hdr_p->bitWidth < 1) || (hdr_p->bitWidth > 64)) {
+		printf("%s: unsupported dataset (version %u flags 0x%x bits %u)\n",
+				fileName_p, hdr_p->version, hdr_p->flags, hdr_p->bitWidth);
+		dataset_unmap(dataset_p);
+		return -1;
+	}
+	need = sizeof(*hdr_p) + ((size_t)(hdr_p->count + hdr_p->alarmCount) * sizeof(uint64_t));
+	if ((hdr_p->count > SIZE_MAX / 16) || (hdr_p->alarmCount > hdr_p->count) || (need > dataset_p->mapLen)) {
+		printf("%s: truncated dataset\n", fileName_p);
+		dataset_unmap(dataset_p);
+		return -1;
+	}
+
+	dataset_p->ids_p = (uint64_t*)(hdr_p + 1);
+	dataset_p->count = (size_t)hdr_p->count;
+	dataset_p->bitSize = hdr_p->bitWidth;
+	dataset_p->alarms_p = dataset_p->ids_p + dataset_p->count;
+	dataset_p->numAlarms = (size_t)hdr_p->alarmCount;
+	return 0;
+}
+
+void
+dataset_unmap (Dataset_t *dataset_p)
+{
+	/* preconds */
+	if (dataset_p == NULL)
+		return;
+
+	if (dataset_p->map_p != NULL)
+		munmap(dataset_p->map_p, dataset_p->mapLen);
+	memset(dataset_p, 0, sizeof(*dataset_p));
+}
+
+static int
+write_all (FILE *file_p, const void *buf_p, size_t size, size_t cnt)
+{
+	if (cnt == 0)
+		return 0;
+	return (fwrite(buf_p, size, cnt, file_p) == cnt)? 0 : -1;
+}
+
+/**
+ * sort the IDs (and alarms) into search order, in place, and write them out
+ * duplicate IDs are an error
+ */
+int
+dataset_write (const char *fileName_p, uint64_t *ids_p, size_t count, int bitSize, uint64_t *alarms_p, size_t numAlarms)
+{
+	DatasetHeader_t hdr;
+	FILE *file_p;
+	size_t i;
+	int ret;
+
+	/* preconds */
+	if (fileName_p == NULL)
+		return -1;
+	if ((ids_p == NULL) && (count > 0))
+		return -1;
+	if ((alarms_p == NULL) && (numAlarms > 0))
+		return -1;
+	if ((bitSize < 1) || (bitSize > 64))
+		return -1;
+
+	devset_sort(ids_p, count);
+	for (i=1; i<count; ++i)
+		if (ids_p[i] == ids_p[i-1]) {
+			printf("duplicate ID %"PRIu64"\n", ids_p[i]);
+			return -1;
+		}
+	devset_sort(alarms_p, numAlarms);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, DATASET_MAGIC, sizeof(hdr.magic));
+	hdr.version = DATASET_VERSION;
+	hdr.bitWidth = (uint16_t)bitSize;
+	hdr.flags = DATASET_FLAG_SORTED;
+	hdr.count = count;
+	hdr.alarmCount = numAlarms;
+
+	file_p = fopen(fileName_p, "wb");
+	if (file_p == NULL) {
+		perror("open dataset");
+		return -1;
+	}
+	ret = write_all(file_p, &hdr, sizeof(hdr), 1);
+	if (ret == 0)
+		ret = write_all(file_p, ids_p, sizeof(*ids_p), count);
+	if (ret == 0)
+		ret = write_all(file_p, alarms_p, sizeof(*alarms_p), numAlarms);
+	if (fclose(file_p) != 0)
+		ret = -1;
+	if (ret != 0)
+		perror("write dataset");
+	return ret;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#ifndef ROM_SEARCH_DATASET__H
+#define ROM_SEARCH_DATASET__H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * binary device population, to be mmapped as is
+ *
+ *	header (DatasetHeader_t, 32 bytes)
+ *	count × uint64_t       the IDs, in search order (see devset.h)
+ *	alarmCount × uint64_t  the IDs with their alarm flag set, in search order
+ *
+ * everything is in the byte order of the machine that wrote it
+ */
+#define DATASET_MAGIC "ROMd"
+#define DATASET_VERSION 1
+// the IDs are sorted in search order and unique
+#define DATASET_FLAG_SORTED 0x1
+
+typedef struct {
+	char magic[4];
+	uint16_t version;
+	uint16_t bitWidth;
+	uint32_t flags;
+	uint32_t reserved;
+	uint64_t count;
+	uint64_t alarmCount;
+} DatasetHeader_t;
+
+typedef struct {
+	void *map_p;
+	size_t mapLen;
+
+	uint64_t *ids_p;
+	size_t count;
+	int bitSize;
+	uint64_t *alarms_p;
+	size_t numAlarms;
+} Dataset_t;
+
+int dataset_map (const char *fileName_p, Dataset_t *dataset_p);
+void dataset_unmap (Dataset_t *dataset_p);
+int dataset_write (const char *fileName_p, uint64_t *ids_p, size_t count, int bitSize, uint64_t *alarms_p, size_t numAlarms);
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "common.h"
+#include "devset.h"
+
+static int
+search_order_cmp (const void *a_p, const void *b_p)
+{
+	uint64_t a = bit_reverse64(*(const uint64_t*)a_p);
+	uint64_t b = bit_reverse64(*(const uint64_t*)b_p);
+
+	if (a < b)
+		return -1;
+	if (a > b)
+		return 1;
+	return 0;
+}
+
+/**
+ * put an array of IDs into search order
+ */
+void
+devset_sort (uint64_t *ids_p, size_t count)
+{
+	/* preconds */
+	if ((ids_p == NULL) || (count < 2))
+		return;
+
+	qsort(ids_p, count, sizeof(*ids_p), search_order_cmp);
+}
+
+/**
+ * take over the given array of IDs and sort it into search order
+ */
+int
+devset_init (DevSet_t *set_p, uint64_t *ids_p, size_t count, int bitSize)
+{
+	int ret;
+
+	ret = devset_init_sorted(set_p, ids_p, count, bitSize);
+	if (ret != 0)
+		return ret;
+	devset_sort(ids_p, count);
+	return 0;
+}
+
+/**
+ * use an array of IDs that is already in search order, as is
+ */
+int
+devset_init_sorted (DevSet_t *set_p, uint64_t *ids_p, size_t count, int bitSize)
+{
+	/* preconds */
+	if (set_p == NULL)
+		return -1;
+	if ((ids_p == NULL) && (count > 0))
+		return -1;
+	if ((bitSize < 1) || (bitSize > 64))
+		return -1;
+
+	set_p->ids_p = ids_p;
+	set_p->count = count;
+	set_p->bitSize = bitSize;
+	devset_reset(set_p);
+	return 0;
+}
+
+/**
+ * bus reset: every device is back in the running
+ */
+void
+devset_reset (DevSet_t *set_p)
+{
+	/* preconds */
+	if (set_p == NULL)
+		return;
+
+	set_p->lo = 0;
+	set_p->hi = set_p->count;
+	set_p->bitPos = 0;
+	set_p->splitPos = -1;
+}
+
+/**
+ * find the first active device with a 1 at the current bit position
+ * (binary search, the active devices agree on all the bits before it)
+ */
+static void
+devset_find_split (DevSet_t *set_p)
+{
+	size_t lo, hi, mid;
+	uint64_t mask;
+
+	if (set_p->splitPos == set_p->bitPos)
+		return;
+
+	mask = 1llu << set_p->bitPos;
+	lo = set_p->lo;
+	hi = set_p->hi;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if (set_p->ids_p[mid] & mask)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	set_p->split = lo;
+	set_p->splitPos = set_p->bitPos;
+}
+
+/**
+ * the wired-AND of the current bit (or its complement) of every active device
+ * with nobody driving the bus it reads as 1
+ */
+int
+devset_read (DevSet_t *set_p, bool complement)
+{
+	/* preconds */
+	if (set_p == NULL)
+		return 1;
+
+	if ((set_p->lo == set_p->hi) || (set_p->bitPos >= set_p->bitSize))
+		return 1;
+
+	devset_find_split(set_p);
+	if (complement)
+		return (set_p->split < set_p->hi)? 0 : 1;
+	return (set_p->split > set_p->lo)? 0 : 1;
+}
+
+/**
+ * the master picked a direction, drop the devices that don't match and move
+ * on to the next bit
+ */
+void
+devset_select (DevSet_t *set_p, int bit)
+{
+	/* preconds */
+	if (set_p == NULL)
+		return;
+	if (set_p->bitPos >= set_p->bitSize)
+		return;
+
+	if (set_p->lo < set_p->hi) {
+		devset_find_split(set_p);
+		if (bit)
+			set_p->lo = set_p->split;
+		else
+			set_p->hi = set_p->split;
+	}
+
+	// past the last bit whoever is left was addressed; nobody drives the
+	// bus any more
+	++set_p->bitPos;
+}
+
+/**
+ * where <id> is in the set, or count if it isn't there
+ */
+size_t
+devset_find (const DevSet_t *set_p, uint64_t id)
+{
+	size_t lo, hi, mid;
+	uint64_t key, midKey;
+
+	/* preconds */
+	if (set_p == NULL)
+		return 0;
+
+	key = bit_reverse64(id);
+	lo = 0;
+	hi = set_p->count;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		midKey = bit_reverse64(set_p->ids_p[mid]);
+		if (midKey == key)
+			return mid;
+		if (midKey < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return set_p->count;
+}
+
+size_t
+devset_active (const DevSet_t *set_p)
+{
+	/* preconds */
+	if (set_p == NULL)
+		return 0;
+
+	return set_p->hi - set_p->lo;
+}
+
+/**
+ * how many of the active devices have <bit> at the current bit position
+ */
+size_t
+devset_side (DevSet_t *set_p, int bit)
+{
+	/* preconds */
+	if (set_p == NULL)
+		return 0;
+
+	if ((set_p->lo == set_p->hi) || (set_p->bitPos >= set_p->bitSize))
+		return 0;
+
+	devset_find_split(set_p);
+	return bit? (set_p->hi - set_p->split) : (set_p->split - set_p->lo);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#ifndef ROM_SEARCH_DEVSET__H
+#define ROM_SEARCH_DEVSET__H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * the device population of a simulated bus
+ *
+ * the IDs are kept sorted by their bit-reversed value, i.e. in the order the
+ * search walks them (LSB first, '0' before '1'). every device still taking
+ * part in a search shares the path chosen so far, so they always form one
+ * contiguous range [lo, hi) of the array, and at the current bit position
+ * the devices with a 0 come before the ones with a 1
+ *
+ * a read is then just a question of whether there is anything on either side
+ * of that split, and a direction bit just moves one end of the range
+ */
+typedef struct {
+	uint64_t *ids_p;
+	size_t count;
+	int bitSize;
+
+	size_t lo, hi;
+	int bitPos;
+	size_t split;
+	int splitPos;
+} DevSet_t;
+
+void devset_sort (uint64_t *ids_p, size_t count);
+int devset_init (DevSet_t *set_p, uint64_t *ids_p, size_t count, int bitSize);
+int devset_init_sorted (DevSet_t *set_p, uint64_t *ids_p, size_t count, int bitSize);
+void devset_reset (DevSet_t *set_p);
+int devset_read (DevSet_t *set_p, bool complement);
+void devset_select (DevSet_t *set_p, int bit);
+size_t devset_find (const DevSet_t *set_p, uint64_t id);
+size_t devset_active (const DevSet_t *set_p);
+size_t devset_side (DevSet_t *set_p, int bit);
+
+#endif
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "crc8.h"
+#include "generate.h"
+
+static const char *distributionNames_pG[GEN_DISTRIBUTIONS] = {
+	"uniform",
+	"family",
+	"prefix",
+	"allfork",
+};
+
+static uint64_t
+low_mask (int bits)
+{
+	if (bits >= 64)
+		return ~(uint64_t)0;
+	return ((uint64_t)1 << bits) - 1;
+}
+
+static int
+value_cmp (const void *a_p, const void *b_p)
+{
+	uint64_t a = *(const uint64_t*)a_p;
+	uint64_t b = *(const uint64_t*)b_p;
+
+	if (a < b)
+		return -1;
+	if (a > b)
+		return 1;
+	return 0;
+}
+
+void
+generate_defaults (GenParams_t *params_p)
+{
+	/* preconds */
+	if (params_p == NULL)
+		return;
+
+	memset(params_p, 0, sizeof(*params_p));
+	params_p->distribution = GEN_UNIFORM;
+	params_p->count = 8;
+	params_p->bitSize = 8;
+	params_p->families = GEN_DEFAULT_FAMILIES;
+	params_p->prefixBits = -1;
+}
+
+int
+generate_parse_distribution (const char *str_p, GenDistribution_e *distributionOut_p)
+{
+	int i;
+
+	/* preconds */
+	if ((str_p == NULL) || (distributionOut_p == NULL))
+		return -1;
+
+	for (i=0; i<GEN_DISTRIBUTIONS; ++i)
+		if (strcmp(str_p, distributionNames_pG[i]) == 0) {
+			*distributionOut_p = (GenDistribution_e)i;
+			return 0;
+		}
+	return -1;
+}
+
+const char *
+generate_distribution_name (GenDistribution_e distribution)
+{
+	if ((unsigned)distribution >= GEN_DISTRIBUTIONS)
+		return "unknown";
+	return distributionNames_pG[distribution];
+}
+
+/**
+ * allocate count unique IDs into *idsOut_p
+ *
+ * every ID is (random << fixedBits) | front, where front is whatever the
+ * distribution puts in the low bits: the IDs are drawn, sorted and the
+ * duplicates dropped, and the gap is drawn again until there is none
+ * the refill only ever touches the tail, so the result depends on nothing
+ * but the parameters
+ * the CRC8 byte depends only on the bits below it, so it can't make two IDs
+ * the same or different
+ */
+int
+generate_ids (const GenParams_t *params_p, uint64_t **idsOut_p)
+{
+	uint64_t *ids_p;
+	uint64_t mask, state, front, fronts[1 << GEN_FAMILY_BITS];
+	size_t n, i, j;
+	unsigned numFronts, k;
+	int fixedBits, freeBits;
+
+	/* preconds */
+	if ((params_p == NULL) || (idsOut_p == NULL))
+		return -1;
+	if ((params_p->bitSize < 1) || (params_p->bitSize > 64) || (params_p->count == 0))
+		return -1;
+	if ((unsigned)params_p->distribution >= GEN_DISTRIBUTIONS)
+		return -1;
+	if (params_p->crc && (params_p->bitSize != CRC8_ROM_BITS)) {
+		printf("CRC8 IDs have to be %d bits\n", CRC8_ROM_BITS);
+		return -1;
+	}
+
+	mask = low_mask(params_p->bitSize);
+	state = params_p->seed;
+	numFronts = 1;
+	fronts[0] = 0;
+	fixedBits = 0;
+
+	switch (params_p->distribution) {
+		case GEN_UNIFORM:
+			break;
+
+		case GEN_FAMILY:
+			fixedBits = (params_p->bitSize > GEN_FAMILY_BITS)? GEN_FAMILY_BITS : params_p->bitSize - 1;
+			numFronts = params_p->families? params_p->families : GEN_DEFAULT_FAMILIES;
+			if ((fixedBits < 1) || (numFronts > (1u << fixedBits))) {
+				printf("can't have %u family code(s) in %d bit(s)\n", numFronts, fixedBits);
+				return -1;
+			}
+			k = 0;
+			while (k < numFronts) {
+				front = prng_next(&state) & low_mask(fixedBits);
+				for (j=0; j<k; ++j)
+					if (fronts[j] == front)
+						break;
+				if (j == k)
+					fronts[k++] = front;
+			}
+			break;
+
+		case GEN_PREFIX:
+			fixedBits = (params_p->prefixBits < 0)? params_p->bitSize / 2 : params_p->prefixBits;
+			if (fixedBits >= (params_p->bitSize - (params_p->crc? 8 : 0))) {
+				printf("a %d-bit prefix leaves nothing of a %d-bit ID\n", fixedBits, params_p->bitSize);
+				return -1;
+			}
+			fronts[0] = prng_next(&state) & low_mask(fixedBits);
+			break;
+
+		case GEN_ALLFORK:
+			while ((fixedBits < 64) && (((uint64_t)1 << fixedBits) < params_p->count))
+				++fixedBits;
+			if (fixedBits > (params_p->bitSize - (params_p->crc? 8 : 0))) {
+				printf("%zu devices don't fit in %d bit(s)\n", params_p->count, params_p->bitSize);
+				return -1;
+			}
+			break;
+
+		default:
+			return -1;
+	}
+
+	// same rule as always: ask for at most half of what the bits can hold so
+	// that drawing unique IDs doesn't go on forever
+	freeBits = params_p->bitSize - fixedBits - (params_p->crc? 8 : 0);
+	if ((params_p->distribution != GEN_ALLFORK) && (freeBits < 63) &&
+			(params_p->count > ((((uint64_t)numFronts) << freeBits) >> 1))) {
+		printf("%d bit(s) with the %s distribution can't randomly hold %zu devices\n",
+				params_p->bitSize, generate_distribution_name(params_p->distribution), params_p->count);
+		return -1;
+	}
+
+	ids_p = (uint64_t*)malloc(params_p->count * sizeof(uint64_t));
+	if (ids_p == NULL) {
+		printf("can't allocate memory\n");
+		return -1;
+	}
+
+	n = 0;
+	while (n < params_p->count) {
+		for (i=n; i<params_p->count; ++i) {
+			if (params_p->distribution == GEN_ALLFORK)
+				front = i;
+			else
+				front = fronts[(numFronts > 1)? prng_next(&state) % numFronts : 0];
+			ids_p[i] = ((fixedBits < 64)? (prng_next(&state) << fixedBits) | front : front) & mask;
+			if (params_p->crc)
+				ids_p[i] = crc8_rom_fix(ids_p[i]);
+		}
+		if (params_p->distribution == GEN_ALLFORK)
+			break;
+
+		qsort(ids_p, params_p->count, sizeof(*ids_p), value_cmp);
+		n = 1;
+		for (i=1; i<params_p->count; ++i)
+			if (ids_p[i] != ids_p[n-1])
+				ids_p[n++] = ids_p[i];
+	}
+
+	*idsOut_p = ids_p;
+	return 0;
+}
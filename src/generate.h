@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#ifndef ROM_SEARCH_GENERATE__H
+#define ROM_SEARCH_GENERATE__H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * reproducible device populations: the same parameters (seed included)
+ * always give the same IDs
+ *
+ * search order is LSB first, so the "front" of an ID is its low bits
+ *	uniform  every bit random
+ *	family   the low 8 bits (the 1-Wire family code) come from a small set
+ *	         of codes, the rest is random
+ *	prefix   the low prefixBits are the same for every device
+ *	allfork  the low bits count up, so the top of the search tree forks at
+ *	         every node, the rest is random
+ *
+ * with crc set (64-bit IDs only) the top byte of every ID is the CRC8 of the
+ * other 7, as on a real 1-Wire device (see crc8.h)
+ */
+typedef enum {
+	GEN_UNIFORM,
+	GEN_FAMILY,
+	GEN_PREFIX,
+	GEN_ALLFORK,
+	GEN_DISTRIBUTIONS,
+} GenDistribution_e;
+
+#define GEN_FAMILY_BITS 8
+#define GEN_DEFAULT_FAMILIES 4
+
+typedef struct {
+	GenDistribution_e distribution;
+	uint64_t seed;
+	size_t count;
+	int bitSize;
+	unsigned families;	// family: how many family codes (0: default)
+	int prefixBits;		// prefix: how many shared bits (-1: half the ID)
+	bool crc;		// top byte is the CRC8 of the rest
+} GenParams_t;
+
+void generate_defaults (GenParams_t *params_p);
+int generate_parse_distribution (const char *str_p, GenDistribution_e *distributionOut_p);
+const char *generate_distribution_name (GenDistribution_e distribution);
+int generate_ids (const GenParams_t *params_p, uint64_t **idsOut_p);
+
+#endif
@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "common.h"
+#include "output.h"
+
+static const char *formatNames_pG[OUTPUT_FORMATS] = {
+	"dec",
+	"hex",
+	"jsonl",
+	"binary",
+};
+
+// the text formats' tag, and the jsonl one
+static const char *tagText_pG[] = {"", "+ ", "= ", "- "};
+static const char *tagJson_pG[] = {NULL, "added", "confirmed", "removed"};
+
+static const char hexDigits_pG[] = "0123456789abcdef";
+
+int
+output_parse_format (const char *str_p, OutputFormat_e *formatOut_p)
+{
+	int i;
+
+	/* preconds */
+	if ((str_p == NULL) || (formatOut_p == NULL))
+		return -1;
+
+	for (i=0; i<OUTPUT_FORMATS; ++i)
+		if (strcmp(str_p, formatNames_pG[i]) == 0) {
+			*formatOut_p = (OutputFormat_e)i;
+			return 0;
+		}
+	return -1;
+}
+
+const char *
+output_format_name (OutputFormat_e format)
+{
+	if ((unsigned)format >= OUTPUT_FORMATS)
+		return "unknown";
+	return formatNames_pG[format];
+}
+
+int
+output_open (Output_t *output_p, FILE *out_p, OutputFormat_e format, size_t bufSize)
+{
+	/* preconds */
+	if ((output_p == NULL) || (out_p == NULL))
+		return -1;
+	if ((unsigned)format >= OUTPUT_FORMATS)
+		return -1;
+
+	memset(output_p, 0, sizeof(*output_p));
+	if (bufSize < OUTPUT_RECORD_MAX)
+		bufSize = OUTPUT_RECORD_MAX;
+	output_p->buf_p = (char*)malloc(bufSize);
+	if (output_p->buf_p == NULL) {
+		perror("malloc");
+		return -1;
+	}
+	output_p->max = bufSize;
+	output_p->out_p = out_p;
+	output_p->format = format;
+	pthread_mutex_init(&output_p->lock, NULL);
+	return 0;
+}
+
+static size_t
+append_str (char *buf_p, const char *str_p)
+{
+	size_t len = strlen(str_p);
+
+	memcpy(buf_p, str_p, len);
+	return len;
+}
+
+static size_t
+append_int (char *buf_p, int val)
+{
+	if (val < 0) {
+		buf_p[0] = '-';
+		return 1 + format_u64(buf_p + 1, (uint64_t)-(int64_t)val, 0);
+	}
+	return format_u64(buf_p, (uint64_t)val, 0);
+}
+
+static size_t
+append_hex (char *buf_p, const DeviceID_t *device_p)
+{
+	size_t i, digits;
+
+	digits = (device_p->bitLen + 3) / 4;
+	if (digits == 0)
+		digits = 1;
+	for (i=0; i<digits; ++i)
+		buf_p[i] = hexDigits_pG[(device_p->value >> (4 * (digits - 1 - i))) & 0xf];
+	return digits;
+}
+
+/**
+ * one device's record into buf_p (at least OUTPUT_RECORD_MAX bytes, not
+ * terminated), busNum < 0 for none
+ * returns the length
+ */
+size_t
+output_format (char *buf_p, OutputFormat_e format, int busNum, OutputTag_e tag, const DeviceID_t *device_p)
+{
+	size_t len = 0;
+
+	/* preconds */
+	if ((buf_p == NULL) || (device_p == NULL))
+		return 0;
+	if ((unsigned)tag > OUTPUT_TAG_REMOVED)
+		tag = OUTPUT_TAG_NONE;
+
+	switch (format) {
+		case OUTPUT_DEC:
+		case OUTPUT_HEX:
+			if (busNum >= 0) {
+				len += append_str(buf_p + len, "bus");
+				len += append_int(buf_p + len, busNum);
+				len += append_str(buf_p + len, ": ");
+			}
+			len += append_str(buf_p + len, tagText_pG[tag]);
+			if (format == OUTPUT_DEC)
+				len += format_id(buf_p + len, device_p, (int)device_p->bitLen);
+			else
+				len += append_hex(buf_p + len, device_p);
+			buf_p[len++] = '\n';
+			break;
+
+		case OUTPUT_JSONL:
+			len += append_str(buf_p + len, "{");
+			if (busNum >= 0) {
+				len += append_str(buf_p + len, "\"bus\": ");
+				len += append_int(buf_p + len, busNum);
+				len += append_str(buf_p + len, ", ");
+			}
+			if (tagJson_pG[tag] != NULL) {
+				len += append_str(buf_p + len, "\"change\": \"");
+				len += append_str(buf_p + len, tagJson_pG[tag]);
+				len += append_str(buf_p + len, "\", ");
+			}
+			len += append_str(buf_p + len, "\"id\": \"");
+			len += format_u64(buf_p + len, device_p->value, 0);
+			len += append_str(buf_p + len, "\", \"hex\": \"");
+			len += append_hex(buf_p + len, device_p);
+			len += append_str(buf_p + len, "\", \"bits\": ");
+			len += format_u64(buf_p + len, (uint64_t)device_p->bitLen, 0);
+			len += append_str(buf_p + len, "}\n");
+			break;
+
+		case OUTPUT_BINARY:
+			memcpy(buf_p, &device_p->value, sizeof(device_p->value));
+			len = sizeof(device_p->value);
+			break;
+
+		default:
+			break;
+	}
+
+	return len;
+}
+
+// with the lock held
+static int
+flush_locked (Output_t *output_p)
+{
+	if (output_p->len == 0)
+		return output_p->failed? -1 : 0;
+
+	if (!output_p->failed) {
+		++output_p->writes;
+		if (fwrite(output_p->buf_p, 1, output_p->len, output_p->out_p) != output_p->len) {
+			perror("write results");
+			output_p->failed = true;
+		}
+	}
+	output_p->len = 0;
+	return output_p->failed? -1 : 0;
+}
+
+/**
+ * add a device to the output, writing the buffer out first if it won't fit
+ * once the output has failed the devices are dropped
+ */
+int
+output_device (Output_t *output_p, int busNum, OutputTag_e tag, const DeviceID_t *device_p)
+{
+	int ret = 0;
+	char record[OUTPUT_RECORD_MAX];
+	size_t len;
+
+	/* preconds */
+	if ((output_p == NULL) || (device_p == NULL))
+		return -1;
+
+	// format outside the lock, only the copy is serialized
+	len = output_format(record, output_p->format, busNum, tag, device_p);
+
+	pthread_mutex_lock(&output_p->lock);
+	if ((output_p->len + len) > output_p->max)
+		ret = flush_locked(output_p);
+	memcpy(output_p->buf_p + output_p->len, record, len);
+	output_p->len += len;
+	++output_p->records;
+	pthread_mutex_unlock(&output_p->lock);
+
+	return ret;
+}
+
+/**
+ * write out what's buffered, all the way to the file
+ */
+int
+output_flush (Output_t *output_p)
+{
+	int ret;
+
+	/* preconds */
+	if (output_p == NULL)
+		return -1;
+
+	pthread_mutex_lock(&output_p->lock);
+	ret = flush_locked(output_p);
+	if ((fflush(output_p->out_p) != 0) && !output_p->failed) {
+		perror("write results");
+		output_p->failed = true;
+		ret = -1;
+	}
+	pthread_mutex_unlock(&output_p->lock);
+	return ret;
+}
+
+/**
+ * flush and free the buffer (the file stays open)
+ * returns -1 if anything couldn't be written, at any point
+ */
+int
+output_close (Output_t *output_p)
+{
+	int ret;
+
+	/* preconds */
+	if ((output_p == NULL) || (output_p->buf_p == NULL))
+		return -1;
+
+	ret = output_flush(output_p);
+	pthread_mutex_destroy(&output_p->lock);
+	free(output_p->buf_p);
+	output_p->buf_p = NULL;
+	return ret;
+}
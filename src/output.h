@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#ifndef ROM_SEARCH_OUTPUT__H
+#define ROM_SEARCH_OUTPUT__H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "common.h"
+
+/**
+ * the devices found, formatted into one big buffer that's written out when
+ * it fills up (and at the end) instead of a few stdio calls per device
+ *
+ *	dec     the bits (MSB first), "..." and the value in decimal, as ever
+ *	hex     the value in hex, most significant (on a 1-Wire ID: CRC8)
+ *	        byte first, the way the datasheets write ROM codes
+ *	jsonl   one JSON object per line
+ *	binary  the value as a raw uint64_t in host byte order, nothing else
+ *
+ * dec, hex and jsonl carry the bus number (with several buses) and the
+ * change (see OutputTag_e), binary only the IDs
+ *
+ * several buses can write to one output at the same time, every device's
+ * record goes in whole
+ */
+typedef enum {
+	OUTPUT_DEC,
+	OUTPUT_HEX,
+	OUTPUT_JSONL,
+	OUTPUT_BINARY,
+	OUTPUT_FORMATS,
+} OutputFormat_e;
+
+// what a delta search (see Bus_t.cacheFile_p) says about a device
+typedef enum {
+	OUTPUT_TAG_NONE,
+	OUTPUT_TAG_ADDED,
+	OUTPUT_TAG_CONFIRMED,
+	OUTPUT_TAG_REMOVED,
+} OutputTag_e;
+
+#define OUTPUT_DEFAULT_BUFFER (64 * 1024)
+// the longest record of any format
+#define OUTPUT_RECORD_MAX 192
+
+typedef struct {
+	pthread_mutex_t lock;
+	FILE *out_p;
+	OutputFormat_e format;
+	char *buf_p;
+	size_t len;
+	size_t max;
+	bool failed;
+
+	// results
+	uint64_t records;
+	uint64_t writes;
+} Output_t;
+
+int output_parse_format (const char *str_p, OutputFormat_e *formatOut_p);
+const char *output_format_name (OutputFormat_e format);
+int output_open (Output_t *output_p, FILE *out_p, OutputFormat_e format, size_t bufSize);
+size_t output_format (char *buf_p, OutputFormat_e format, int busNum, OutputTag_e tag, const DeviceID_t *device_p);
+int output_device (Output_t *output_p, int busNum, OutputTag_e tag, const DeviceID_t *device_p);
+int output_flush (Output_t *output_p);
+int output_close (Output_t *output_p);
+
+#endif
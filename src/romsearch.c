@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "common.h"
+#include "crc8.h"
+#include "transport.h"
+#include "search.h"
+#include "romsearch.h"
+
+struct _romsearch {
+	Bus_t bus;
+	bool open;
+	int timeoutMs;
+	RomSearchDeviceFn_t fn_p;
+	void *fnCtx_p;
+};
+
+static int on_device (void *ctx_p, OutputTag_e tag, const DeviceID_t *device_p);
+
+void
+romsearch_defaults (RomSearchOptions_t *options_p)
+{
+	/* preconds */
+	if (options_p == NULL)
+		return;
+
+	memset(options_p, 0, sizeof(*options_p));
+	options_p->engine = ROMSEARCH_ENGINE_FORK;
+	options_p->pipelineReplay = true;
+	options_p->retries = ROMSEARCH_DEFAULT_RETRIES;
+}
+
+/**
+ * a context with these options (NULL: the defaults), with no bus yet
+ * returns NULL if the options don't go together
+ */
+RomSearch_t *
+romsearch_new (const RomSearchOptions_t *options_p)
+{
+	RomSearch_t *rs_p;
+	RomSearchOptions_t defaults;
+
+	if (options_p == NULL) {
+		romsearch_defaults(&defaults);
+		options_p = &defaults;
+	}
+	if ((options_p->engine != ROMSEARCH_ENGINE_FORK) && (options_p->engine != ROMSEARCH_ENGINE_LD))
+		return NULL;
+	if ((options_p->engine != ROMSEARCH_ENGINE_FORK) && (options_p->crcCheck || (options_p->patternMask != 0)))
+		return NULL;
+	if ((options_p->retries < 0) || (options_p->idWidth > DEVICE_ID_MAX_BITS) || (options_p->timeoutMs < 0))
+		return NULL;
+
+	rs_p = (RomSearch_t*)calloc(1, sizeof(*rs_p));
+	if (rs_p == NULL)
+		return NULL;
+
+	bus_init(&rs_p->bus, -1);
+	rs_p->bus.engine = (options_p->engine == ROMSEARCH_ENGINE_LD)? ENGINE_LD : ENGINE_FORK;
+	rs_p->bus.pipelineReplay = options_p->pipelineReplay;
+	rs_p->bus.overdrive = options_p->overdrive;
+	rs_p->bus.alarmOnly = options_p->alarmOnly;
+	rs_p->bus.crcCheck = options_p->crcCheck;
+	rs_p->bus.pattern.mask = options_p->patternMask;
+	rs_p->bus.pattern.value = options_p->patternValue & options_p->patternMask;
+	rs_p->bus.retries = options_p->retries;
+	rs_p->bus.expectBits = options_p->idWidth;
+	if (options_p->crcCheck && (options_p->idWidth == 0))
+		rs_p->bus.expectBits = CRC8_ROM_BITS;
+	rs_p->bus.onDevice_p = on_device;
+	rs_p->bus.onDeviceCtx_p = rs_p;
+	rs_p->timeoutMs = options_p->timeoutMs;
+	return rs_p;
+}
+
+void
+romsearch_free (RomSearch_t *rs_p)
+{
+	/* preconds */
+	if (rs_p == NULL)
+		return;
+
+	if (rs_p->open)
+		transport_close(&rs_p->bus.transport);
+	bus_free(&rs_p->bus);
+	free(rs_p);
+}
+
+/**
+ * search the bus a tester serves over "fifo" or "shm" (see ROMsearch -t and
+ * -N for busNum, -1 for the one, unnumbered, bus)
+ */
+int
+romsearch_open (RomSearch_t *rs_p, const char *transport_p, int busNum)
+{
+	int ret;
+	TransportType_e type;
+
+	/* preconds */
+	if ((rs_p == NULL) || (transport_p == NULL))
+		return -1;
+	if ((transport_parse_type(transport_p, &type) != 0) || (type == TRANSPORT_SIM))
+		return -1;
+
+	if (rs_p->open)
+		transport_close(&rs_p->bus.transport);
+	rs_p->open = false;
+	ret = transport_open(&rs_p->bus.transport, type, TRANSPORT_MASTER, false, busNum);
+	if (ret != 0)
+		return -1;
+	rs_p->bus.transport.timeoutMs = rs_p->timeoutMs;
+	atomic_store(&rs_p->bus.cancel, false);
+	rs_p->open = true;
+	return 0;
+}
+
+/**
+ * search whatever the caller's I/O talks to, the functions are copied
+ */
+int
+romsearch_set_io (RomSearch_t *rs_p, const RomSearchIo_t *io_p)
+{
+	int ret;
+	TransportIo_t io;
+
+	/* preconds */
+	if ((rs_p == NULL) || (io_p == NULL))
+		return -1;
+	if ((io_p->send_p == NULL) || (io_p->recv_p == NULL))
+		return -1;
+
+	if (rs_p->open)
+		transport_close(&rs_p->bus.transport);
+	rs_p->open = false;
+	ret = transport_open(&rs_p->bus.transport, TRANSPORT_CUSTOM, TRANSPORT_MASTER, false, -1);
+	if (ret != 0)
+		return -1;
+	io.send_p = io_p->send_p;
+	io.recv_p = io_p->recv_p;
+	io.ctx_p = io_p->ctx_p;
+	ret = transport_attach_io(&rs_p->bus.transport, &io);
+	if (ret != 0) {
+		transport_close(&rs_p->bus.transport);
+		return -1;
+	}
+	rs_p->bus.transport.timeoutMs = rs_p->timeoutMs;
+	atomic_store(&rs_p->bus.cancel, false);
+	rs_p->open = true;
+	return 0;
+}
+
+/**
+ * fn_p (NULL for none) gets every device as it's found
+ */
+void
+romsearch_set_callback (RomSearch_t *rs_p, RomSearchDeviceFn_t fn_p, void *ctx_p)
+{
+	/* preconds */
+	if (rs_p == NULL)
+		return;
+
+	rs_p->fn_p = fn_p;
+	rs_p->fnCtx_p = ctx_p;
+}
+
+static int
+on_device (void *ctx_p, OutputTag_e tag, const DeviceID_t *device_p)
+{
+	RomSearch_t *rs_p = (RomSearch_t*)ctx_p;
+
+	(void)tag;
+	if (rs_p->fn_p == NULL)
+		return 0;
+	return rs_p->fn_p(rs_p->fnCtx_p, device_value(device_p), (unsigned)device_p->bitLen);
+}
+
+/**
+ * search the whole bus once, the callback gets the devices as they turn up
+ * a cancelled search stops before its next bus operation, the devices
+ * already handed out stay found. a cancel that comes before the run (but
+ * after romsearch_open()/romsearch_set_io()) stops it before it starts, one
+ * that comes after it has finished is kept for the next run
+ */
+RomSearchResult_e
+romsearch_run (RomSearch_t *rs_p)
+{
+	int ret;
+	bool cancelled;
+
+	/* preconds */
+	if ((rs_p == NULL) || !rs_p->open)
+		return ROMSEARCH_FAILED;
+
+	// the stats are this run's
+	memset(&rs_p->bus.ops, 0, sizeof(rs_p->bus.ops));
+	memset(&rs_p->bus.slots, 0, sizeof(rs_p->bus.slots));
+	memset(&rs_p->bus.stats, 0, sizeof(rs_p->bus.stats));
+	rs_p->bus.devicesFound = 0;
+	rs_p->bus.roundTripsSaved = 0;
+	rs_p->bus.peakPending = 0;
+	rs_p->bus.idBits = 0;
+	rs_p->bus.pattern.skippedSubtrees = rs_p->bus.pattern.deadEnds = rs_p->bus.pattern.deadEndBits = 0;
+
+	ret = bus_search(&rs_p->bus);
+
+	// read and clear in one go, so a cancel that comes in now isn't lost
+	cancelled = atomic_exchange(&rs_p->bus.cancel, false);
+	if (cancelled)
+		return ROMSEARCH_CANCELLED;
+	return (ret == 0)? ROMSEARCH_OK : ROMSEARCH_FAILED;
+}
+
+/**
+ * stop the search under way, or the next one if none is, safe from any
+ * thread or a signal handler
+ */
+void
+romsearch_cancel (RomSearch_t *rs_p)
+{
+	/* preconds */
+	if (rs_p == NULL)
+		return;
+
+	atomic_store(&rs_p->bus.cancel, true);
+}
+
+int
+romsearch_stats (const RomSearch_t *rs_p, RomSearchStats_t *stats_p)
+{
+	/* preconds */
+	if ((rs_p == NULL) || (stats_p == NULL))
+		return -1;
+
+	memset(stats_p, 0, sizeof(*stats_p));
+	stats_p->devices = rs_p->bus.devicesFound;
+	stats_p->resets = rs_p->bus.ops.resets;
+	stats_p->searches = rs_p->bus.ops.searches;
+	stats_p->reads = rs_p->bus.ops.reads;
+	stats_p->writes = rs_p->bus.ops.writes;
+	stats_p->timeouts = rs_p->bus.stats.timeouts;
+	stats_p->badReplies = rs_p->bus.stats.badReplies;
+	stats_p->retries = rs_p->bus.stats.bitRetries + rs_p->bus.stats.nodeRetries + rs_p->bus.stats.pathRetries;
+	stats_p->busTimeUs = busslots_time_us(&rs_p->bus.slots);
+	return 0;
+}
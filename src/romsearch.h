@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+/*
+ * libromsearch: the ROMsearch search, for programs that want the devices
+ * themselves instead of ROMsearch's output
+ *
+ * a context searches one bus. the bus is either a tester at the other end
+ * of a fifo or shm link (romsearch_open()), or whatever the caller's I/O
+ * functions talk to (romsearch_set_io()). every device is handed to the
+ * callback the moment it's found, while the search carries on with the rest
+ * of the bus
+ *
+ * a context is used by one thread at a time, except for romsearch_cancel()
+ * which can be called from anywhere, a signal handler included; it stops the
+ * run under way or, in between runs, the next one. several contexts can
+ * search several buses at the same time
+ *
+ *	RomSearch_t *rs_p = romsearch_new(NULL);
+ *	romsearch_open(rs_p, "fifo", -1);
+ *	romsearch_set_callback(rs_p, got_one, &myState);
+ *	ret = romsearch_run(rs_p);
+ *	romsearch_free(rs_p);
+ */
+
+#ifndef ROM_SEARCH_ROMSEARCH__H
+#define ROM_SEARCH_ROMSEARCH__H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _romsearch RomSearch_t;
+
+typedef enum {
+	ROMSEARCH_ENGINE_FORK,
+	ROMSEARCH_ENGINE_LD,
+} RomSearchEngine_e;
+
+typedef enum {
+	ROMSEARCH_OK = 0,
+	ROMSEARCH_FAILED = -1,
+	ROMSEARCH_CANCELLED = -2,
+} RomSearchResult_e;
+
+// how many times a read or a walk is tried again before giving up on it
+#define ROMSEARCH_DEFAULT_RETRIES 3
+
+/**
+ * how to search, see ROMsearch -h for what each of these does
+ * start from romsearch_defaults(), later versions may add fields
+ */
+typedef struct {
+	RomSearchEngine_e engine;
+	// send the known part of each path in one go (default: true)
+	bool pipelineReplay;
+	bool overdrive;
+	// only the devices with their alarm flag set
+	bool alarmOnly;
+	// only 64-bit IDs with a good CRC8 (fork engine only)
+	bool crcCheck;
+	// only IDs that have the bits of patternValue where patternMask is set
+	// (fork engine only)
+	uint64_t patternValue;
+	uint64_t patternMask;
+	// recovery from bad replies (fork engine only), see ROMsearch -r
+	int retries;
+	// the ID width, if known (0: not), crcCheck implies 64
+	unsigned idWidth;
+	// give up on a reply after this long (0: wait forever)
+	int timeoutMs;
+} RomSearchOptions_t;
+
+/**
+ * the bus I/O: the commands are the ones the tester takes ('R' reset, 'S'
+ * search, 'r' read a bit, '0'/'1' write a bit, ...), one character each,
+ * and every read is answered with '0' or '1'
+ *
+ * send_p() takes all len bytes and returns 0 (-1 on failure)
+ * recv_p() waits up to timeoutMs (0: forever) for up to len bytes and
+ * returns how many it got, 0 if the bus has gone, ROMSEARCH_IO_TIMEOUT if
+ * nothing came in time, or -1 on failure
+ */
+#define ROMSEARCH_IO_TIMEOUT (-2)
+typedef struct {
+	int (*send_p) (void *ctx_p, const char *buf_p, size_t len);
+	ssize_t (*recv_p) (void *ctx_p, char *buf_p, size_t len, int timeoutMs);
+	void *ctx_p;
+} RomSearchIo_t;
+
+/**
+ * a device has been found: its ID (the first bit found is bit 0) and how
+ * many bits it has
+ * return non-zero to cancel the rest of the search
+ */
+typedef int (*RomSearchDeviceFn_t) (void *ctx_p, uint64_t id, unsigned bits);
+
+// what the last romsearch_run() took
+typedef struct {
+	uint64_t devices;
+	uint64_t resets;
+	uint64_t searches;
+	uint64_t reads;
+	uint64_t writes;
+	// replies that never came, ones that were neither '0' nor '1', and
+	// retries of all kinds
+	uint64_t timeouts;
+	uint64_t badReplies;
+	uint64_t retries;
+	// how long that would have kept a real bus busy
+	double busTimeUs;
+} RomSearchStats_t;
+
+void romsearch_defaults (RomSearchOptions_t *options_p);
+RomSearch_t *romsearch_new (const RomSearchOptions_t *options_p);
+void romsearch_free (RomSearch_t *rs_p);
+int romsearch_open (RomSearch_t *rs_p, const char *transport_p, int busNum);
+int romsearch_set_io (RomSearch_t *rs_p, const RomSearchIo_t *io_p);
+void romsearch_set_callback (RomSearch_t *rs_p, RomSearchDeviceFn_t fn_p, void *ctx_p);
+RomSearchResult_e romsearch_run (RomSearch_t *rs_p);
+void romsearch_cancel (RomSearch_t *rs_p);
+int romsearch_stats (const RomSearch_t *rs_p, RomSearchStats_t *stats_p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1653 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include "common.h"
+#include "crc8.h"
+#include "transport.h"
+#include "search.h"
+
+// last-discrepancy search state (see Maxim AN187)
+// positions are 1-based, 0 means "none"
+typedef struct {
+	DeviceID_t rom;
+	size_t lastDiscrepancy;
+	bool lastDevice;
+} LdState_t;
+
+static int run_fork_engine (Bus_t *bus_p);
+static int run_ld_engine (Bus_t *bus_p);
+static int run_delta_engine (Bus_t *bus_p);
+static int run_shared_engine (Bus_t *bus_p);
+static int push_pending (Bus_t *bus_p, const DeviceID_t *device_p);
+static int search_pending (Bus_t *bus_p, OutputTag_e tag, DeviceList_t *found_p);
+static int emit_device (Bus_t *bus_p, OutputTag_e tag, const DeviceID_t *device_p);
+static int crc_check_device (Bus_t *bus_p, DeviceID_t *device_p);
+static bool key_prefix_equal (uint64_t a, uint64_t b, size_t len);
+static bool key_prefix_covered (const uint64_t *keys_p, size_t cnt, uint64_t key, size_t len);
+static int device_list_add (DeviceList_t *list_p, const DeviceID_t *device_p);
+static int load_cache (const char *fileName_p, DeviceList_t *cache_p);
+static int save_cache (const char *fileName_p, const DeviceList_t *cache_p, const DeviceList_t *found_p);
+static void sort_cache (DeviceList_t *cache_p);
+static int next_inventory (DeviceList_t *cache_p, const DeviceList_t *found_p);
+static int add_bit (Bus_t *bus_p, DeviceID_t *device_p, uint8_t bit, bool send);
+static int find_one_device (Bus_t *bus_p, DeviceID_t *device_p);
+static int walk_to_node (Bus_t *bus_p, const DeviceID_t *device_p);
+static int read_next_pair (Bus_t *bus_p, DeviceID_t *device_p, unsigned *digitsRet_p, int *nodeRetries_p);
+static int walk_path (Bus_t *bus_p, const DeviceID_t *device_p, char *replies_p, size_t *missingOut_p);
+static int step_path (Bus_t *bus_p, const DeviceID_t *device_p, char *replies_p, size_t *missingOut_p);
+static int ld_search_next (Bus_t *bus_p, LdState_t *state_p);
+static int send_path (Bus_t *bus_p, const DeviceID_t *device_p, char *replies_p);
+static bool path_present (const DeviceID_t *device_p, const char *replies_p);
+static size_t path_missing_bit (const DeviceID_t *device_p, const char *replies_p);
+static int replay_prefix (Bus_t *bus_p, DeviceID_t *device_p, char *repliesOut_p);
+static int get_next_digits (Bus_t *bus_p, unsigned *digitsRet_p);
+static char reset_cmd (const Bus_t *bus_p);
+static char search_cmd (const Bus_t *bus_p);
+static int pattern_bit (const Bus_t *bus_p, size_t pos);
+static int bus_send (Bus_t *bus_p, const char *buf_p, size_t len);
+static int bus_recv_all (Bus_t *bus_p, char *buf_p, size_t len);
+static void note_device_stats (Bus_t *bus_p, const DeviceID_t *device_p);
+
+void
+bus_init (Bus_t *bus_p, int busNum)
+{
+	/* preconds */
+	if (bus_p == NULL)
+		return;
+
+	memset(bus_p, 0, sizeof(*bus_p));
+	bus_p->busNum = busNum;
+	bus_p->engine = ENGINE_FORK;
+	bus_p->pipelineReplay = true;
+	bus_p->retries = BUS_DEFAULT_RETRIES;
+	atomic_init(&bus_p->cancel, false);
+}
+
+void
+bus_free (Bus_t *bus_p)
+{
+	/* preconds */
+	if (bus_p == NULL)
+		return;
+
+	free(bus_p->results_p);
+	bus_p->results_p = NULL;
+	bus_p->numResults = bus_p->maxResults = 0;
+	free(bus_p->devStats_p);
+	bus_p->devStats_p = NULL;
+	bus_p->numDevStats = bus_p->maxDevStats = 0;
+	free(bus_p->inventory.entries_p);
+	memset(&bus_p->inventory, 0, sizeof(bus_p->inventory));
+	bus_p->haveInventory = false;
+}
+
+/**
+ * enumerate all the devices on the bus with the configured engine
+ * the bus' transport must already be open
+ *
+ * returns 0, -1 on failure or BUS_CANCELLED if the bus' cancel flag stopped
+ * it (nothing is printed for that, it's what was asked for)
+ */
+int
+bus_search (Bus_t *bus_p)
+{
+	int ret;
+
+	/* preconds */
+	if (bus_p == NULL)
+		return -1;
+
+	// everyone to overdrive speed first, from then on the resets have to be
+	// overdrive resets too or they'd drop back to standard speed
+	if (bus_p->overdrive) {
+		ret = bus_send(bus_p, "RO", 2);
+		if (ret != 0)
+			return ret;
+	}
+
+	if (bus_p->pool_p != NULL)
+		return run_shared_engine(bus_p);
+	if (bus_p->engine == ENGINE_LD)
+		return run_ld_engine(bus_p);
+	if ((bus_p->cacheFile_p != NULL) || bus_p->keepInventory)
+		return run_delta_engine(bus_p);
+	return run_fork_engine(bus_p);
+}
+
+/**
+ * the fork algorithm: every 00 fork found while searching for one device is
+ * pushed (with "the other path" already added) onto a stack of pending
+ * partial IDs to be searched afterwards
+ *
+ * the stack is worked depth-first, so there are never more pending entries
+ * than there are bits in an ID, and each device is printed and forgotten as
+ * soon as it's found
+ */
+static int
+run_fork_engine (Bus_t *bus_p)
+{
+	int ret;
+	DeviceID_t device;
+
+	workstack_init(&bus_p->workStack);
+	memset(&device, 0, sizeof(device));
+	ret = workstack_push(&bus_p->workStack, &device);
+	if (ret != 0) {
+		fprintf(stderr, "failed to create first node\n");
+		return -1;
+	}
+
+	ret = search_pending(bus_p, OUTPUT_TAG_NONE, NULL);
+	bus_p->peakPending = bus_p->workStack.peakDepth;
+	workstack_free(&bus_p->workStack);
+	return ret;
+}
+
+/**
+ * run find_one_device(bus_p) on everything on the work stack (and everything it
+ * pushes) until the stack is empty
+ *
+ * each device is written out (with tag) as soon as it's found
+ * and, if found_p is given, also kept there
+ */
+static int
+search_pending (Bus_t *bus_p, OutputTag_e tag, DeviceList_t *found_p)
+{
+	int ret;
+	DeviceID_t device;
+
+	while (workstack_pop(&bus_p->workStack, &device)) {
+		ret = find_one_device(bus_p, &device);
+		if (ret == BUS_CANCELLED)
+			return ret;
+		if (ret != 0) {
+			fprintf(stderr, "failure in find_one_device\n");
+			return -1;
+		}
+		// nobody answered the first read: there's nothing on the bus
+		// (or, in a conditional search, nothing alarmed)
+		if (device.bitLen == 0)
+			continue;
+		ret = crc_check_device(bus_p, &device);
+		if (ret < 0)
+			return ret;
+		if (ret == 0)
+			continue;
+		ret = emit_device(bus_p, tag, &device);
+		if (ret != 0)
+			return -1;
+		if (found_p != NULL) {
+			ret = device_list_add(found_p, &device);
+			if (ret != 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * the fork engine as one of several workers sharing the pending forks
+ * through the bus' work pool; each worker has its own connection to
+ * (a copy of) the same devices
+ */
+static int
+run_shared_engine (Bus_t *bus_p)
+{
+	int ret;
+	DeviceID_t device;
+
+	while (workpool_take(bus_p->pool_p, bus_p->poolSlot, &device, &bus_p->steals)) {
+		ret = find_one_device(bus_p, &device);
+		// a subtree to search again has to be in the pool before this
+		// piece of work is marked done, or the others could all stop
+		if ((ret == 0) && (device.bitLen != 0))
+			ret = crc_check_device(bus_p, &device);
+		else if ((ret != 0) && (ret != BUS_CANCELLED)) {
+			fprintf(stderr, "failure in find_one_device\n");
+			ret = -1;
+		}
+		workpool_done(bus_p->pool_p);
+		if (ret < 0)
+			return ret;
+		if ((ret == 0) || (device.bitLen == 0))
+			continue;
+		ret = emit_device(bus_p, OUTPUT_TAG_NONE, &device);
+		if (ret != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * a fork was found, keep "the other path" for later
+ */
+static int
+push_pending (Bus_t *bus_p, const DeviceID_t *device_p)
+{
+	if (bus_p->pool_p != NULL)
+		return workpool_push(bus_p->pool_p, bus_p->poolSlot, device_p);
+	return workstack_push(&bus_p->workStack, device_p);
+}
+
+/**
+ * with crcCheck, make sure a device that was just found is a real one: a
+ * 64-bit ID with a good CRC8
+ *
+ * the path to one that isn't is walked again; a bit nobody on the bus has is
+ * where the search misread its way off the tree, so only the subtree from that
+ * bit down is searched again (unless the search forked there: then the other
+ * side is the real one, and it's been taken care of). if the whole path is
+ * there the device really does have that ID, so it's reported as bad instead
+ *
+ * return:
+ *  1: the device is good
+ *  0: it isn't (and has been dealt with)
+ * -1: failure
+ */
+static int
+crc_check_device (Bus_t *bus_p, DeviceID_t *device_p)
+{
+	int ret;
+	size_t missing;
+	char replies[2 * DEVICE_ID_MAX_BITS];
+	char prefix[32];
+
+	/* preconds */
+	if ((bus_p == NULL) || (device_p == NULL))
+		return -1;
+
+	if (!bus_p->crcCheck)
+		return 1;
+	if ((device_p->bitLen == CRC8_ROM_BITS) && crc8_rom_valid(device_p->value))
+		return 1;
+
+	++bus_p->stats.crcFailures;
+	++bus_p->recovering;
+	ret = walk_path(bus_p, device_p, replies, &missing);
+	--bus_p->recovering;
+	if (ret != 0)
+		return (ret < 0)? ret : -1;
+
+	if ((missing < device_p->bitLen) && (bus_p->forks & ((uint64_t)1 << missing))) {
+		++bus_p->stats.missingForks;
+		return 0;
+	}
+
+	prefix[0] = 0;
+	if (bus_p->busNum >= 0)
+		snprintf(prefix, sizeof(prefix), "bus%d: ", bus_p->busNum);
+	if ((missing < device_p->bitLen) && (bus_p->stats.crcResearches < BUS_CRC_RESEARCH_MAX)) {
+		++bus_p->stats.crcResearches;
+		fprintf(stderr, "%sbad CRC8: 0x%016"PRIx64" (%zu bits), searching again from bit %zu\n",
+				prefix, device_p->value, device_p->bitLen, missing);
+		device_truncate(device_p, missing);
+		device_p->done = false;
+		return (push_pending(bus_p, device_p) == 0)? 0 : -1;
+	}
+
+	++bus_p->stats.crcRejected;
+	fprintf(stderr, "%sbad CRC8: 0x%016"PRIx64" (%zu bits), %s\n", prefix, device_p->value, device_p->bitLen,
+			(missing < device_p->bitLen)? "giving up on it" : "it's on the bus");
+	return 0;
+}
+
+/**
+ * write one result out, tagged with the bus number when there's more than
+ * one bus; the output keeps records from buses being searched concurrently
+ * from interleaving
+ *
+ * (or, if the bus is collecting, just keep it)
+ *
+ * returns -1 if a collected device couldn't be kept: the results would be
+ * missing it, so the search has to fail
+ */
+static int
+emit_device (Bus_t *bus_p, OutputTag_e tag, const DeviceID_t *device_p)
+{
+	size_t newMax;
+	DeviceID_t *newResults_p;
+
+	/* preconds */
+	if ((bus_p == NULL) || (device_p == NULL))
+		return -1;
+
+	++bus_p->devicesFound;
+	if (device_p->bitLen > bus_p->idBits)
+		bus_p->idBits = device_p->bitLen;
+	if (bus_p->deviceStats)
+		note_device_stats(bus_p, device_p);
+	if ((bus_p->onDevice_p != NULL) && (bus_p->onDevice_p(bus_p->onDeviceCtx_p, tag, device_p) != 0))
+		atomic_store(&bus_p->cancel, true);
+	if (bus_p->collect) {
+		if (bus_p->numResults == bus_p->maxResults) {
+			newMax = (bus_p->maxResults == 0)? 64 : (2 * bus_p->maxResults);
+			newResults_p = (DeviceID_t*)realloc(bus_p->results_p, newMax * sizeof(DeviceID_t));
+			if (newResults_p == NULL) {
+				perror("realloc");
+				return -1;
+			}
+			bus_p->results_p = newResults_p;
+			bus_p->maxResults = newMax;
+		}
+		bus_p->results_p[bus_p->numResults++] = *device_p;
+		return 0;
+	}
+
+	// a failed write shows up when the output is flushed
+	if (bus_p->output_p != NULL)
+		output_device(bus_p->output_p, bus_p->busNum, tag, device_p);
+	return 0;
+}
+
+/**
+ * delta enumeration against the cache of devices seen last time
+ *
+ * each cached ID is verified with a single-path search along its own bits.
+ * the replies along that path also show every fork on it; a new device has to
+ * hang off one of those forks on the path of some device that's still there
+ * (at the bit where it parts company with the present device it shares the
+ * longest prefix with), so only the sides of those forks that no present
+ * device accounts for need to be searched
+ *
+ * confirmed devices are printed with "= " (unless changesOnly), new ones with
+ * "+ " and ones that have gone with "- "
+ *
+ * the devices start from the inventory the last search left (keepInventory)
+ * or else the cache file, and what's there now goes back to both
+ */
+static int
+run_delta_engine (Bus_t *bus_p)
+{
+	int ret, fnRtn = -1;
+	size_t i, k, prev, presentCnt, removedCnt;
+	DeviceList_t cache, found;
+	CacheEntry_t *entry_p;
+	uint64_t *presentKeys_p = NULL;
+	DeviceID_t sibling;
+	char replies[2 * DEVICE_ID_MAX_BITS];
+
+	memset(&cache, 0, sizeof(cache));
+	memset(&found, 0, sizeof(found));
+	workstack_init(&bus_p->workStack);
+
+	if (bus_p->haveInventory) {
+		cache = bus_p->inventory;
+		memset(&bus_p->inventory, 0, sizeof(bus_p->inventory));
+		bus_p->haveInventory = false;
+	}
+	else if (bus_p->cacheFile_p != NULL) {
+		ret = load_cache(bus_p->cacheFile_p, &cache);
+		if (ret != 0)
+			return -1;
+	}
+
+	// verify
+	presentCnt = removedCnt = 0;
+	for (i=0; i<cache.count; ++i) {
+		entry_p = &cache.entries_p[i];
+		ret = walk_path(bus_p, &entry_p->device, replies, &k);
+		if (ret != 0)
+			goto cleanup;
+		entry_p->present = (k == entry_p->device.bitLen);
+		entry_p->forks = 0;
+		// a pair that was lost (see step_path()) could have been a fork
+		for (k=0; k<entry_p->device.bitLen; ++k)
+			if (((replies[2*k] == '0') && (replies[(2*k) + 1] == '0')) || (replies[2*k] == '?'))
+				entry_p->forks |= (uint64_t)1 << k;
+		if (!entry_p->present || !bus_p->changesOnly) {
+			ret = emit_device(bus_p, entry_p->present? OUTPUT_TAG_CONFIRMED : OUTPUT_TAG_REMOVED, &entry_p->device);
+			if (ret != 0)
+				goto cleanup;
+		}
+		if (entry_p->present)
+			++presentCnt;
+		else
+			++removedCnt;
+	}
+
+	// the unexplained sides of the forks on the present devices' paths
+	if (presentCnt == 0) {
+		memset(&sibling, 0, sizeof(sibling));
+		ret = workstack_push(&bus_p->workStack, &sibling);
+		if (ret != 0)
+			goto cleanup;
+	}
+	else {
+		presentKeys_p = (uint64_t*)malloc(presentCnt * sizeof(uint64_t));
+		if (presentKeys_p == NULL) {
+			perror("malloc");
+			goto cleanup;
+		}
+		for (i=0,k=0; i<cache.count; ++i)
+			if (cache.entries_p[i].present)
+				presentKeys_p[k++] = cache.entries_p[i].key;
+
+		prev = cache.count;
+		for (i=0; i<cache.count; ++i) {
+			entry_p = &cache.entries_p[i];
+			if (!entry_p->present)
+				continue;
+			for (k=0; k<entry_p->device.bitLen; ++k) {
+				if (!(entry_p->forks & ((uint64_t)1 << k)))
+					continue;
+
+				// the previous present device shared this fork, it's been
+				// dealt with already
+				if ((prev != cache.count) && key_prefix_equal(cache.entries_p[prev].key, entry_p->key, k+1))
+					continue;
+
+				sibling = entry_p->device;
+				device_truncate(&sibling, k);
+				ret = add_bit(bus_p, &sibling, (uint8_t)('0' + !device_bit(&entry_p->device, k)), false);
+				if (ret != 0)
+					goto cleanup;
+				if (key_prefix_covered(presentKeys_p, presentCnt, bit_reverse64(device_value(&sibling)), k+1))
+					continue;
+				ret = workstack_push(&bus_p->workStack, &sibling);
+				if (ret != 0)
+					goto cleanup;
+			}
+			prev = i;
+		}
+	}
+
+	// search only those
+	ret = search_pending(bus_p, OUTPUT_TAG_ADDED, &found);
+	if (ret != 0)
+		goto cleanup;
+
+	if (bus_p->cacheFile_p != NULL) {
+		ret = save_cache(bus_p->cacheFile_p, &cache, &found);
+		if (ret != 0)
+			goto cleanup;
+	}
+	if (bus_p->keepInventory) {
+		ret = next_inventory(&cache, &found);
+		if (ret != 0)
+			goto cleanup;
+		bus_p->inventory = cache;
+		bus_p->haveInventory = true;
+		memset(&cache, 0, sizeof(cache));
+	}
+
+	bus_p->deltaConfirmed = presentCnt;
+	bus_p->deltaAdded = found.count;
+	bus_p->deltaRemoved = removedCnt;
+	if (!bus_p->changesOnly)
+		fprintf(stderr, "delta: %zu confirmed %zu added %zu removed\n", presentCnt, found.count, removedCnt);
+	fnRtn = 0;
+cleanup:
+	bus_p->peakPending = bus_p->workStack.peakDepth;
+	workstack_free(&bus_p->workStack);
+	free(presentKeys_p);
+	free(cache.entries_p);
+	free(found.entries_p);
+	return fnRtn;
+}
+
+static int
+cache_entry_cmp (const void *a_p, const void *b_p)
+{
+	const CacheEntry_t *a = (const CacheEntry_t*)a_p;
+	const CacheEntry_t *b = (const CacheEntry_t*)b_p;
+
+	if (a->key < b->key)
+		return -1;
+	if (a->key > b->key)
+		return 1;
+	return 0;
+}
+
+/**
+ * do the first len bits (in search order) of the two keys agree?
+ */
+static bool
+key_prefix_equal (uint64_t a, uint64_t b, size_t len)
+{
+	uint64_t mask;
+
+	if (len == 0)
+		return true;
+	if (len > 64)
+		len = 64;
+	mask = ~(uint64_t)0 << (64 - len);
+	return (a & mask) == (b & mask);
+}
+
+/**
+ * does any of the (sorted) keys start with the first len bits of key?
+ */
+static bool
+key_prefix_covered (const uint64_t *keys_p, size_t cnt, uint64_t key, size_t len)
+{
+	size_t lo, hi, mid;
+
+	if (len < 64)
+		key &= ~(~(uint64_t)0 >> len);
+
+	lo = 0;
+	hi = cnt;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if (keys_p[mid] < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo < cnt) && key_prefix_equal(keys_p[lo], key, len);
+}
+
+static int
+device_list_add (DeviceList_t *list_p, const DeviceID_t *device_p)
+{
+	size_t newMax;
+	CacheEntry_t *newEntries_p;
+
+	/* preconds */
+	if ((list_p == NULL) || (device_p == NULL))
+		return -1;
+
+	if (list_p->count == list_p->max) {
+		newMax = (list_p->max == 0)? 64 : (2 * list_p->max);
+		newEntries_p = (CacheEntry_t*)realloc(list_p->entries_p, newMax * sizeof(CacheEntry_t));
+		if (newEntries_p == NULL) {
+			perror("realloc");
+			return -1;
+		}
+		list_p->entries_p = newEntries_p;
+		list_p->max = newMax;
+	}
+
+	memset(&list_p->entries_p[list_p->count], 0, sizeof(CacheEntry_t));
+	list_p->entries_p[list_p->count].device = *device_p;
+	list_p->entries_p[list_p->count].device.done = false;
+	list_p->entries_p[list_p->count].key = bit_reverse64(device_value(device_p));
+	++list_p->count;
+
+	return 0;
+}
+
+/**
+ * cache file format, one device per line:
+ * <number of bits> <value>
+ *
+ * a missing file is an empty cache
+ * the entries come back sorted in search order with duplicates removed
+ */
+static int
+load_cache (const char *fileName_p, DeviceList_t *cache_p)
+{
+	int ret;
+	unsigned bitLen;
+	uint64_t val;
+	FILE *cacheFile_p;
+	char lineBuf[64];
+	DeviceID_t device;
+
+	/* preconds */
+	if ((fileName_p == NULL) || (cache_p == NULL))
+		return -1;
+
+	cacheFile_p = fopen(fileName_p, "r");
+	if (cacheFile_p == NULL) {
+		if (errno == ENOENT)
+			return 0;
+		perror("open cache file");
+		return -1;
+	}
+
+	while (fgets(lineBuf, sizeof(lineBuf), cacheFile_p) != NULL) {
+		if (sscanf(lineBuf, "%u %"SCNu64, &bitLen, &val) != 2)
+			continue;
+		if ((bitLen == 0) || (bitLen > DEVICE_ID_MAX_BITS))
+			continue;
+		device_set_value(&device, val, bitLen);
+		ret = device_list_add(cache_p, &device);
+		if (ret != 0) {
+			fclose(cacheFile_p);
+			return -1;
+		}
+	}
+	fclose(cacheFile_p);
+
+	sort_cache(cache_p);
+	return 0;
+}
+
+/**
+ * put the entries in search order and drop the duplicates
+ */
+static void
+sort_cache (DeviceList_t *cache_p)
+{
+	size_t i, j;
+
+	if (cache_p->count > 1) {
+		qsort(cache_p->entries_p, cache_p->count, sizeof(CacheEntry_t), cache_entry_cmp);
+		for (i=1,j=1; i<cache_p->count; ++i)
+			if (cache_p->entries_p[i].key != cache_p->entries_p[j-1].key)
+				cache_p->entries_p[j++] = cache_p->entries_p[i];
+		cache_p->count = j;
+	}
+}
+
+/**
+ * turn the cache a delta search started from into what's on the bus now: the
+ * devices still present and the ones found, ready for the next one
+ */
+static int
+next_inventory (DeviceList_t *cache_p, const DeviceList_t *found_p)
+{
+	int ret;
+	size_t i, j;
+
+	for (i=0,j=0; i<cache_p->count; ++i)
+		if (cache_p->entries_p[i].present)
+			cache_p->entries_p[j++] = cache_p->entries_p[i];
+	cache_p->count = j;
+	for (i=0; i<found_p->count; ++i) {
+		ret = device_list_add(cache_p, &found_p->entries_p[i].device);
+		if (ret != 0)
+			return -1;
+	}
+
+	sort_cache(cache_p);
+	return 0;
+}
+
+static int
+save_cache (const char *fileName_p, const DeviceList_t *cache_p, const DeviceList_t *found_p)
+{
+	size_t i;
+	FILE *cacheFile_p;
+
+	/* preconds */
+	if ((fileName_p == NULL) || (cache_p == NULL) || (found_p == NULL))
+		return -1;
+
+	cacheFile_p = fopen(fileName_p, "w");
+	if (cacheFile_p == NULL) {
+		perror("write cache file");
+		return -1;
+	}
+	for (i=0; i<cache_p->count; ++i)
+		if (cache_p->entries_p[i].present)
+			fprintf(cacheFile_p, "%zu %"PRIu64"\n", cache_p->entries_p[i].device.bitLen, device_value(&cache_p->entries_p[i].device));
+	for (i=0; i<found_p->count; ++i)
+		fprintf(cacheFile_p, "%zu %"PRIu64"\n", found_p->entries_p[i].device.bitLen, device_value(&found_p->entries_p[i].device));
+	fclose(cacheFile_p);
+
+	return 0;
+}
+
+/**
+ * the last-discrepancy algorithm: O(1) state, one full pass of the bus per
+ * device, devices come out in ROM order
+ */
+static int
+run_ld_engine (Bus_t *bus_p)
+{
+	int ret;
+	LdState_t state;
+
+	memset(&state, 0, sizeof(state));
+	while (1) {
+		ret = ld_search_next(bus_p, &state);
+		if (ret == BUS_CANCELLED)
+			return ret;
+		if (ret < 0) {
+			fprintf(stderr, "failure in ld_search_next\n");
+			return -1;
+		}
+		if (ret == 0)
+			break;
+		ret = emit_device(bus_p, OUTPUT_TAG_NONE, &state.rom);
+		if (ret != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * optionally add the specified bit to the given (non-NULL) device
+ * optionally send this bit to the tester
+ * bit is specified as a character: '0' or '1'
+ *
+ * return:
+ *  0: ok
+ * -1: failure
+ */
+static int
+add_bit (Bus_t *bus_p, DeviceID_t *device_p, uint8_t bit, bool send)
+{
+	/* preconds */
+	if ((bit != '0') && (bit != '1'))
+		return -1;
+
+	if (device_p != NULL) {
+		if (device_p->bitLen < DEVICE_ID_MAX_BITS)
+			device_append_bit(device_p, bit - '0');
+		else {
+			fprintf(stderr, "bitfield full\n");
+			return -1;
+		}
+	}
+	if (send)
+		return bus_send(bus_p, (const char*)&bit, sizeof(bit));
+
+	return 0;
+}
+
+/**
+ * interrogate the testing device over the fifo to find 1 device/serial number
+ * (see the "Example of a ROM Search" section of the datasheet for the DS18B20
+ * for an explanation of the algorithm)
+ *
+ * if a fork is found along the way, push a copy of the current device up to
+ * this point with "the other path" already added onto the work stack
+ *
+ * with a pattern set, a device that can't match comes back with no bits
+ */
+static int
+find_one_device (Bus_t *bus_p, DeviceID_t *device_p)
+{
+	int ret, want;
+	int nodeRetries = 0;
+	unsigned nextDigits;
+	DeviceID_t forkDevice;
+
+	/* preconds */
+	if (device_p == NULL)
+		return -1;
+
+	// check if this is an already-started ID
+	// if it is, twiddle the tester with the current bits up to now so
+	// that all devices are at the correct state before continuing
+	bus_p->forks = 0;
+	ret = walk_to_node(bus_p, device_p);
+	if (ret == BUS_CANCELLED)
+		return ret;
+	if (ret < 0) {
+		fprintf(stderr, "error replaying prefix\n");
+		return -1;
+	}
+	if (ret == 1) {
+		device_truncate(device_p, 0);
+		device_p->done = true;
+		return 0;
+	}
+	// the prefix counts as forked too: whoever pushed it searched the
+	// real side of anything it got wrong
+	bus_p->forks = (device_p->bitLen < DEVICE_ID_MAX_BITS)? ((uint64_t)1 << device_p->bitLen) - 1 : ~(uint64_t)0;
+
+	while (!(device_p->done)) {
+		ret = read_next_pair(bus_p, device_p, &nextDigits, &nodeRetries);
+		if (ret == BUS_CANCELLED)
+			return ret;
+		if (ret < 0) {
+			fprintf(stderr, "error fetching next digits\n");
+			return -1;
+		}
+		if (ret == 2) {
+			++bus_p->stats.missingForks;
+			device_truncate(device_p, 0);
+			device_p->done = true;
+			break;
+		}
+		if (ret == 1) {
+			++bus_p->stats.lostSubtrees;
+			fprintf(stderr, "giving up on the subtree at 0x%"PRIx64" (%zu bits)\n", device_p->value, device_p->bitLen);
+			device_truncate(device_p, 0);
+			device_p->done = true;
+			break;
+		}
+		if (ret == 3) {
+			++bus_p->stats.timedOutNodes;
+			fprintf(stderr, "giving up on the subtree at 0x%"PRIx64" (%zu bits), the bus doesn't answer\n",
+					device_p->value, device_p->bitLen);
+			device_truncate(device_p, 0);
+			device_p->done = true;
+			break;
+		}
+		// where the pattern says which way to go, the other branch
+		// can't hold a match: don't fork it, and give up on this
+		// device if it's the only way on
+		want = pattern_bit(bus_p, device_p->bitLen);
+		if ((want != -1) && (nextDigits != 3)) {
+			if (nextDigits == 0)
+				++bus_p->pattern.skippedSubtrees;
+			else if ((nextDigits == 1) != (want == 0)) {
+				++bus_p->pattern.deadEnds;
+				bus_p->pattern.deadEndBits += device_p->bitLen + 1;
+				device_truncate(device_p, 0);
+				device_p->done = true;
+				break;
+			}
+			ret = add_bit(bus_p, device_p, (uint8_t)('0' + want), true);
+			if (ret != 0)
+				return ret;
+			++bus_p->stats.bitsDiscovered;
+			continue;
+		}
+		if (nextDigits != 3)
+			++bus_p->stats.bitsDiscovered;
+
+		switch (nextDigits) {
+			case 0: // 00
+				// send someone off to do the '1' case
+				forkDevice = *device_p;
+				ret = add_bit(bus_p, &forkDevice, '1', false);
+				if (ret != 0)
+					return ret;
+				ret = push_pending(bus_p, &forkDevice);
+				if (ret != 0)
+					return ret;
+				++bus_p->stats.forks;
+				bus_p->forks |= (uint64_t)1 << device_p->bitLen;
+
+				// we'll do the '0' case here
+				ret = add_bit(bus_p, device_p, '0', true);
+				if (ret != 0)
+					return ret;
+				break;
+
+			case 1: // 01
+				ret = add_bit(bus_p, device_p, '0', true);
+				if (ret != 0)
+					return ret;
+				break;
+
+			case 2: // 10
+				ret = add_bit(bus_p, device_p, '1', true);
+				if (ret != 0)
+					return ret;
+				break;
+
+			case 3: // 11
+				device_p->done = true;
+				break;
+
+			default:
+				fprintf(stderr, "unhandled reply from tester: %c (0x%02x)\n", nextDigits, nextDigits);
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * start a search and walk the bus to the end of the device's known prefix,
+ * making sure the path is still there
+ *
+ * with retries, a path that stays missing is either a pending fork that
+ * wasn't there (it's missing at its last bit, the side the fork added: the
+ * 00 was a misread, or the devices have left) or a subtree that's gone;
+ * either way there's nothing to search. a path that never gets its replies
+ * is given up on the same way, the rest of the bus is still searched
+ *
+ * return:
+ *  0: the bus is at the end of the prefix
+ *  1: the prefix isn't on the bus
+ * -1: failure
+ */
+static int
+walk_to_node (Bus_t *bus_p, const DeviceID_t *device_p)
+{
+	int ret;
+	size_t missing;
+	char replies[2 * DEVICE_ID_MAX_BITS];
+
+	ret = walk_path(bus_p, device_p, replies, &missing);
+	if (ret < 0)
+		return ret;
+	if (ret == 1) {
+		if (bus_p->retries == 0)
+			return -1;
+		++bus_p->stats.timedOutNodes;
+		fprintf(stderr, "giving up on the subtree at 0x%"PRIx64" (%zu bits), the bus doesn't answer\n",
+				device_p->value, device_p->bitLen);
+		return 1;
+	}
+	if (missing == device_p->bitLen)
+		return 0;
+	if (bus_p->retries == 0)
+		return -1;
+
+	if ((missing + 1) == device_p->bitLen)
+		++bus_p->stats.missingForks;
+	else {
+		++bus_p->stats.lostSubtrees;
+		fprintf(stderr, "the subtree at 0x%"PRIx64" (%zu bits) is gone from bit %zu\n",
+				device_p->value, device_p->bitLen, missing);
+	}
+	return 1;
+}
+
+/**
+ * read the pair for the next bit of the device; the bus has to be at the end
+ * of what's known of it
+ *
+ * with retries, a reply that can't be right is read again: a timeout, nobody
+ * answering (11) before the end of an ID of the expected width or somebody
+ * answering after it. to do that the bus is walked back to this bit, which
+ * also checks the path so far: if that's broken the search went wrong
+ * further up (a misread sent it down a branch nobody is on), so the device
+ * is cut back to the first bit nobody has and the search of this node
+ * carries on from there, at most "retries" times per node
+ * if that bit is one this descent forked at, or part of the prefix it
+ * started from (see Bus_t.forks), the fork was a misread
+ * and its other side, searched or pending, is the real one: this side has
+ * nothing to search
+ *
+ * an 11 that's still there after all the retries is believed
+ *
+ * return:
+ *  0: *digitsRet_p holds the pair
+ *  1: the node had to be given up on
+ *  2: this side of a fork was a misread
+ *  3: the pair or the walks back to the node kept timing out, it had to be
+ *     given up on too
+ * -1: failure
+ */
+static int
+read_next_pair (Bus_t *bus_p, DeviceID_t *device_p, unsigned *digitsRet_p, int *nodeRetries_p)
+{
+	int ret, attempt = 0;
+	size_t missing;
+	bool suspect;
+	char replies[2 * DEVICE_ID_MAX_BITS];
+
+	while (1) {
+		ret = get_next_digits(bus_p, digitsRet_p);
+		if (ret < 0)
+			return ret;
+		if (ret == 1)
+			suspect = true;
+		else if (*digitsRet_p == 3)
+			suspect = (device_p->bitLen < bus_p->expectBits);
+		else
+			suspect = (device_p->bitLen >= (bus_p->expectBits? bus_p->expectBits : DEVICE_ID_MAX_BITS));
+		if (!suspect)
+			return 0;
+		if (bus_p->retries == 0)
+			return (ret == 0)? 0 : -1;
+		if (attempt == bus_p->retries)
+			return (ret == 0)? 0 : 3;
+		++attempt;
+		++bus_p->stats.bitRetries;
+
+		++bus_p->recovering;
+		while (1) {
+			ret = walk_path(bus_p, device_p, replies, &missing);
+			if (ret == 1)
+				ret = 3;
+			if ((ret != 0) || (missing == device_p->bitLen))
+				break;
+			if (bus_p->forks & ((uint64_t)1 << missing)) {
+				ret = 2;
+				break;
+			}
+			if (*nodeRetries_p == bus_p->retries) {
+				ret = 1;
+				break;
+			}
+			++(*nodeRetries_p);
+			++bus_p->stats.nodeRetries;
+			device_truncate(device_p, missing);
+			attempt = 0;
+		}
+		--bus_p->recovering;
+		if (ret != 0)
+			return ret;
+	}
+}
+
+/**
+ * send_path(), tried again (up to "retries" times) if the replies time out
+ * or don't show the whole path; a transient fault won't do the same thing
+ * twice
+ *
+ * the tries after the first go one bit at a time (see step_path()), so a
+ * lost reply costs that one bit instead of the whole walk
+ *
+ * return:
+ *  0: *missingOut_p holds the first bit of the path nobody has, from the last
+ *     walk that got its replies (the length of the path if it's all there,
+ *     and then replies_p holds that walk's replies, "??" for a lost pair)
+ *  1: it timed out every time (the first walk, if there are no retries)
+ * -1: failure
+ */
+static int
+walk_path (Bus_t *bus_p, const DeviceID_t *device_p, char *replies_p, size_t *missingOut_p)
+{
+	int ret, attempt;
+	size_t missing = 0;
+	bool answered = false;
+
+	for (attempt=0; ; ++attempt) {
+		if (attempt > 0) {
+			++bus_p->stats.pathRetries;
+			++bus_p->recovering;
+			ret = step_path(bus_p, device_p, replies_p, &missing);
+			--bus_p->recovering;
+		}
+		else {
+			ret = send_path(bus_p, device_p, replies_p);
+			if (ret == 0)
+				missing = path_missing_bit(device_p, replies_p);
+		}
+		if (ret < 0)
+			return ret;
+		if (ret == 0) {
+			answered = true;
+			*missingOut_p = missing;
+			if (missing == device_p->bitLen)
+				return 0;
+		}
+		if (attempt >= bus_p->retries)
+			return answered? 0 : 1;
+	}
+}
+
+/**
+ * walk the path again, reading each pair on its own: a pair that doesn't
+ * come back (or isn't two bits) is read again as part of the next one, since
+ * whoever answers that one has every bit before it too; the walk carries on
+ * down the path it already knows
+ *
+ * the walk stops at the first bit nobody has, or before it if the pairs just
+ * before that one were lost (the devices could have gone at any of them)
+ *
+ * the replies go to replies_p like send_path()'s, a lost pair as "??"
+ *
+ * return:
+ *  0: *missingOut_p holds the first bit of the path nobody has (the length of
+ *     the path if it's all there)
+ *  1: the pairs at the end of the path were lost, there's no telling
+ * -1: failure
+ */
+static int
+step_path (Bus_t *bus_p, const DeviceID_t *device_p, char *replies_p, size_t *missingOut_p)
+{
+	size_t i, lost = SIZE_MAX;
+	int ret;
+	char *pair_p;
+	char sendBuf[2];
+
+	/* preconds */
+	if ((device_p == NULL) || (replies_p == NULL) || (missingOut_p == NULL))
+		return -1;
+	if (device_p->bitLen > DEVICE_ID_MAX_BITS)
+		return -1;
+
+	sendBuf[0] = reset_cmd(bus_p);
+	sendBuf[1] = search_cmd(bus_p);
+	ret = bus_send(bus_p, sendBuf, 2);
+	if (ret != 0)
+		return ret;
+
+	for (i=0; i<device_p->bitLen; ++i) {
+		ret = bus_send(bus_p, "rr", 2);
+		if (ret != 0)
+			return ret;
+		pair_p = &replies_p[2*i];
+		ret = bus_recv_all(bus_p, pair_p, 2);
+		if (ret < 0)
+			return -1;
+		++bus_p->stats.readPairs;
+		++bus_p->stats.bitsReplayed;
+		if ((ret == 0) && (((pair_p[0] != '0') && (pair_p[0] != '1')) || ((pair_p[1] != '0') && (pair_p[1] != '1')))) {
+			++bus_p->stats.badReplies;
+			ret = 1;
+		}
+		if (ret == 1) {
+			pair_p[0] = pair_p[1] = '?';
+			++bus_p->stats.bitRetries;
+			if (lost == SIZE_MAX)
+				lost = i;
+		}
+		else if (pair_p[device_bit(device_p, i)] != '0') {
+			*missingOut_p = (lost != SIZE_MAX)? lost : i;
+			return 0;
+		}
+		else
+			lost = SIZE_MAX;
+
+		ret = add_bit(bus_p, NULL, (uint8_t)('0' + device_bit(device_p, i)), true);
+		if (ret != 0)
+			return ret;
+	}
+
+	if (lost != SIZE_MAX)
+		return 1;
+	*missingOut_p = device_p->bitLen;
+	return 0;
+}
+
+/**
+ * find the next device with the last-discrepancy search
+ * (see Maxim application note 187)
+ *
+ * every pass starts from the reset and follows the previous ROM up to the
+ * last discrepancy, takes the '1' branch there and the '0' branch at every
+ * new discrepancy after it
+ *
+ * with pipelining enabled the part that follows the previous ROM is sent in
+ * one burst; its replies still show where the other discrepancies are
+ *
+ * return:
+ *  1: state_p->rom holds the next device
+ *  0: no more devices
+ * -1: failure
+ */
+static int
+ld_search_next (Bus_t *bus_p, LdState_t *state_p)
+{
+	int ret;
+	char sendCh;
+	size_t n, start, lastZero;
+	unsigned nextDigits;
+	int dir;
+	char replies[2 * DEVICE_ID_MAX_BITS];
+
+	/* preconds */
+	if (state_p == NULL)
+		return -1;
+
+	if (state_p->lastDevice)
+		return 0;
+
+	lastZero = 0;
+	if (bus_p->pipelineReplay && (state_p->lastDiscrepancy > 1)) {
+		device_truncate(&state_p->rom, state_p->lastDiscrepancy - 1);
+		ret = replay_prefix(bus_p, &state_p->rom, replies);
+		if (ret != 0)
+			return ret;
+		for (n=1; n<state_p->lastDiscrepancy; ++n)
+			if ((replies[2*(n-1)] == '0') && (replies[(2*(n-1))+1] == '0') && (device_bit(&state_p->rom, n-1) == 0))
+				lastZero = n;
+		start = state_p->lastDiscrepancy;
+	}
+	else {
+		sendCh = reset_cmd(bus_p);
+		ret = bus_send(bus_p, &sendCh, 1);
+		if (ret != 0)
+			return ret;
+		sendCh = search_cmd(bus_p);
+		ret = bus_send(bus_p, &sendCh, 1);
+		if (ret != 0)
+			return ret;
+		start = 1;
+	}
+
+	for (n=start; ; ++n) {
+		ret = get_next_digits(bus_p, &nextDigits);
+		if (ret == BUS_CANCELLED)
+			return ret;
+		if (ret != 0) {
+			fprintf(stderr, "error fetching next digits\n");
+			return -1;
+		}
+
+		switch (nextDigits) {
+			case 0: // 00
+				if (n < state_p->lastDiscrepancy)
+					dir = device_bit(&state_p->rom, n-1);
+				else if (n == state_p->lastDiscrepancy)
+					dir = 1;
+				else
+					dir = 0;
+				if (dir == 0)
+					lastZero = n;
+				if (n > state_p->lastDiscrepancy)
+					++bus_p->stats.forks;
+				break;
+
+			case 1: // 01
+				dir = 0;
+				break;
+
+			case 2: // 10
+				dir = 1;
+				break;
+
+			case 3: // 11
+				// nobody answered at all: the bus is empty
+				if (n == 1) {
+					state_p->lastDevice = true;
+					return 0;
+				}
+				device_truncate(&state_p->rom, n - 1);
+				state_p->lastDiscrepancy = lastZero;
+				if (lastZero == 0)
+					state_p->lastDevice = true;
+				return 1;
+
+			default:
+				fprintf(stderr, "unhandled reply from tester: %c (0x%02x)\n", nextDigits, nextDigits);
+				return -1;
+		}
+
+		if (n > DEVICE_ID_MAX_BITS) {
+			fprintf(stderr, "bitfield full\n");
+			return -1;
+		}
+		if (n < state_p->lastDiscrepancy)
+			++bus_p->stats.bitsReplayed;
+		else
+			++bus_p->stats.bitsDiscovered;
+		state_p->rom.value &= ~((uint64_t)1 << (n-1));
+		state_p->rom.value |= (uint64_t)dir << (n-1);
+		ret = add_bit(bus_p, NULL, (uint8_t)('0' + dir), true);
+		if (ret != 0)
+			return ret;
+	}
+}
+
+/**
+ * start a search and walk the tester down the given path, collecting the
+ * replies to the 2 reads of every bit on the way
+ *
+ * when pipelining, the reset, the search command, and every read pair plus
+ * its direction bit are sent to the tester in one burst and the replies are
+ * then drained in bulk, otherwise each bit is done in lock-step
+ *
+ * the tester follows whatever path it's given, so it's up to the caller to
+ * check (see path_present()) whether the replies say anyone is really there
+ *
+ * return:
+ *  0: ok
+ *  1: the replies timed out
+ * -1: failure
+ */
+static int
+send_path (Bus_t *bus_p, const DeviceID_t *device_p, char *replies_p)
+{
+	size_t i, pos;
+	int ret;
+	unsigned nextDigits;
+	char sendBuf[2 + (3 * DEVICE_ID_MAX_BITS)];
+
+	/* preconds */
+	if ((device_p == NULL) || (replies_p == NULL))
+		return -1;
+	if (device_p->bitLen > DEVICE_ID_MAX_BITS)
+		return -1;
+
+	if (!bus_p->pipelineReplay) {
+		sendBuf[0] = reset_cmd(bus_p);
+		sendBuf[1] = search_cmd(bus_p);
+		ret = bus_send(bus_p, sendBuf, 2);
+		if (ret != 0)
+			return ret;
+		for (i=0; i<device_p->bitLen; ++i) {
+			ret = get_next_digits(bus_p, &nextDigits);
+			if (ret != 0)
+				return ret;
+			replies_p[2*i] = (nextDigits & 2)? '1' : '0';
+			replies_p[(2*i) + 1] = (nextDigits & 1)? '1' : '0';
+			ret = add_bit(bus_p, NULL, (uint8_t)('0' + device_bit(device_p, i)), true);
+			if (ret != 0)
+				return ret;
+		}
+		bus_p->stats.bitsReplayed += device_p->bitLen;
+		return 0;
+	}
+
+	pos = 0;
+	sendBuf[pos++] = reset_cmd(bus_p);
+	sendBuf[pos++] = search_cmd(bus_p);
+	for (i=0; i<device_p->bitLen; ++i) {
+		sendBuf[pos++] = 'r';
+		sendBuf[pos++] = 'r';
+		sendBuf[pos++] = (char)('0' + device_bit(device_p, i));
+	}
+	ret = bus_send(bus_p, sendBuf, pos);
+	if (ret != 0)
+		return ret;
+	if (device_p->bitLen == 0)
+		return 0;
+
+	ret = bus_recv_all(bus_p, replies_p, 2 * device_p->bitLen);
+	if (ret != 0)
+		return ret;
+	bus_p->stats.readPairs += device_p->bitLen;
+	bus_p->stats.bitsReplayed += device_p->bitLen;
+
+	bus_p->roundTripsSaved += (2 * device_p->bitLen) - 1;
+	return 0;
+}
+
+/**
+ * check the replies from send_path(bus_p): every bit on the path has to be one
+ * some device on the bus still has
+ * i.e. bit '0' needs the true read to be 0, bit '1' needs the complement read
+ * to be 0
+ */
+static bool
+path_present (const DeviceID_t *device_p, const char *replies_p)
+{
+	/* preconds */
+	if ((device_p == NULL) || (replies_p == NULL))
+		return false;
+
+	return path_missing_bit(device_p, replies_p) == device_p->bitLen;
+}
+
+/**
+ * the first bit on the path (see path_present()) that no device has,
+ * device_p->bitLen if there isn't one
+ */
+static size_t
+path_missing_bit (const DeviceID_t *device_p, const char *replies_p)
+{
+	size_t i;
+	char trueRd, complRd;
+
+	for (i=0; i<device_p->bitLen; ++i) {
+		trueRd = replies_p[2*i];
+		complRd = replies_p[(2*i) + 1];
+
+		if (((trueRd != '0') && (trueRd != '1')) || ((complRd != '0') && (complRd != '1')))
+			break;
+		if ((device_bit(device_p, i) == 0) && (trueRd != '0'))
+			break;
+		if ((device_bit(device_p, i) == 1) && (complRd != '0'))
+			break;
+	}
+
+	return i;
+}
+
+/**
+ * start a search and bring the tester up to the end of the device's known
+ * prefix without waiting on each bit
+ *
+ * the replies to the replayed reads carry no new information (we already know
+ * which way we're going) but they are checked to make sure the path still
+ * exists on the bus
+ *
+ * doing this in lock-step costs 2 round trips per replayed bit, this costs 1
+ * for the whole prefix
+ *
+ * if repliesOut_p is given, the read replies (2 per bit) are copied there
+ */
+static int
+replay_prefix (Bus_t *bus_p, DeviceID_t *device_p, char *repliesOut_p)
+{
+	int ret;
+	char recvBuf[2 * DEVICE_ID_MAX_BITS];
+
+	/* preconds */
+	if (device_p == NULL)
+		return -1;
+
+	ret = send_path(bus_p, device_p, recvBuf);
+	if (ret != 0)
+		return (ret < 0)? ret : -1;
+	if (!path_present(device_p, recvBuf))
+		return -1;
+
+	if (repliesOut_p != NULL)
+		memcpy(repliesOut_p, recvBuf, 2 * device_p->bitLen);
+	return 0;
+}
+
+/**
+ * the reset that keeps the bus at the speed it's running at
+ */
+static char
+reset_cmd (const Bus_t *bus_p)
+{
+	return bus_p->overdrive? 'D' : 'R';
+}
+
+/**
+ * the bit the pattern wants at <pos>, -1 if it doesn't care
+ */
+static int
+pattern_bit (const Bus_t *bus_p, size_t pos)
+{
+	if ((pos >= DEVICE_ID_MAX_BITS) || !((bus_p->pattern.mask >> pos) & 1))
+		return -1;
+	return (int)((bus_p->pattern.value >> pos) & 1);
+}
+
+/**
+ * a lower bound on what the pattern saved: every skipped subtree holds at
+ * least one device, which would have cost a reset, a search command and a
+ * full ID's worth of read pairs and direction bits; every dead end would at
+ * least have been followed to the end of its ID
+ */
+void
+bus_pattern_avoided (const Bus_t *bus_p, BusSlots_t *avoided_p)
+{
+	uint64_t idBits, bitSteps;
+
+	/* preconds */
+	if ((bus_p == NULL) || (avoided_p == NULL))
+		return;
+
+	memset(avoided_p, 0, sizeof(*avoided_p));
+	idBits = bus_p->idBits;
+	if (idBits == 0)
+		idBits = (uint64_t)(64 - __builtin_clzll(bus_p->pattern.mask | 1));
+
+	bitSteps = bus_p->pattern.skippedSubtrees * idBits;
+	if (bus_p->pattern.deadEnds * idBits > bus_p->pattern.deadEndBits)
+		bitSteps += (bus_p->pattern.deadEnds * idBits) - bus_p->pattern.deadEndBits;
+
+	avoided_p->resets[BUS_STANDARD] = bus_p->pattern.skippedSubtrees;
+	busslots_add_byte(avoided_p, ROM_CMD_SEARCH);
+	avoided_p->write0Slots[BUS_STANDARD] *= bus_p->pattern.skippedSubtrees;
+	avoided_p->write1Slots[BUS_STANDARD] *= bus_p->pattern.skippedSubtrees;
+	avoided_p->readSlots[BUS_STANDARD] = 2 * bitSteps;
+	avoided_p->write0Slots[BUS_STANDARD] += bitSteps;
+}
+
+static char
+search_cmd (const Bus_t *bus_p)
+{
+	return bus_p->alarmOnly? 'A' : 'S';
+}
+
+/**
+ * one read pair on its own (for timing the framing)
+ */
+int
+bus_next_digits (Bus_t *bus_p, unsigned *digitsRet_p)
+{
+	/* preconds */
+	if (bus_p == NULL)
+		return -1;
+
+	return get_next_digits(bus_p, digitsRet_p);
+}
+
+/**
+ * perform 2 "reads" on the "device" (i.e. send two 'r' commands down the
+ * fifo) to obtain the all the current bits of all devices and the complement
+ * of all the current bits of all devices
+ *
+ * the first received bit is the MSB
+ *
+ * the return value indicates error:
+ * 0  → okay
+ * 1  → the reply timed out or was neither '0' nor '1' (a fault, like a bad
+ *      pair: whatever else is on its way is thrown away)
+ * -1 → error
+ *
+ * the digitsRet_p is set to the value from the tester:
+ * 0b00
+ * 0b01
+ * 0b10
+ * 0b11
+ */
+static int
+get_next_digits (Bus_t *bus_p, unsigned *digitsRet_p)
+{
+	int i, ret;
+	char sendCh, recvCh;
+
+	/* preconds */
+	if (digitsRet_p == NULL)
+		return -1;
+
+	*digitsRet_p = 0;
+	++bus_p->stats.readPairs;
+	for (i=1; i>-1; --i) {
+		// send 'r'
+		sendCh = 'r';
+		ret = bus_send(bus_p, &sendCh, 1);
+		if (ret != 0)
+			return ret;
+
+		ret = bus_recv_all(bus_p, &recvCh, sizeof(recvCh));
+		if (ret != 0)
+			return ret;
+		switch (recvCh) {
+			case '0':
+				break;
+			case '1':
+				*digitsRet_p += (unsigned)(1 << i);
+				break;
+			default:
+				++bus_p->stats.badReplies;
+				transport_drain(&bus_p->transport);
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+count_ops (BusOps_t *ops_p, const char *buf_p, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; ++i) {
+		switch (buf_p[i]) {
+			case 'R':
+			case 'D':
+				++ops_p->resets;
+				break;
+			case 'S':
+			case 'A':
+				++ops_p->searches;
+				break;
+			case 'r':
+				++ops_p->reads;
+				break;
+			case '0':
+			case '1':
+				++ops_p->writes;
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+/**
+ * send commands to the tester, keeping count of the bus operations
+ * they represent (and, while recovering, of what recovery costs)
+ * returns BUS_CANCELLED, without sending, once the bus has been cancelled
+ */
+static int
+bus_send (Bus_t *bus_p, const char *buf_p, size_t len)
+{
+	size_t i;
+
+	/* preconds */
+	if (buf_p == NULL)
+		return -1;
+
+	if (atomic_load_explicit(&bus_p->cancel, memory_order_relaxed))
+		return BUS_CANCELLED;
+	for (i=0; i<len; ++i)
+		busslots_add_cmd(&bus_p->slots, buf_p[i]);
+	count_ops(&bus_p->ops, buf_p, len);
+	if (bus_p->recovering > 0)
+		count_ops(&bus_p->stats.recoveryOps, buf_p, len);
+
+	return (transport_send(&bus_p->transport, buf_p, len) == 0)? 0 : -1;
+}
+
+/**
+ * receive replies from the tester, timing the wait if asked to
+ * after a timeout whatever is still on its way is thrown away, so what
+ * comes next is the reply to the next command sent
+ *
+ * return:
+ *  0: ok
+ *  1: timed out
+ * -1: failure
+ */
+static int
+bus_recv_all (Bus_t *bus_p, char *buf_p, size_t len)
+{
+	int ret;
+	uint64_t start = 0;
+
+	if (bus_p->timeWaits)
+		start = monotonic_ns();
+	ret = transport_recv_all(&bus_p->transport, buf_p, len);
+	if (bus_p->timeWaits)
+		log2hist_add(&bus_p->stats.recvWait, monotonic_ns() - start);
+	if (ret == 1) {
+		++bus_p->stats.timeouts;
+		transport_drain(&bus_p->transport);
+	}
+	return ret;
+}
+
+/**
+ * what it took to find this device: everything since the last one
+ */
+static void
+note_device_stats (Bus_t *bus_p, const DeviceID_t *device_p)
+{
+	size_t newMax;
+	BusDeviceStats_t *newStats_p, *entry_p, *mark_p;
+
+	if (bus_p->numDevStats == bus_p->maxDevStats) {
+		newMax = (bus_p->maxDevStats == 0)? 64 : (2 * bus_p->maxDevStats);
+		newStats_p = (BusDeviceStats_t*)realloc(bus_p->devStats_p, newMax * sizeof(BusDeviceStats_t));
+		if (newStats_p == NULL) {
+			perror("realloc");
+			return;
+		}
+		bus_p->devStats_p = newStats_p;
+		bus_p->maxDevStats = newMax;
+	}
+
+	mark_p = &bus_p->devStatsMark;
+	entry_p = &bus_p->devStats_p[bus_p->numDevStats++];
+	entry_p->device = *device_p;
+	entry_p->ops.resets = bus_p->ops.resets - mark_p->ops.resets;
+	entry_p->ops.searches = bus_p->ops.searches - mark_p->ops.searches;
+	entry_p->ops.reads = bus_p->ops.reads - mark_p->ops.reads;
+	entry_p->ops.writes = bus_p->ops.writes - mark_p->ops.writes;
+	entry_p->bitsReplayed = bus_p->stats.bitsReplayed - mark_p->bitsReplayed;
+	entry_p->bitsDiscovered = bus_p->stats.bitsDiscovered - mark_p->bitsDiscovered;
+	entry_p->waitNs = bus_p->stats.recvWait.sum - mark_p->waitNs;
+
+	mark_p->ops = bus_p->ops;
+	mark_p->bitsReplayed = bus_p->stats.bitsReplayed;
+	mark_p->bitsDiscovered = bus_p->stats.bitsDiscovered;
+	mark_p->waitNs = bus_p->stats.recvWait.sum;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#ifndef ROM_SEARCH_SEARCH__H
+#define ROM_SEARCH_SEARCH__H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "common.h"
+#include "transport.h"
+#include "workpool.h"
+#include "bustime.h"
+#include "output.h"
+
+// how many times one search will go back over a subtree after a bad CRC8
+#define BUS_CRC_RESEARCH_MAX 64
+// how many times a read or a walk is tried again before giving up on it
+#define BUS_DEFAULT_RETRIES 3
+
+// what the search returns when the bus' cancel flag stopped it
+#define BUS_CANCELLED (-2)
+
+typedef enum {
+	ENGINE_FORK,
+	ENGINE_LD,
+} SearchEngine_e;
+
+// only look for IDs that match value in the bits set in mask
+// and what that saved
+typedef struct {
+	uint64_t value;
+	uint64_t mask;
+
+	uint64_t skippedSubtrees;
+	uint64_t deadEnds;
+	uint64_t deadEndBits;
+} BusPattern_t;
+
+// bus operations issued, by kind
+typedef struct {
+	uint64_t resets;
+	uint64_t searches;
+	uint64_t reads;
+	uint64_t writes;
+} BusOps_t;
+
+// where the work and the waiting went
+typedef struct {
+	// read pairs (a bit and its complement)
+	uint64_t readPairs;
+	// bits walked again to get back to a known point, and bits learned
+	uint64_t bitsReplayed;
+	uint64_t bitsDiscovered;
+	uint64_t forks;
+	// with crcCheck: devices that failed the CRC8 check, how many of those
+	// had the subtree from their first missing bit searched again, and how
+	// many were given up on
+	uint64_t crcFailures;
+	uint64_t crcResearches;
+	uint64_t crcRejected;
+	// recovery (see Bus_t.retries): replies that never came, nodes given
+	// up on because the walks back to them never got theirs, replies that
+	// were neither '0' nor '1', bits read again, nodes searched again from
+	// a bit further up, walks to a known point done again, pending forks
+	// that weren't there and subtrees given up on, and the bus operations
+	// all of that took
+	uint64_t timeouts;
+	uint64_t timedOutNodes;
+	uint64_t badReplies;
+	uint64_t bitRetries;
+	uint64_t nodeRetries;
+	uint64_t pathRetries;
+	uint64_t missingForks;
+	uint64_t lostSubtrees;
+	BusOps_t recoveryOps;
+	// time spent blocked on replies (ns), only if the bus is timing waits
+	Log2Hist_t recvWait;
+} BusStats_t;
+
+// what finding one device took (the difference from the one before)
+typedef struct {
+	DeviceID_t device;
+	BusOps_t ops;
+	uint64_t bitsReplayed;
+	uint64_t bitsDiscovered;
+	uint64_t waitNs;
+} BusDeviceStats_t;
+
+// the devices a delta search starts from, in search order (key is the
+// bit-reversed value); present and forks are filled in as it goes
+typedef struct {
+	DeviceID_t device;
+	uint64_t key;
+	bool present;
+	uint64_t forks;
+} CacheEntry_t;
+typedef struct {
+	CacheEntry_t *entries_p;
+	size_t count;
+	size_t max;
+} DeviceList_t;
+
+/**
+ * everything needed to search one bus
+ * one of these per bus, so several buses can be searched concurrently
+ */
+typedef struct {
+	// -1 for the one, unnumbered, bus
+	int busNum;
+	Transport_t transport;
+
+	// settings
+	SearchEngine_e engine;
+	bool pipelineReplay;
+	// switch every device to overdrive speed before searching
+	bool overdrive;
+	// conditional search: only the devices with their alarm flag set
+	bool alarmOnly;
+	// fork engine only
+	BusPattern_t pattern;
+	// delta search (fork engine only): start from the devices found last
+	// time, from this file and/or (keepInventory) from the last search
+	// on this bus, and only report the ones that come (and go) if
+	// changesOnly
+	const char *cacheFile_p;
+	bool keepInventory;
+	bool changesOnly;
+	// if set, this is one of several connections to the same devices and
+	// the pending forks are shared through the pool (fork engine only)
+	WorkPool_t *pool_p;
+	int poolSlot;
+	// where the devices found go (not owned, shared by the buses), NULL
+	// for nowhere
+	Output_t *output_p;
+	// keep the devices found in results_p instead of writing them out
+	bool collect;
+	// called with every device the moment it's found, before it's written
+	// out or kept; a non-zero return cancels the search
+	int (*onDevice_p) (void *ctx_p, OutputTag_e tag, const DeviceID_t *device_p);
+	void *onDeviceCtx_p;
+	// time every wait for replies (into stats.recvWait)
+	bool timeWaits;
+	// keep a BusDeviceStats_t for every device found
+	bool deviceStats;
+	// only report 64-bit IDs with a good CRC8 (fork engine only)
+	bool crcCheck;
+	// recovery from bad replies (fork engine only): how many times to try
+	// again at each step (0: fail the search on the first one, as ever),
+	// and the ID width, if known (a device that stops answering before
+	// then is a bad reply), 0 if not
+	int retries;
+	size_t expectBits;
+
+	// state
+	WorkStack_t workStack;
+	// > 0 while recovering: the bus ops also count as recovery
+	int recovering;
+	// the bits the last device found forked at (its prefix included), see
+	// find_one_device()
+	uint64_t forks;
+	DeviceList_t inventory;
+	bool haveInventory;
+	// set from anywhere (another thread, a signal handler) to stop the
+	// search before its next bus operation, bus_search() then fails
+	atomic_bool cancel;
+
+	// results
+	BusOps_t ops;
+	// the same, as 1-Wire resets and time slots
+	BusSlots_t slots;
+	uint64_t roundTripsSaved;
+	size_t peakPending;
+	uint64_t devicesFound;
+	// length of the longest ID found
+	size_t idBits;
+	uint64_t steals;
+	DeviceID_t *results_p;
+	size_t numResults;
+	size_t maxResults;
+	BusStats_t stats;
+	BusDeviceStats_t *devStats_p;
+	size_t numDevStats;
+	size_t maxDevStats;
+	// the totals as they were when the last device was found
+	BusDeviceStats_t devStatsMark;
+	// what the last delta search saw
+	size_t deltaConfirmed;
+	size_t deltaAdded;
+	size_t deltaRemoved;
+} Bus_t;
+
+void bus_init (Bus_t *bus_p, int busNum);
+void bus_free (Bus_t *bus_p);
+int bus_search (Bus_t *bus_p);
+int bus_next_digits (Bus_t *bus_p, unsigned *digitsRet_p);
+void bus_pattern_avoided (const Bus_t *bus_p, BusSlots_t *avoided_p);
+
+#endif
@@ -17,21 +17,30 @@
 #include <string.h>
 #include <signal.h>
 #include <setjmp.h>
+#include <limits.h>
+#include <sys/epoll.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include "common.h"
+#include "transport.h"
+#include "devset.h"
+#include "bussim.h"
+#include "generate.h"
+#include "crc8.h"
+#include "trace.h"
 #include "config.h"
 
-typedef enum {
-	ROMsearch,
-	ROMnone,
-} RomFunction_e;
-typedef struct {
-	uint64_t deviceID;
-	bool inSearch;
-} Devices_t;
-static Devices_t *devices_pG;
+static int alarmPercent_G = 0;
+// keeps the alarm picks apart from the population drawn from the same seed
+#define ALARM_SEED_SALT 0x616c61726d73llu
+static uint64_t seed_G;
+static GenDistribution_e distribution_G = GEN_UNIFORM;
+static bool crc_G = false;
+static const char *traceFile_pG = NULL;
+static uint64_t traceEvents_G = TRACE_DEFAULT_EVENTS;
+static Trace_t trace_G;
+static BusSim_t sim_G;
 static int numEntries_G;
 static bool verbose_G = false;
 #define DEFAULT_BIT_SIZE 8
@@ -39,181 +48,192 @@ static int bitSize_G = DEFAULT_BIT_SIZE;
 #define DEFAULT_MAX_ENTRIES 8;
 static int maxEntries_G = DEFAULT_MAX_ENTRIES;
 static jmp_buf env_G;
-static RomFunction_e function_G = ROMnone;
+static TransportType_e transportType_G = TRANSPORT_FIFO;
+static bool busyPoll_G = false;
+static int busNum_G = -1;
+static int numBuses_G = 0;
+static const char *dataFile_pG = NULL;
+static BusSimFaults_t faults_G;
+
+// one of the buses served by a multi-bus tester (-N)
+typedef struct {
+	BusSim_t sim;
+	Transport_t transport;
+	Trace_t trace;
+	bool open;
+} VirtualBus_t;
 
 static int process_cmdline_args (int argc, char *argv[]);
 static void setup_signal_handler (void);
+static int setup_bus (BusSim_t *sim_p, const char *fileName_p, uint64_t seed);
+static int serve_buses (void);
+static void print_injected (const BusSim_t *sim_p);
+static void print_devices (const BusSim_t *sim_p);
+static void verbose_hook (BusSim_t *sim_p, char cmd, int reply);
 
 int
 main (int argc, char *argv[])
 {
-	int i;
 	int ret;
-	int toTesterFifoFd;
-	int fmTesterFifoFd;
-	struct pollfd pollFd[1];
+	Transport_t transport;
 	ssize_t retRead;
 	volatile bool runLoop;
-	char readBuf;
-	volatile int bitPos;
-	volatile int readState;
-	int ANDbit;
-	char writeBuf;
-	volatile bool firstRun;
-	uint64_t currentBit;
+	char rxBuf[256];
+	char txBuf[256];
+	size_t len, txLen;
+	const char *quit_p;
+	BusSpeed_e speed;
 
 	ret = process_cmdline_args(argc, argv);
 	if (ret != 0)
 		return 1;
-	printf("devices: %d\n", numEntries_G);
-	printf("bitsize: %d", bitSize_G);
+	if (numBuses_G != 0)
+		return (serve_buses() == 0)? 0 : 1;
 
-	ret = open_fifo(toTesterFifoName_p, &toTesterFifoFd);
-	if (ret != 0) {
-		perror("mkfifo to tester");
-		goto fifoFail;
-	}
-	ret = open_fifo(fmTesterFifoName_p, &fmTesterFifoFd);
-	if (ret != 0) {
-		perror("mkfifo fm tester");
-		goto closeToFifo;
+	ret = setup_bus(&sim_G, dataFile_pG, seed_G);
+	if (ret != 0)
+		return 1;
+	numEntries_G = (int)sim_G.devices.count;
+	bitSize_G = sim_G.devices.bitSize;
+	if (traceFile_pG != NULL) {
+		ret = trace_open(&trace_G, traceFile_pG, traceEvents_G, bitSize_G);
+		if (ret != 0)
+			goto transportFail;
+		sim_G.trace_p = &trace_G;
 	}
+	printf("seed: %"PRIu64"\n", seed_G);
+	printf("devices: %d\n", numEntries_G);
+	printf("alarmed: %zu\n", sim_G.alarmDevices.count);
+	printf("bitsize: %d", bitSize_G);
 
-	pollFd[0].fd = toTesterFifoFd;
-	pollFd[0].events = POLLIN;
+	ret = transport_open(&transport, transportType_G, TRANSPORT_TESTER, busyPoll_G, busNum_G);
+	if (ret != 0)
+		goto transportFail;
 
-	bitPos = 0;
-	readState = 0;
-	firstRun = true;
 	runLoop = true;
+	print_devices(&sim_G);
+	sim_G.hook_p = verbose_hook;
 
 	setup_signal_handler();
 	if (setjmp(env_G) != 0)
 		runLoop = false;
 
+	// the commands are run a whole read at a time, and the replies to them
+	// sent back together
 	while (runLoop) {
-		if (verbose_G || firstRun) {
-			firstRun = false;
-			printf("\n");
-			for (i=0; i<numEntries_G; ++i) {
-				if (devices_pG[i].inSearch) {
-					printf("devices_pG[%02d] = %0*"PRIu64" (0b", i, dwidth(bitSize_G), devices_pG[i].deviceID);
-					print_bits(devices_pG[i].deviceID, bitSize_G-1, bitSize_G);
-					printf(")  current bit pos:%02d → ", bitPos);
-					print_bits(devices_pG[i].deviceID, bitPos, 1);
-					printf("\n");
-				}
-			}
-		}
-
-		ret = poll(pollFd, 1, -1);
-		if ((ret != 1) || (pollFd[0].revents != POLLIN))
-			continue;
-
-		retRead = read(pollFd[0].fd, &readBuf, sizeof(readBuf));
+		retRead = transport_recv(&transport, rxBuf, sizeof(rxBuf));
 		if (retRead == -1) {
-			perror("read fifo");
+			perror("read transport");
 			goto allocFail;
 		}
-		if (retRead == 0) {
+		if (retRead == 0)
+			break;
+		len = (size_t)retRead;
+		quit_p = (const char*)memchr(rxBuf, 'Q', len);
+		if (quit_p != NULL) {
+			len = (size_t)(quit_p - rxBuf);
 			runLoop = false;
-			continue;
 		}
-		if (verbose_G)
-			printf("fifo: 0x%02x (%c) cnt:%zd bitPos:%d\n", readBuf, readBuf, retRead, bitPos);
 
-		switch (readBuf) {
-			case 'Q': // quit
-				runLoop = false;
-				break;
+		txLen = bussim_process(&sim_G, rxBuf, len, txBuf);
+		if (txLen > 0)
+			transport_send(&transport, txBuf, txLen);
+	}
 
-			case 'R': // reset
-				function_G = ROMnone;
-				readState = 0;
-				bitPos = 0;
-				for (i=0; i<numEntries_G; ++i)
-					devices_pG[i].inSearch = true;
-				break;
+	// what this run would have cost on a real wire
+	printf("\nbus: %"PRIu64" reset(s) %"PRIu64" read slot(s) %"PRIu64" write slot(s)\n",
+			busslots_resets(&sim_G.slots), busslots_reads(&sim_G.slots),
+			busslots_writes(&sim_G.slots));
+	printf("bus time: %.3f ms", busslots_time_us(&sim_G.slots) / 1000.0);
+	if (sim_G.numOverdrive > 0)
+		printf(" (%zu device(s) in overdrive)", sim_G.numOverdrive);
+	printf("\n");
+	for (speed=BUS_STANDARD; speed<BUS_SPEEDS; ++speed)
+		printf("bus time: all %s %.3f ms\n", bus_speed_name(speed),
+				busslots_time_at_us(&sim_G.slots, speed) / 1000.0);
+	print_injected(&sim_G);
 
-			case 'S': // ROM search function
-				function_G = ROMsearch;
-				break;
+allocFail:
+	transport_close(&transport);
+transportFail:
+	bussim_free(&sim_G);
+	trace_close(&trace_G);
+	return 0;
+}
 
-			case 'V': // verbose
-				verbose_G = !verbose_G;
-				break;
+/**
+ * the devices still listening, and where they are in the ID
+ */
+static void
+print_devices (const BusSim_t *sim_p)
+{
+	size_t idx;
+	const DevSet_t *set_p = sim_p->listening_p;
+
+	printf("\n");
+	for (idx=set_p->lo; idx<set_p->hi; ++idx) {
+		printf("devices[%02zu] = %0*"PRIu64" (0b", idx, dwidth(bitSize_G), set_p->ids_p[idx]);
+		print_bits(set_p->ids_p[idx], bitSize_G-1, bitSize_G);
+		printf(")  current bit pos:%02d → ", set_p->bitPos);
+		print_bits(set_p->ids_p[idx], set_p->bitPos, 1);
+		printf("\n");
+	}
+}
 
-			case 'r': // read
-				if (function_G != ROMsearch)
-					break;
-				if ((readState != 0) && (readState != 1))
-					break;
-
-				if (verbose_G)
-					printf(" readState:%d bitPos:%d\n", readState, bitPos);
-
-				ANDbit = 1; // the default is pull-up
-				for (i=0; i<numEntries_G; ++i) {
-					currentBit = 1;
-					if (devices_pG[i].inSearch) {
-						currentBit = (1llu << bitPos) & devices_pG[i].deviceID;
-						if (readState == 1)
-							currentBit = currentBit? 0 : 1;
-
-						if (verbose_G)
-							printf("  in search [%02d] %cbit:%d\n", i, (readState==0? ' ' : '~'), (currentBit? 1 : 0));
-					}
-					ANDbit &= (currentBit? 1 : 0);
-				}
+/**
+ * 'V' (which the simulator doesn't know) toggles the verbose mode, in which
+ * every command is shown with the devices and what it does to them
+ */
+static void
+verbose_hook (BusSim_t *sim_p, char cmd, int reply)
+{
+	size_t idx;
+	int bit;
+	const DevSet_t *set_p = sim_p->listening_p;
 
-				writeBuf = (char)(ANDbit + '0');
-				if (verbose_G)
-					printf("  <= %c\n", writeBuf);
-				write(fmTesterFifoFd, (void*)&writeBuf, 1);
-				++readState;
-				break;
+	if (reply >= 0) {
+		if (verbose_G)
+			printf("  <= %c\n", (char)('0' + reply));
+		return;
+	}
 
-			case '0':
-			case '1':
-				if (function_G != ROMsearch)
-					break;
-				if (readState != 2)
-					break;
-				if (verbose_G)
-					printf(" readState:%d bitPos:%d\n", readState, bitPos);
-
-				for (i=0; i<numEntries_G; ++i) {
-					if (devices_pG[i].inSearch) {
-						currentBit = (1llu << bitPos) & devices_pG[i].deviceID;
-						if (((readBuf == '0') && currentBit) || ((readBuf == '1') && !currentBit)) {
-							if (verbose_G)
-								printf("   removing: %02d\n", i);
-							devices_pG[i].inSearch = false;
-						}
-					}
+	if (verbose_G) {
+		print_devices(sim_p);
+		printf("transport: 0x%02x (%c) bitPos:%d\n", cmd, cmd, set_p->bitPos);
+	}
+	switch (cmd) {
+		case 'V':
+			verbose_G = !verbose_G;
+			break;
+
+		case 'r':
+			if (verbose_G && (sim_p->function == BUSSIM_SEARCH) && (sim_p->readState < 2)) {
+				printf(" readState:%d bitPos:%d\n", sim_p->readState, set_p->bitPos);
+				for (idx=set_p->lo; idx<set_p->hi; ++idx) {
+					bit = (set_p->ids_p[idx] & (1llu << set_p->bitPos))? 1 : 0;
+					if (sim_p->readState == 1)
+						bit = !bit;
+					printf("  in search [%02zu] %cbit:%d\n", idx, (sim_p->readState==0? ' ' : '~'), bit);
 				}
+			}
+			break;
 
-				++bitPos;
-				if (bitPos >= bitSize_G)
-					for (i=0; i<numEntries_G; ++i)
-						devices_pG[i].inSearch = false;
-				readState = 0;
-				break;
+		case '0':
+		case '1':
+			if (verbose_G && ((sim_p->function == BUSSIM_MATCH) || (sim_p->function == BUSSIM_OD_MATCH) ||
+						((sim_p->function == BUSSIM_SEARCH) && (sim_p->readState == 2)))) {
+				printf(" readState:%d bitPos:%d\n", sim_p->readState, set_p->bitPos);
+				for (idx=set_p->lo; idx<set_p->hi; ++idx) {
+					bit = (set_p->ids_p[idx] & (1llu << set_p->bitPos))? 1 : 0;
+					if (bit != (cmd - '0'))
+						printf("   removing: %02zu\n", idx);
+				}
+			}
+			break;
 
-			default:
-				break;
-		}
+		default:
+			break;
 	}
-
-allocFail:
-	free(devices_pG);
-	close(fmTesterFifoFd);
-	unlink("fmTesterFifoFd");
-closeToFifo:
-	close(toTesterFifoFd);
-	unlink("toTesterFifoFd");
-fifoFail:
-	return 0;
 }
 
 static void
@@ -251,145 +271,284 @@ usage (const char *cmdline_p)
 
 	printf("usage: %s [<options>] [<testfile>]\n", cmdline_p);
 	printf("  where:\n");
-	printf("    <testfile>              a file from which to get serial ID data\n");
+	printf("    <testfile>              a file from which to get serial ID data, text or a\n");
+	printf("                            binary dataset (see ROMdataset)\n");
 	printf("                            (otherwise the data is generated randomly)\n");
 	printf("    <options>\n");
 	printf("      -h|--help             print information about this program and exit successfully\n");
 	printf("      -b|--bitsize <b>      set the number of bits in the serial ID to <b> (MIN:2 default:8 MAX:64)\n");
 	printf("      -m|--max-devices <m>  set the maximum number of devices (MIN:1 default:8)\n");
+	printf("      -t|--transport <t>    talk to ROMsearch over <t>: fifo or shm (default: fifo)\n");
+	printf("      -B|--busy-poll        spin instead of sleeping while waiting on the shm transport\n");
+	printf("      -n|--bus <n>          serve bus <n> of a multi-bus ROMsearch (ROMsearch -N)\n");
+	printf("      -N|--buses <n>        serve all of buses 0..<n>-1 (ROMsearch -N <n>) from this one\n");
+	printf("                            process, over fifos; bus <n> gets <testfile>.<n>, or random\n");
+	printf("                            devices seeded with <s>+<n> (-T traces go to <file>.<n>)\n");
+	printf("      -a|--alarm <p>        set the alarm flag of <p>%% of the devices at random\n");
+	printf("                            (unless the data file flags them: an 'A' after the ID)\n");
+	printf("      -s|--seed <s>         seed the random data and alarms with <s>, the same seed\n");
+	printf("                            always gives the same devices (default: the time)\n");
+	printf("      -g|--distribution <d> how to spread the random IDs: uniform (default), family,\n");
+	printf("                            prefix or allfork (see ROMdataset)\n");
+	printf("      -c|--crc              generate real 1-Wire IDs: 64 bits, the top byte the CRC8\n");
+	printf("                            of the rest\n");
+	printf("      -T|--trace <file>     record every command in a binary trace in <file>, for\n");
+	printf("                            ROMtrace to decode (cheap enough to leave on, unlike 'V')\n");
+	printf("      -E|--trace-events <n> keep the last <n> commands in the trace (default: %u)\n", TRACE_DEFAULT_EVENTS);
+	printf("      -i|--inject <spec>    misbehave: <spec> is a comma separated list of\n");
+	printf("                            <fault>=<ppm> (in a million per read) out of flip (the\n");
+	printf("                            reply is inverted), drop (it's never sent), ones (both\n");
+	printf("                            halves of the pair read 1) and vanish (a device drops\n");
+	printf("                            off until the next reset), and seed=<n> (added to the\n");
+	printf("                            bus' seed); the master needs a timeout (-T) for drop\n");
 }
 
 /**
- * input file format:
- * <number of entries>
- * <number of bits>
- * <unique serial id>… * N
+ * a reproducible population: the number of devices and the devices
+ * themselves come from the seed
  */
 static int
-get_data_from_file (const char *fileName_p)
+use_random_data (BusSim_t *sim_p, uint64_t seed)
 {
-	int i, ret;
-	int fnRtn = -1;
-	FILE *dataFile_p = NULL;
-	char dataBuf[32];
-
-	/* preconds */
-	if (fileName_p == NULL)
+	GenParams_t params;
+	uint64_t *ids_p;
+	uint64_t state;
+
+	generate_defaults(&params);
+	state = seed;
+	params.distribution = distribution_G;
+	params.seed = prng_next(&state);
+	params.count = (size_t)(prng_next(&state) % (uint64_t)maxEntries_G) + 1;
+	params.bitSize = bitSize_G;
+	params.crc = crc_G;
+	if (generate_ids(&params, &ids_p) != 0) {
+		printf("please either increase the bit size or reduce the number of max entries\n");
 		return -1;
+	}
+
+	return bussim_init(sim_p, ids_p, params.count, bitSize_G);
+}
+
+/**
+ * flag alarmPercent_G% of the devices, picked at random from the bus' seed
+ * (its own stream, not the one the population was drawn from)
+ */
+static int
+random_alarms (BusSim_t *sim_p, uint64_t seed)
+{
+	size_t i, numAlarms;
+	uint64_t *alarms_p;
+	uint64_t state;
 
-	dataFile_p = fopen(fileName_p, "r");
-	if (dataFile_p == NULL) {
-		perror("open data file");
+	alarms_p = (uint64_t*)malloc((sim_p->devices.count? sim_p->devices.count : 1) * sizeof(uint64_t));
+	if (alarms_p == NULL) {
+		printf("can't allocate memory\n");
 		return -1;
 	}
 
-	// 1st line → entries
-	if (fgets(dataBuf, sizeof(dataBuf), dataFile_p) == NULL) {
-		perror("reading 1st line");
-		goto closeDataFile;
-	}
-	if (sscanf(dataBuf, "%i", &numEntries_G) != 1) {
-		perror("parsing numEntries");
-		goto closeDataFile;
-	}
+	state = seed ^ ALARM_SEED_SALT;
+	numAlarms = 0;
+	for (i=0; i<sim_p->devices.count; ++i)
+		if ((prng_next(&state) % 100) < (uint64_t)alarmPercent_G)
+			alarms_p[numAlarms++] = sim_p->devices.ids_p[i];
 
-	// 2nd line → bit size
-	if (fgets(dataBuf, sizeof(dataBuf), dataFile_p) == NULL) {
-		perror("reading 2nd line");
-		goto closeDataFile;
-	}
-	if (sscanf(dataBuf, "%i", &bitSize_G) != 1) {
-		perror("parsing bitSize");
-		goto closeDataFile;
+	if (bussim_set_alarms(sim_p, alarms_p, numAlarms) != 0) {
+		free(alarms_p);
+		return -1;
 	}
+	return 0;
+}
 
-	devices_pG = (Devices_t*)malloc((size_t)numEntries_G * sizeof(Devices_t));
-	if (devices_pG == NULL) {
-		printf("can't allocate memory\n");
-		goto closeDataFile;
+/**
+ * a bus' population: from the data file if there is one, random otherwise
+ * the faults (if any) are seeded from the bus' seed too
+ */
+static int
+setup_bus (BusSim_t *sim_p, const char *fileName_p, uint64_t seed)
+{
+	int ret;
+	BusSimFaults_t faults;
+
+	if (fileName_p != NULL)
+		ret = bussim_open(sim_p, fileName_p);
+	else
+		ret = use_random_data(sim_p, seed);
+	if (ret != 0) {
+		printf("bad device population\n");
+		return -1;
 	}
-	for (i=0; i<numEntries_G; ++i) {
-		if (fgets(dataBuf, sizeof(dataBuf), dataFile_p) == NULL) {
-			printf("error getting entry %i from data file\n", i);
-			goto postAllocFail;
-		}
-		if (sscanf(dataBuf, "%d", &ret) != 1) {
-			printf("error converting entry %i from data file\n", i);
-			goto postAllocFail;
+
+	if ((sim_p->alarmDevices.count == 0) && (alarmPercent_G > 0)) {
+		ret = random_alarms(sim_p, seed);
+		if (ret != 0) {
+			bussim_free(sim_p);
+			return -1;
 		}
-		devices_pG[i].deviceID = (uint64_t)ret;
-		devices_pG[i].inSearch = true;
 	}
 
-	if (dataFile_p != NULL)
-		fclose(dataFile_p);
+	if (faults_G.enabled) {
+		faults = faults_G;
+		faults.state += seed;
+		bussim_set_faults(sim_p, &faults);
+	}
+
 	return 0;
+}
 
-postAllocFail:
-	free(devices_pG);
-closeDataFile:
-	if (dataFile_p != NULL)
-		fclose(dataFile_p);
-	return fnRtn;
+/**
+ * the faults thrown at the master
+ */
+static void
+print_injected (const BusSim_t *sim_p)
+{
+	int i;
+
+	if (!sim_p->faults.enabled)
+		return;
+	printf("injected:");
+	for (i=0; i<BUSSIM_FAULTS; ++i)
+		printf(" %"PRIu64" %s", sim_p->faults.injected[i], bussim_fault_name((BusSimFault_e)i));
+	printf("\n");
 }
 
+/**
+ * serve buses 0..numBuses_G-1 from this one process: each has its own
+ * population, protocol state and fifo pair, and whichever has commands
+ * waiting is served next
+ *
+ * with a data file, bus <n> gets <file>.<n>; random populations are seeded
+ * with seed_G + <n>
+ */
 static int
-use_random_data (void)
+serve_buses (void)
 {
-	int i, j;
-	bool duplicate;
-	uint64_t mask;
-	uint64_t nextRandVal;
-
-	/* preconds */
-	if (bitSize_G > 64)
+	int i, k, n, epollFd;
+	int fnRtn = -1;
+	volatile int live;
+	VirtualBus_t *buses_p, *bus_p;
+	struct epoll_event event, events[64];
+	char rxBuf[256], replies[256], name[PATH_MAX];
+	ssize_t retRead;
+	size_t len, cnt;
+	const char *quit_p;
+	uint64_t totalDevices;
+	BusSlots_t totalSlots;
+	BusSpeed_e speed;
+
+	buses_p = (VirtualBus_t*)calloc((size_t)numBuses_G, sizeof(VirtualBus_t));
+	if (buses_p == NULL) {
+		perror("calloc");
 		return -1;
-
-	// create mask
-	mask = 0;
-	for (i=0; i<bitSize_G; ++i)
-		mask |= (uint64_t)(1llu << i);
-
-	// make sure the max number of entries is sensible wrt the chosen bit size
-	// a quick and easy way is to ensure the max entries is a magnitude
-	// smaller than the number of bits
-	if ((uint64_t)maxEntries_G > (mask>>1)) {
-		printf("the given bit size (%d) is not high enough to randomly\n", bitSize_G);
-		printf("generate the requested number of max entries (%d)\n\n", maxEntries_G);
-		printf("please either increase the bit size\n");
-		printf("or reduce the number of max entries to %lu or less\n", (mask>>1));
+	}
+	epollFd = epoll_create1(0);
+	if (epollFd == -1) {
+		perror("epoll_create1");
+		free(buses_p);
 		return -1;
 	}
 
-	srandom((unsigned)time(NULL));
-	numEntries_G = ((int)random() % (maxEntries_G)) + 1;
-
-	devices_pG = (Devices_t*)malloc((size_t)numEntries_G * sizeof(Devices_t));
-	if (devices_pG == NULL) {
-		printf("can't allocate memory\n");
-		return -1;
+	totalDevices = 0;
+	for (i=0; i<numBuses_G; ++i) {
+		bus_p = &buses_p[i];
+		if (dataFile_pG != NULL)
+			snprintf(name, sizeof(name), "%s.%d", dataFile_pG, i);
+		if (setup_bus(&bus_p->sim, (dataFile_pG != NULL)? name : NULL, seed_G + (uint64_t)i) != 0) {
+			printf("bus%d: can't set up its devices\n", i);
+			goto cleanup;
+		}
+		totalDevices += bus_p->sim.devices.count;
+		if (traceFile_pG != NULL) {
+			snprintf(name, sizeof(name), "%s.%d", traceFile_pG, i);
+			if (trace_open(&bus_p->trace, name, traceEvents_G, bus_p->sim.devices.bitSize) != 0)
+				goto cleanup;
+			bus_p->sim.trace_p = &bus_p->trace;
+		}
+		if (transport_open(&bus_p->transport, TRANSPORT_FIFO, TRANSPORT_TESTER, false, i) != 0)
+			goto cleanup;
+		bus_p->open = true;
+
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.u32 = (uint32_t)i;
+		if (epoll_ctl(epollFd, EPOLL_CTL_ADD, bus_p->transport.recvFd, &event) != 0) {
+			perror("epoll_ctl");
+			goto cleanup;
+		}
 	}
+	printf("seed: %"PRIu64"\n", seed_G);
+	printf("buses: %d\n", numBuses_G);
+	printf("devices: %"PRIu64"\n", totalDevices);
+	fflush(stdout);
 
-	// generate unique entries
-	for (i=0; i<numEntries_G; ++i) {
-		nextRandVal = ((uint64_t)random() * (uint64_t)random()) & mask;
-		duplicate = false;
-		for (j=0; j<i; ++j)
-			if (devices_pG[j].deviceID == nextRandVal) {
-				duplicate = true;
-				break;
+	live = numBuses_G;
+	setup_signal_handler();
+	if (setjmp(env_G) != 0)
+		live = 0;
+
+	while (live > 0) {
+		n = epoll_wait(epollFd, events, (int)(sizeof(events) / sizeof(events[0])), -1);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			break;
+		}
+		for (k=0; k<n; ++k) {
+			bus_p = &buses_p[events[k].data.u32];
+			retRead = transport_recv(&bus_p->transport, rxBuf, sizeof(rxBuf));
+			if (retRead <= 0) {
+				if (retRead == -1)
+					perror("read transport");
+				quit_p = rxBuf;
+				len = 0;
+			}
+			else {
+				len = (size_t)retRead;
+				quit_p = (const char*)memchr(rxBuf, 'Q', len);
+				if (quit_p != NULL)
+					len = (size_t)(quit_p - rxBuf);
 			}
 
-		if (duplicate) {
-			--i;
-			continue;
-		}
+			cnt = bussim_process(&bus_p->sim, rxBuf, len, replies);
+			if ((cnt > 0) && (transport_send(&bus_p->transport, replies, cnt) != 0))
+				quit_p = rxBuf;
 
-		devices_pG[i].deviceID = nextRandVal;
-		devices_pG[i].inSearch = true;
+			// this bus' master is finished (or gone)
+			if (quit_p != NULL) {
+				epoll_ctl(epollFd, EPOLL_CTL_DEL, bus_p->transport.recvFd, NULL);
+				--live;
+			}
+		}
 	}
 
-	return 0;
+	// what the whole rack would have cost on real wires
+	memset(&totalSlots, 0, sizeof(totalSlots));
+	for (i=0; i<numBuses_G; ++i)
+		busslots_merge(&totalSlots, &buses_p[i].sim.slots);
+	printf("\nbus: %"PRIu64" reset(s) %"PRIu64" read slot(s) %"PRIu64" write slot(s)\n",
+			busslots_resets(&totalSlots), busslots_reads(&totalSlots), busslots_writes(&totalSlots));
+	printf("bus time: %.3f ms\n", busslots_time_us(&totalSlots) / 1000.0);
+	for (speed=BUS_STANDARD; speed<BUS_SPEEDS; ++speed)
+		printf("bus time: all %s %.3f ms\n", bus_speed_name(speed),
+				busslots_time_at_us(&totalSlots, speed) / 1000.0);
+	for (i=0; i<numBuses_G; ++i) {
+		if (!buses_p[i].sim.faults.enabled)
+			continue;
+		printf("bus%d ", i);
+		print_injected(&buses_p[i].sim);
+	}
+	fnRtn = 0;
+
+cleanup:
+	for (i=0; i<numBuses_G; ++i) {
+		if (buses_p[i].open)
+			transport_close(&buses_p[i].transport);
+		bussim_free(&buses_p[i].sim);
+		trace_close(&buses_p[i].trace);
+	}
+	close(epollFd);
+	free(buses_p);
+	return fnRtn;
 }
 
 static int
@@ -398,15 +557,28 @@ process_cmdline_args (int argc, char *argv[])
 	int c, ret;
 	bool bitSizeSpecified = false;
 	bool maxEntriesSpecified = false;
+	bool seedSpecified = false;
+	char *end_p;
 	struct option longOpts[] = {
 		{"help", no_argument, NULL, 'h'},
 		{"bitsize", required_argument, NULL, 'b'},
 		{"max-devices", required_argument, NULL, 'm'},
+		{"transport", required_argument, NULL, 't'},
+		{"busy-poll", no_argument, NULL, 'B'},
+		{"bus", required_argument, NULL, 'n'},
+		{"buses", required_argument, NULL, 'N'},
+		{"alarm", required_argument, NULL, 'a'},
+		{"seed", required_argument, NULL, 's'},
+		{"distribution", required_argument, NULL, 'g'},
+		{"crc", no_argument, NULL, 'c'},
+		{"trace", required_argument, NULL, 'T'},
+		{"trace-events", required_argument, NULL, 'E'},
+		{"inject", required_argument, NULL, 'i'},
 		{NULL, 0, NULL, 0},
 	};
 
 	while (1) {
-		c = getopt_long(argc, argv, "hb:m:", longOpts, 0);
+		c = getopt_long(argc, argv, "hb:m:t:Bn:N:a:s:g:cT:E:i:", longOpts, 0);
 		if (c == -1)
 			break;
 		switch (c) {
@@ -441,28 +613,117 @@ process_cmdline_args (int argc, char *argv[])
 				maxEntriesSpecified = true;
 				break;
 
+			case 't':
+				if ((transport_parse_type(optarg, &transportType_G) != 0) ||
+						(transportType_G == TRANSPORT_SIM)) {
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+
+			case 'B':
+				busyPoll_G = true;
+				break;
+
+			case 'n':
+				if ((sscanf(optarg, "%i", &ret) != 1) || (ret < 0)) {
+					usage(argv[0]);
+					return -1;
+				}
+				busNum_G = ret;
+				break;
+
+			case 'N':
+				if ((sscanf(optarg, "%i", &ret) != 1) || (ret < 1)) {
+					usage(argv[0]);
+					return -1;
+				}
+				numBuses_G = ret;
+				break;
+
+			case 'a':
+				if ((sscanf(optarg, "%i", &ret) != 1) || (ret < 0) || (ret > 100)) {
+					usage(argv[0]);
+					return -1;
+				}
+				alarmPercent_G = ret;
+				break;
+
+			case 's':
+				seed_G = strtoull(optarg, &end_p, 0);
+				if ((*optarg == '\0') || (*end_p != '\0')) {
+					usage(argv[0]);
+					return -1;
+				}
+				seedSpecified = true;
+				break;
+
+			case 'g':
+				if (generate_parse_distribution(optarg, &distribution_G) != 0) {
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+
+			case 'c':
+				crc_G = true;
+				break;
+
+			case 'T':
+				traceFile_pG = optarg;
+				break;
+
+			case 'E':
+				traceEvents_G = strtoull(optarg, &end_p, 0);
+				if ((*optarg == '\0') || (*optarg == '-') || (*end_p != '\0') || (traceEvents_G == 0)) {
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+
+			case 'i':
+				if (bussim_parse_faults(optarg, &faults_G) != 0) {
+					printf("bad fault spec: %s\n", optarg);
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+
 			default:
 				printf("cmdline arg error: %c (0x%02x)\n", c, c);
 		}
 	}
 
-	ret = 0;
-	if (argc == optind)
-		ret = use_random_data();
-	else if (argc == (optind + 1)) {
+	if (!seedSpecified)
+		seed_G = (uint64_t)time(NULL);
+
+	if (argc == (optind + 1)) {
 		if (bitSizeSpecified || maxEntriesSpecified) {
 			printf("WARNING: specifying the bit size and/or max entries on the cmdline\n");
 			printf("         is not compatible with using pre-generated data from a file\n");
 			printf("these cmdline options will be ignored in favour of the values from the datafile\n");
 		}
-		ret = get_data_from_file(argv[optind]);
+		dataFile_pG = argv[optind];
 	}
-	else {
+	else if (argc != optind) {
 		usage(argv[0]);
 		return -1;
 	}
-	if (ret != 0)
-		return -1;
+
+	if (crc_G) {
+		if (bitSizeSpecified && (bitSize_G != CRC8_ROM_BITS)) {
+			printf("CRC8 IDs (-c) are %d bits\n", CRC8_ROM_BITS);
+			return -1;
+		}
+		bitSize_G = CRC8_ROM_BITS;
+	}
+
+	if (numBuses_G != 0) {
+		if ((transportType_G != TRANSPORT_FIFO) || (busNum_G != -1)) {
+			printf("a multi-bus tester (-N) serves fifos 0..<n>-1 itself, it can't be used with -t or -n\n");
+			return -1;
+		}
+	}
 
 	return 0;
 }
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "common.h"
+#include "trace.h"
+
+/**
+ * create (or truncate) a trace file that holds the last capacity events
+ * capacity is rounded up to a power of 2
+ */
+int
+trace_open (Trace_t *trace_p, const char *fileName_p, uint64_t capacity, int bitSize)
+{
+	int fd;
+	uint64_t cap;
+
+	/* preconds */
+	if ((trace_p == NULL) || (fileName_p == NULL) || (capacity == 0))
+		return -1;
+	if (capacity > (SIZE_MAX / 2 / sizeof(TraceEvent_t)))
+		return -1;
+
+	memset(trace_p, 0, sizeof(*trace_p));
+	for (cap=1; cap<capacity; cap<<=1)
+		;
+	trace_p->mapLen = sizeof(TraceHeader_t) + ((size_t)cap * sizeof(TraceEvent_t));
+
+	fd = open(fileName_p, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		perror("open trace file");
+		return -1;
+	}
+	if (ftruncate(fd, (off_t)trace_p->mapLen) != 0) {
+		perror("size trace file");
+		close(fd);
+		return -1;
+	}
+	trace_p->map_p = mmap(NULL, trace_p->mapLen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (trace_p->map_p == MAP_FAILED) {
+		perror("mmap trace file");
+		trace_p->map_p = NULL;
+		return -1;
+	}
+
+	trace_p->hdr_p = (TraceHeader_t*)trace_p->map_p;
+	memcpy(trace_p->hdr_p->magic, TRACE_MAGIC, sizeof(trace_p->hdr_p->magic));
+	trace_p->hdr_p->version = TRACE_VERSION;
+	trace_p->hdr_p->eventSize = sizeof(TraceEvent_t);
+	trace_p->hdr_p->capacity = cap;
+	trace_p->hdr_p->bitSize = (uint32_t)bitSize;
+	trace_p->events_p = (TraceEvent_t*)(trace_p->hdr_p + 1);
+	trace_p->mask = cap - 1;
+	trace_p->startNs = monotonic_ns();
+	return 0;
+}
+
+/**
+ * map an existing trace file to decode it
+ */
+int
+trace_map (Trace_t *trace_p, const char *fileName_p)
+{
+	int fd;
+	struct stat st;
+	TraceHeader_t *hdr_p;
+
+	/* preconds */
+	if ((trace_p == NULL) || (fileName_p == NULL))
+		return -1;
+
+	memset(trace_p, 0, sizeof(*trace_p));
+	fd = open(fileName_p, O_RDONLY);
+	if (fd == -1) {
+		perror("open trace file");
+		return -1;
+	}
+	if (fstat(fd, &st) != 0) {
+		perror("stat trace file");
+		close(fd);
+		return -1;
+	}
+	if ((size_t)st.st_size < sizeof(TraceHeader_t)) {
+		printf("%s: not a trace\n", fileName_p);
+		close(fd);
+		return -1;
+	}
+	trace_p->mapLen = (size_t)st.st_size;
+	trace_p->map_p = mmap(NULL, trace_p->mapLen, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (trace_p->map_p == MAP_FAILED) {
+		perror("mmap trace file");
+		trace_p->map_p = NULL;
+		return -1;
+	}
+
+	hdr_p = (TraceHeader_t*)trace_p->map_p;
+	if ((memcmp(hdr_p->magic, TRACE_MAGIC, sizeof(hdr_p->magic)) != 0) ||
+			(hdr_p->version != TRACE_VERSION) || (hdr_p->eventSize != sizeof(TraceEvent_t)) ||
+			(hdr_p->capacity == 0) || (hdr_p->capacity & (hdr_p->capacity - 1)) ||
+			(hdr_p->capacity > ((trace_p->mapLen - sizeof(*hdr_p)) / sizeof(TraceEvent_t)))) {
+		printf("%s: not a trace (or a broken one)\n", fileName_p);
+		trace_close(trace_p);
+		return -1;
+	}
+	trace_p->hdr_p = hdr_p;
+	trace_p->events_p = (TraceEvent_t*)(hdr_p + 1);
+	trace_p->mask = hdr_p->capacity - 1;
+	return 0;
+}
+
+void
+trace_close (Trace_t *trace_p)
+{
+	/* preconds */
+	if (trace_p == NULL)
+		return;
+
+	if (trace_p->map_p != NULL)
+		munmap(trace_p->map_p, trace_p->mapLen);
+	memset(trace_p, 0, sizeof(*trace_p));
+}
+
+/**
+ * record a command, with the state it is about to run against
+ * the caller fills in the reply (if any) once it has one
+ */
+TraceEvent_t *
+trace_begin (Trace_t *trace_p, char cmd, int bitPos, int readState, size_t active)
+{
+	TraceEvent_t *event_p;
+
+	/* preconds */
+	if ((trace_p == NULL) || (trace_p->hdr_p == NULL))
+		return NULL;
+
+	event_p = &trace_p->events_p[trace_p->hdr_p->written & trace_p->mask];
+	event_p->ns = monotonic_ns() - trace_p->startNs;
+	event_p->active = (active > UINT32_MAX)? UINT32_MAX : (uint32_t)active;
+	event_p->bitPos = (uint8_t)bitPos;
+	event_p->readState = (uint8_t)readState;
+	event_p->cmd = cmd;
+	event_p->reply = 0;
+	++trace_p->hdr_p->written;
+	return event_p;
+}
+
+/**
+ * the oldest event still in the ring
+ */
+uint64_t
+trace_first (const Trace_t *trace_p)
+{
+	/* preconds */
+	if ((trace_p == NULL) || (trace_p->hdr_p == NULL))
+		return 0;
+
+	if (trace_p->hdr_p->written > trace_p->hdr_p->capacity)
+		return trace_p->hdr_p->written - trace_p->hdr_p->capacity;
+	return 0;
+}
+
+/**
+ * event n (counting from the start of the trace), NULL if it's not in the
+ * ring (anymore)
+ */
+const TraceEvent_t *
+trace_event (const Trace_t *trace_p, uint64_t n)
+{
+	/* preconds */
+	if ((trace_p == NULL) || (trace_p->hdr_p == NULL))
+		return NULL;
+
+	if ((n < trace_first(trace_p)) || (n >= trace_p->hdr_p->written))
+		return NULL;
+	return &trace_p->events_p[n & trace_p->mask];
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#ifndef ROM_SEARCH_TRACE__H
+#define ROM_SEARCH_TRACE__H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * binary trace of the commands a simulated bus sees: one fixed-size event
+ * per command, into a ring in a shared file mapping (so it is there to
+ * decode even if the process dies), ROMtrace decodes it
+ *
+ *	header (TraceHeader_t, 64 bytes)
+ *	capacity × TraceEvent_t
+ *
+ * event n lives in slot (n % capacity), the ring holds the last "capacity"
+ * of the "written" events; the state recorded is that seen by the command,
+ * i.e. from before it ran
+ */
+#define TRACE_MAGIC "ROMt"
+#define TRACE_VERSION 1
+#define TRACE_DEFAULT_EVENTS (1u << 20)
+
+typedef struct {
+	char magic[4];
+	uint16_t version;
+	uint16_t eventSize;
+	uint64_t capacity;
+	uint64_t written;
+	uint32_t bitSize;
+	uint32_t reserved[9];
+} TraceHeader_t;
+
+typedef struct {
+	uint64_t ns;		// since the trace was opened
+	uint32_t active;	// devices still in the running
+	uint8_t bitPos;
+	uint8_t readState;
+	char cmd;
+	char reply;		// '0' or '1' for a read, 0 otherwise
+} TraceEvent_t;
+
+typedef struct {
+	void *map_p;
+	size_t mapLen;
+	TraceHeader_t *hdr_p;
+	TraceEvent_t *events_p;
+	uint64_t mask;
+	uint64_t startNs;
+} Trace_t;
+
+int trace_open (Trace_t *trace_p, const char *fileName_p, uint64_t capacity, int bitSize);
+int trace_map (Trace_t *trace_p, const char *fileName_p);
+void trace_close (Trace_t *trace_p);
+TraceEvent_t *trace_begin (Trace_t *trace_p, char cmd, int bitPos, int readState, size_t active);
+uint64_t trace_first (const Trace_t *trace_p);
+const TraceEvent_t *trace_event (const Trace_t *trace_p, uint64_t n);
+
+#endif
@@ -0,0 +1,627 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "common.h"
+#include "transport.h"
+
+// shared-memory ring
+static int
+futex_wait (_Atomic uint32_t *addr_p, uint32_t val, const struct timespec *timeout_p)
+{
+	return (int)syscall(SYS_futex, (uint32_t*)addr_p, FUTEX_WAIT, val, timeout_p, NULL, 0);
+}
+
+static void
+futex_wake (_Atomic uint32_t *addr_p)
+{
+	syscall(SYS_futex, (uint32_t*)addr_p, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static inline void
+cpu_relax (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+/**
+ * wait until *addr_p no longer holds val
+ * optionally spin for a while first, then flag that we're waiting and sleep
+ * on the futex (the value is re-checked after the flag is raised so a wake
+ * can't be lost)
+ *
+ * the spin is bounded so busy-polling can't livelock both ends on a single
+ * cpu
+ *
+ * with a timeout (ms, 0: none) it gives up after that long and returns -1
+ */
+#define BUSY_POLL_SPINS (1u << 16)
+static int
+ring_wait_change (_Atomic uint32_t *addr_p, uint32_t val, _Atomic uint32_t *waiting_p, bool busyPoll,
+		int timeoutMs, TransportStats_t *stats_p)
+{
+	uint32_t spins;
+	uint64_t deadline = 0, now;
+	struct timespec left;
+	int ret = 0;
+
+	if (busyPoll) {
+		for (spins=0; spins<BUSY_POLL_SPINS; ++spins) {
+			if (atomic_load_explicit(addr_p, memory_order_acquire) != val)
+				return 0;
+			cpu_relax();
+		}
+	}
+
+	if (timeoutMs > 0)
+		deadline = monotonic_ns() + ((uint64_t)timeoutMs * 1000000);
+	atomic_store(waiting_p, 1);
+	while (atomic_load(addr_p) == val) {
+		if (deadline != 0) {
+			now = monotonic_ns();
+			if (now >= deadline) {
+				ret = -1;
+				break;
+			}
+			left.tv_sec = (time_t)((deadline - now) / 1000000000);
+			left.tv_nsec = (long)((deadline - now) % 1000000000);
+			futex_wait(addr_p, val, &left);
+		}
+		else
+			futex_wait(addr_p, val, NULL);
+		++stats_p->futexWaits;
+	}
+	atomic_store(waiting_p, 0);
+	return ret;
+}
+
+static ShmRing_t *
+ring_open (const char *name_p)
+{
+	int fd;
+	void *map_p;
+
+	/* preconds */
+	if (name_p == NULL)
+		return NULL;
+
+	fd = shm_open(name_p, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	if (fd == -1)
+		return NULL;
+	if (ftruncate(fd, sizeof(ShmRing_t)) != 0) {
+		close(fd);
+		return NULL;
+	}
+	map_p = mmap(NULL, sizeof(ShmRing_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map_p == MAP_FAILED)
+		return NULL;
+
+	return (ShmRing_t*)map_p;
+}
+
+static void
+ring_reset (ShmRing_t *ring_p)
+{
+	atomic_store(&ring_p->head, 0);
+	atomic_store(&ring_p->tail, 0);
+	atomic_store(&ring_p->consumerWaiting, 0);
+	atomic_store(&ring_p->producerWaiting, 0);
+}
+
+static int
+ring_write (ShmRing_t *ring_p, const char *buf_p, size_t len, bool busyPoll, TransportStats_t *stats_p)
+{
+	uint32_t head, tail, space, pos, n, first;
+
+	/* preconds */
+	if ((ring_p == NULL) || (buf_p == NULL))
+		return -1;
+
+	while (len > 0) {
+		head = atomic_load_explicit(&ring_p->head, memory_order_relaxed);
+		tail = atomic_load_explicit(&ring_p->tail, memory_order_acquire);
+		space = SHM_RING_SIZE - (head - tail);
+		if (space == 0) {
+			ring_wait_change(&ring_p->tail, tail, &ring_p->producerWaiting, busyPoll, 0, stats_p);
+			continue;
+		}
+
+		n = (len < space)? (uint32_t)len : space;
+		pos = head % SHM_RING_SIZE;
+		first = SHM_RING_SIZE - pos;
+		if (first > n)
+			first = n;
+		memcpy(&ring_p->buf[pos], buf_p, first);
+		memcpy(&ring_p->buf[0], buf_p + first, n - first);
+
+		atomic_store(&ring_p->head, head + n);
+		if (atomic_load(&ring_p->consumerWaiting)) {
+			futex_wake(&ring_p->head);
+			++stats_p->futexWakes;
+		}
+
+		buf_p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/**
+ * block until at least 1 byte is available, then take as many as fit
+ */
+static ssize_t
+ring_read (ShmRing_t *ring_p, char *buf_p, size_t len, bool busyPoll, int timeoutMs, TransportStats_t *stats_p)
+{
+	uint32_t head, tail, avail, pos, n, first;
+
+	/* preconds */
+	if ((ring_p == NULL) || (buf_p == NULL))
+		return -1;
+	if (len == 0)
+		return 0;
+
+	while (1) {
+		tail = atomic_load_explicit(&ring_p->tail, memory_order_relaxed);
+		head = atomic_load_explicit(&ring_p->head, memory_order_acquire);
+		avail = head - tail;
+		if (avail != 0)
+			break;
+		if (ring_wait_change(&ring_p->head, head, &ring_p->consumerWaiting, busyPoll, timeoutMs, stats_p) != 0)
+			return TRANSPORT_TIMEOUT;
+	}
+
+	n = (len < avail)? (uint32_t)len : avail;
+	pos = tail % SHM_RING_SIZE;
+	first = SHM_RING_SIZE - pos;
+	if (first > n)
+		first = n;
+	memcpy(buf_p, &ring_p->buf[pos], first);
+	memcpy(buf_p + first, &ring_p->buf[0], n - first);
+
+	atomic_store(&ring_p->tail, tail + n);
+	if (atomic_load(&ring_p->producerWaiting)) {
+		futex_wake(&ring_p->tail);
+		++stats_p->futexWakes;
+	}
+
+	return (ssize_t)n;
+}
+
+// fifo
+static int
+fifo_write (int fd, const char *buf_p, size_t len, TransportStats_t *stats_p)
+{
+	ssize_t retWrite;
+	struct pollfd pollFd[1];
+
+	/* preconds */
+	if (buf_p == NULL)
+		return -1;
+
+	pollFd[0].fd = fd;
+	pollFd[0].events = POLLOUT;
+
+	while (len > 0) {
+		retWrite = write(fd, buf_p, len);
+		++stats_p->writes;
+		if (retWrite < 0) {
+			if ((errno != EAGAIN) && (errno != EINTR))
+				return -1;
+			poll(pollFd, 1, -1);
+			++stats_p->polls;
+			continue;
+		}
+		buf_p += retWrite;
+		len -= (size_t)retWrite;
+	}
+
+	return 0;
+}
+
+static ssize_t
+fifo_read (int fd, char *buf_p, size_t len, int timeoutMs, TransportStats_t *stats_p)
+{
+	int ret;
+	ssize_t retRead;
+	struct pollfd pollFd[1];
+
+	/* preconds */
+	if (buf_p == NULL)
+		return -1;
+
+	pollFd[0].fd = fd;
+	pollFd[0].events = POLLIN;
+
+	while (1) {
+		ret = poll(pollFd, 1, (timeoutMs > 0)? timeoutMs : -1);
+		++stats_p->polls;
+		if (ret == 0)
+			return TRANSPORT_TIMEOUT;
+		if ((ret != 1) || (pollFd[0].revents != POLLIN)) {
+			if ((ret == -1) && (errno == EINTR))
+				continue;
+			return -1;
+		}
+		retRead = read(fd, buf_p, len);
+		++stats_p->reads;
+		if (retRead < 0) {
+			if ((errno == EAGAIN) || (errno == EINTR))
+				continue;
+			return -1;
+		}
+		return retRead;
+	}
+}
+
+// transport
+int
+transport_parse_type (const char *name_p, TransportType_e *typeOut_p)
+{
+	/* preconds */
+	if ((name_p == NULL) || (typeOut_p == NULL))
+		return -1;
+
+	if (strcmp(name_p, "fifo") == 0)
+		*typeOut_p = TRANSPORT_FIFO;
+	else if (strcmp(name_p, "shm") == 0)
+		*typeOut_p = TRANSPORT_SHM;
+	else if (strcmp(name_p, "sim") == 0)
+		*typeOut_p = TRANSPORT_SIM;
+	else
+		return -1;
+
+	return 0;
+}
+
+/**
+ * bus -1 is the one, unnumbered, bus; bus N uses the same names with ".N"
+ * appended so several tester/master pairs can run side by side
+ */
+int
+transport_open (Transport_t *transport_p, TransportType_e type, TransportSide_e side, bool busyPoll, int busNum)
+{
+	int ret;
+	int toTesterFd, fmTesterFd;
+	ShmRing_t *toTester_p, *fmTester_p;
+	const char *toBase_p, *fmBase_p;
+
+	/* preconds */
+	if (transport_p == NULL)
+		return -1;
+
+	memset(transport_p, 0, sizeof(*transport_p));
+	transport_p->type = type;
+	transport_p->side = side;
+	transport_p->busyPoll = busyPoll;
+	transport_p->sendFd = -1;
+	transport_p->recvFd = -1;
+
+	// nothing to set up until a simulator (or the I/O) is attached
+	if ((type == TRANSPORT_SIM) || (type == TRANSPORT_CUSTOM))
+		return (side == TRANSPORT_MASTER)? 0 : -1;
+
+	toBase_p = (type == TRANSPORT_SHM)? toTesterShmName_p : toTesterFifoName_p;
+	fmBase_p = (type == TRANSPORT_SHM)? fmTesterShmName_p : fmTesterFifoName_p;
+	if (busNum < 0) {
+		snprintf(transport_p->toTesterName, sizeof(transport_p->toTesterName), "%s", toBase_p);
+		snprintf(transport_p->fmTesterName, sizeof(transport_p->fmTesterName), "%s", fmBase_p);
+	}
+	else {
+		snprintf(transport_p->toTesterName, sizeof(transport_p->toTesterName), "%s.%d", toBase_p, busNum);
+		snprintf(transport_p->fmTesterName, sizeof(transport_p->fmTesterName), "%s.%d", fmBase_p, busNum);
+	}
+
+	switch (type) {
+		case TRANSPORT_FIFO:
+			ret = open_fifo(transport_p->toTesterName, &toTesterFd);
+			if (ret != 0) {
+				perror("mkfifo to tester");
+				return -1;
+			}
+			ret = open_fifo(transport_p->fmTesterName, &fmTesterFd);
+			if (ret != 0) {
+				perror("mkfifo fm tester");
+				close(toTesterFd);
+				unlink(transport_p->toTesterName);
+				return -1;
+			}
+			transport_p->sendFd = (side == TRANSPORT_MASTER)? toTesterFd : fmTesterFd;
+			transport_p->recvFd = (side == TRANSPORT_MASTER)? fmTesterFd : toTesterFd;
+			break;
+
+		case TRANSPORT_SHM:
+			toTester_p = ring_open(transport_p->toTesterName);
+			if (toTester_p == NULL) {
+				perror("shm to tester");
+				return -1;
+			}
+			fmTester_p = ring_open(transport_p->fmTesterName);
+			if (fmTester_p == NULL) {
+				perror("shm fm tester");
+				munmap(toTester_p, sizeof(ShmRing_t));
+				shm_unlink(transport_p->toTesterName);
+				return -1;
+			}
+			transport_p->send_p = (side == TRANSPORT_MASTER)? toTester_p : fmTester_p;
+			transport_p->recv_p = (side == TRANSPORT_MASTER)? fmTester_p : toTester_p;
+
+			// unlike a fifo, a ring outlives its users; the tester is
+			// started first so it throws away anything a dead master
+			// left behind
+			if (side == TRANSPORT_TESTER) {
+				ring_reset(toTester_p);
+				ring_reset(fmTester_p);
+			}
+			break;
+
+		default:
+			return -1;
+	}
+
+	return 0;
+}
+
+void
+transport_close (Transport_t *transport_p)
+{
+	/* preconds */
+	if (transport_p == NULL)
+		return;
+
+	switch (transport_p->type) {
+		case TRANSPORT_FIFO:
+			if (transport_p->sendFd != -1)
+				close(transport_p->sendFd);
+			if (transport_p->recvFd != -1)
+				close(transport_p->recvFd);
+			transport_p->sendFd = transport_p->recvFd = -1;
+			unlink(transport_p->fmTesterName);
+			unlink(transport_p->toTesterName);
+			break;
+
+		case TRANSPORT_SHM:
+			if (transport_p->send_p != NULL)
+				munmap(transport_p->send_p, sizeof(ShmRing_t));
+			if (transport_p->recv_p != NULL)
+				munmap(transport_p->recv_p, sizeof(ShmRing_t));
+			transport_p->send_p = transport_p->recv_p = NULL;
+			shm_unlink(transport_p->fmTesterName);
+			shm_unlink(transport_p->toTesterName);
+			break;
+
+		case TRANSPORT_SIM:
+			free(transport_p->replies_p);
+			transport_p->replies_p = NULL;
+			transport_p->repliesPos = transport_p->repliesLen = transport_p->repliesMax = 0;
+			transport_p->sim_p = NULL;
+			break;
+
+		case TRANSPORT_CUSTOM:
+			memset(&transport_p->io, 0, sizeof(transport_p->io));
+			break;
+	}
+}
+
+/**
+ * give a TRANSPORT_SIM transport the bus it talks to
+ * the simulator stays the caller's
+ */
+int
+transport_attach_sim (Transport_t *transport_p, BusSim_t *sim_p)
+{
+	/* preconds */
+	if ((transport_p == NULL) || (sim_p == NULL))
+		return -1;
+	if (transport_p->type != TRANSPORT_SIM)
+		return -1;
+
+	transport_p->sim_p = sim_p;
+	return 0;
+}
+
+/**
+ * give a TRANSPORT_CUSTOM transport the functions that move its bytes
+ */
+int
+transport_attach_io (Transport_t *transport_p, const TransportIo_t *io_p)
+{
+	/* preconds */
+	if ((transport_p == NULL) || (io_p == NULL))
+		return -1;
+	if ((transport_p->type != TRANSPORT_CUSTOM) || (io_p->send_p == NULL) || (io_p->recv_p == NULL))
+		return -1;
+
+	transport_p->io = *io_p;
+	return 0;
+}
+
+/**
+ * run the commands on the simulator straight away and queue its replies
+ */
+static int
+sim_write (Transport_t *transport_p, const char *buf_p, size_t len)
+{
+	char *newReplies_p;
+	size_t newMax;
+
+	if (transport_p->sim_p == NULL)
+		return -1;
+
+	// drop what's been read, then make room for a reply to every command
+	if (transport_p->repliesPos == transport_p->repliesLen)
+		transport_p->repliesPos = transport_p->repliesLen = 0;
+	if (transport_p->repliesLen + len > transport_p->repliesMax) {
+		newMax = transport_p->repliesMax? transport_p->repliesMax : 256;
+		while (transport_p->repliesLen + len > newMax)
+			newMax *= 2;
+		newReplies_p = realloc(transport_p->replies_p, newMax);
+		if (newReplies_p == NULL)
+			return -1;
+		transport_p->replies_p = newReplies_p;
+		transport_p->repliesMax = newMax;
+	}
+
+	transport_p->repliesLen += bussim_process(transport_p->sim_p, buf_p, len,
+			transport_p->replies_p + transport_p->repliesLen);
+	return 0;
+}
+
+/**
+ * nothing queued means nothing ever will be: report a timeout
+ */
+static ssize_t
+sim_read (Transport_t *transport_p, char *buf_p, size_t len)
+{
+	size_t avail;
+
+	avail = transport_p->repliesLen - transport_p->repliesPos;
+	if ((avail == 0) && (len > 0))
+		return TRANSPORT_TIMEOUT;
+	if (len > avail)
+		len = avail;
+	memcpy(buf_p, transport_p->replies_p + transport_p->repliesPos, len);
+	transport_p->repliesPos += len;
+	return (ssize_t)len;
+}
+
+int
+transport_send (Transport_t *transport_p, const char *buf_p, size_t len)
+{
+	/* preconds */
+	if ((transport_p == NULL) || (buf_p == NULL))
+		return -1;
+
+	transport_p->stats.bytesSent += len;
+	if (transport_p->type == TRANSPORT_SHM)
+		return ring_write(transport_p->send_p, buf_p, len, transport_p->busyPoll, &transport_p->stats);
+	if (transport_p->type == TRANSPORT_SIM)
+		return sim_write(transport_p, buf_p, len);
+	if (transport_p->type == TRANSPORT_CUSTOM) {
+		if (transport_p->io.send_p == NULL)
+			return -1;
+		return transport_p->io.send_p(transport_p->io.ctx_p, buf_p, len);
+	}
+	return fifo_write(transport_p->sendFd, buf_p, len, &transport_p->stats);
+}
+
+/**
+ * block until something arrives, then return up to len bytes of it
+ *
+ * return:
+ * >0: number of bytes placed in buf_p
+ *  0: the other end has gone away
+ * -1: failure
+ * TRANSPORT_TIMEOUT: nothing arrived in time
+ */
+ssize_t
+transport_recv (Transport_t *transport_p, char *buf_p, size_t len)
+{
+	ssize_t ret;
+
+	/* preconds */
+	if ((transport_p == NULL) || (buf_p == NULL))
+		return -1;
+
+	if (transport_p->type == TRANSPORT_SHM)
+		ret = ring_read(transport_p->recv_p, buf_p, len, transport_p->busyPoll, transport_p->timeoutMs,
+				&transport_p->stats);
+	else if (transport_p->type == TRANSPORT_SIM)
+		ret = sim_read(transport_p, buf_p, len);
+	else if (transport_p->type == TRANSPORT_CUSTOM)
+		ret = (transport_p->io.recv_p == NULL)? -1 :
+				transport_p->io.recv_p(transport_p->io.ctx_p, buf_p, len, transport_p->timeoutMs);
+	else
+		ret = fifo_read(transport_p->recvFd, buf_p, len, transport_p->timeoutMs, &transport_p->stats);
+	if (ret > 0)
+		transport_p->stats.bytesRecv += (uint64_t)ret;
+	return ret;
+}
+
+/**
+ * receive exactly len bytes
+ *
+ * return:
+ *  0: ok
+ *  1: timed out (some of the bytes may have been received)
+ * -1: failure
+ */
+int
+transport_recv_all (Transport_t *transport_p, char *buf_p, size_t len)
+{
+	ssize_t ret;
+
+	/* preconds */
+	if ((transport_p == NULL) || (buf_p == NULL))
+		return -1;
+
+	while (len > 0) {
+		ret = transport_recv(transport_p, buf_p, len);
+		if (ret == TRANSPORT_TIMEOUT)
+			return 1;
+		if (ret <= 0)
+			return -1;
+		buf_p += ret;
+		len -= (size_t)ret;
+	}
+
+	return 0;
+}
+
+/**
+ * after a timeout: throw away whatever is still on its way, so the next
+ * reply is the reply to the next command
+ * (only what turns up within the timeout, a transport without one only
+ * throws away what has already arrived)
+ */
+void
+transport_drain (Transport_t *transport_p)
+{
+	char buf[256];
+	int timeoutMs;
+
+	/* preconds */
+	if (transport_p == NULL)
+		return;
+
+	if (transport_p->type == TRANSPORT_SIM) {
+		transport_p->repliesPos = transport_p->repliesLen;
+		return;
+	}
+
+	timeoutMs = transport_p->timeoutMs;
+	if (timeoutMs <= 0)
+		transport_p->timeoutMs = 1;
+	while (transport_recv(transport_p, buf, sizeof(buf)) > 0)
+		;
+	transport_p->timeoutMs = timeoutMs;
+}
+
+uint64_t
+transport_syscalls (const TransportStats_t *stats_p)
+{
+	/* preconds */
+	if (stats_p == NULL)
+		return 0;
+
+	return stats_p->polls + stats_p->reads + stats_p->writes + stats_p->futexWaits + stats_p->futexWakes;
+}
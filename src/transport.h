@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#ifndef ROM_SEARCH_TRANSPORT__H
+#define ROM_SEARCH_TRANSPORT__H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include "bussim.h"
+
+// shared-memory single-producer/single-consumer byte ring
+// head/tail are free-running; the *Waiting flags tell the other side
+// a futex wake is needed
+#define SHM_RING_SIZE 4096
+typedef struct {
+	_Alignas(64) _Atomic uint32_t head;
+	_Atomic uint32_t consumerWaiting;
+	_Alignas(64) _Atomic uint32_t tail;
+	_Atomic uint32_t producerWaiting;
+	_Alignas(64) char buf[SHM_RING_SIZE];
+} ShmRing_t;
+
+#define toTesterShmName_p "/ROMsearch.toTester"
+#define fmTesterShmName_p "/ROMsearch.fmTester"
+#define TRANSPORT_NAME_MAX 64
+
+typedef enum {
+	TRANSPORT_FIFO,
+	TRANSPORT_SHM,
+	// no tester process, the master drives a bus simulator directly
+	TRANSPORT_SIM,
+	// the bytes are moved by functions the caller provides (see
+	// TransportIo_t), e.g. a driver for a real bus adapter
+	TRANSPORT_CUSTOM,
+} TransportType_e;
+
+// system calls made moving bytes (plain counters, so only ever touched by
+// the thread using the transport)
+typedef struct {
+	uint64_t polls;
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t futexWaits;
+	uint64_t futexWakes;
+	uint64_t bytesSent;
+	uint64_t bytesRecv;
+} TransportStats_t;
+
+// which end of the link this process is
+// the master (ROMsearch) sends to the tester, the tester sends to the master
+typedef enum {
+	TRANSPORT_MASTER,
+	TRANSPORT_TESTER,
+} TransportSide_e;
+
+// transport_recv(): nothing arrived within the timeout
+#define TRANSPORT_TIMEOUT (-2)
+
+// TRANSPORT_CUSTOM: send_p() takes all len bytes (0, or -1 on failure);
+// recv_p() waits up to timeoutMs (0: forever) for up to len bytes and
+// returns how many it got, or what transport_recv() would
+typedef struct {
+	int (*send_p) (void *ctx_p, const char *buf_p, size_t len);
+	ssize_t (*recv_p) (void *ctx_p, char *buf_p, size_t len, int timeoutMs);
+	void *ctx_p;
+} TransportIo_t;
+
+typedef struct {
+	TransportType_e type;
+	TransportSide_e side;
+	bool busyPoll;
+	// how long a receive waits for something to arrive (ms), 0: forever
+	// (the sim transport never waits: what isn't queued isn't coming)
+	int timeoutMs;
+	char toTesterName[TRANSPORT_NAME_MAX];
+	char fmTesterName[TRANSPORT_NAME_MAX];
+
+	// TRANSPORT_FIFO
+	int sendFd;
+	int recvFd;
+
+	// TRANSPORT_SHM
+	ShmRing_t *send_p;
+	ShmRing_t *recv_p;
+
+	// TRANSPORT_SIM
+	// replies are produced as the commands are sent and wait here
+	BusSim_t *sim_p;
+	char *replies_p;
+	size_t repliesPos;
+	size_t repliesLen;
+	size_t repliesMax;
+
+	// TRANSPORT_CUSTOM
+	TransportIo_t io;
+
+	TransportStats_t stats;
+} Transport_t;
+
+int transport_parse_type (const char *name_p, TransportType_e *typeOut_p);
+int transport_open (Transport_t *transport_p, TransportType_e type, TransportSide_e side, bool busyPoll, int busNum);
+int transport_attach_sim (Transport_t *transport_p, BusSim_t *sim_p);
+int transport_attach_io (Transport_t *transport_p, const TransportIo_t *io_p);
+void transport_close (Transport_t *transport_p);
+int transport_send (Transport_t *transport_p, const char *buf_p, size_t len);
+ssize_t transport_recv (Transport_t *transport_p, char *buf_p, size_t len);
+int transport_recv_all (Transport_t *transport_p, char *buf_p, size_t len);
+void transport_drain (Transport_t *transport_p);
+uint64_t transport_syscalls (const TransportStats_t *stats_p);
+
+#endif
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "workpool.h"
+
+int
+workpool_init (WorkPool_t *pool_p, int numDeques)
+{
+	int i;
+
+	/* preconds */
+	if (pool_p == NULL)
+		return -1;
+	if (numDeques < 1)
+		return -1;
+
+	memset(pool_p, 0, sizeof(*pool_p));
+	pool_p->deques_p = (WorkDeque_t*)calloc((size_t)numDeques, sizeof(WorkDeque_t));
+	if (pool_p->deques_p == NULL) {
+		perror("calloc");
+		return -1;
+	}
+	for (i=0; i<numDeques; ++i)
+		pthread_mutex_init(&pool_p->deques_p[i].lock, NULL);
+	pool_p->numDeques = numDeques;
+	atomic_init(&pool_p->outstanding, 0);
+	pthread_mutex_init(&pool_p->idleLock, NULL);
+	pthread_cond_init(&pool_p->idleCond, NULL);
+	atomic_init(&pool_p->pushes, 0);
+	atomic_init(&pool_p->idle, 0);
+
+	return 0;
+}
+
+void
+workpool_free (WorkPool_t *pool_p)
+{
+	int i;
+
+	/* preconds */
+	if (pool_p == NULL)
+		return;
+
+	for (i=0; i<pool_p->numDeques; ++i) {
+		pthread_mutex_destroy(&pool_p->deques_p[i].lock);
+		free(pool_p->deques_p[i].entries_p);
+	}
+	free(pool_p->deques_p);
+	pool_p->deques_p = NULL;
+	pool_p->numDeques = 0;
+	pthread_cond_destroy(&pool_p->idleCond);
+	pthread_mutex_destroy(&pool_p->idleLock);
+}
+
+/**
+ * wake up the idle workers, if there are any
+ * (pushes/outstanding are changed first: a worker on its way to sleep
+ * either sees that or is counted in idle, and then it's waiting by the
+ * time the lock is free)
+ */
+static void
+wake_idle (WorkPool_t *pool_p, bool always)
+{
+	if (!always && (atomic_load(&pool_p->idle) == 0))
+		return;
+	pthread_mutex_lock(&pool_p->idleLock);
+	pthread_cond_broadcast(&pool_p->idleCond);
+	pthread_mutex_unlock(&pool_p->idleLock);
+}
+
+int
+workpool_push (WorkPool_t *pool_p, int slot, const DeviceID_t *device_p)
+{
+	size_t newMax;
+	DeviceID_t *newEntries_p;
+	WorkDeque_t *deque_p;
+
+	/* preconds */
+	if (pool_p == NULL)
+		return -1;
+	if ((slot < 0) || (slot >= pool_p->numDeques))
+		return -1;
+	if (device_p == NULL)
+		return -1;
+
+	deque_p = &pool_p->deques_p[slot];
+	pthread_mutex_lock(&deque_p->lock);
+	if (deque_p->bottom == deque_p->max) {
+		if (deque_p->top > 0) {
+			// slide the live entries back down over the stolen ones
+			memmove(deque_p->entries_p, &deque_p->entries_p[deque_p->top], (deque_p->bottom - deque_p->top) * sizeof(DeviceID_t));
+			deque_p->bottom -= deque_p->top;
+			deque_p->top = 0;
+		}
+		else {
+			newMax = (deque_p->max == 0)? 64 : (2 * deque_p->max);
+			newEntries_p = (DeviceID_t*)realloc(deque_p->entries_p, newMax * sizeof(DeviceID_t));
+			if (newEntries_p == NULL) {
+				pthread_mutex_unlock(&deque_p->lock);
+				perror("realloc");
+				return -1;
+			}
+			deque_p->entries_p = newEntries_p;
+			deque_p->max = newMax;
+		}
+	}
+	deque_p->entries_p[deque_p->bottom++] = *device_p;
+	atomic_fetch_add(&pool_p->outstanding, 1);
+	pthread_mutex_unlock(&deque_p->lock);
+
+	atomic_fetch_add(&pool_p->pushes, 1);
+	wake_idle(pool_p, false);
+	return 0;
+}
+
+static bool
+deque_take (WorkDeque_t *deque_p, bool steal, DeviceID_t *deviceOut_p)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&deque_p->lock);
+	if (deque_p->top < deque_p->bottom) {
+		if (steal)
+			*deviceOut_p = deque_p->entries_p[deque_p->top++];
+		else
+			*deviceOut_p = deque_p->entries_p[--deque_p->bottom];
+		if (deque_p->top == deque_p->bottom)
+			deque_p->top = deque_p->bottom = 0;
+		found = true;
+	}
+	pthread_mutex_unlock(&deque_p->lock);
+
+	return found;
+}
+
+/**
+ * get the next piece of work for the worker in the given slot: its own newest
+ * entry, or failing that the oldest entry of one of the other workers
+ *
+ * sleeps while other workers are still busy (they might push more)
+ *
+ * return:
+ * true:  *deviceOut_p is to be searched, call workpool_done() after
+ * false: the search is over
+ */
+bool
+workpool_take (WorkPool_t *pool_p, int slot, DeviceID_t *deviceOut_p, uint64_t *stealsOut_p)
+{
+	int i, victim;
+	uint_fast64_t seen;
+
+	/* preconds */
+	if (pool_p == NULL)
+		return false;
+	if ((slot < 0) || (slot >= pool_p->numDeques))
+		return false;
+	if (deviceOut_p == NULL)
+		return false;
+
+	while (1) {
+		seen = atomic_load(&pool_p->pushes);
+		if (deque_take(&pool_p->deques_p[slot], false, deviceOut_p))
+			return true;
+
+		for (i=1; i<pool_p->numDeques; ++i) {
+			victim = (slot + i) % pool_p->numDeques;
+			if (deque_take(&pool_p->deques_p[victim], true, deviceOut_p)) {
+				if (stealsOut_p != NULL)
+					++(*stealsOut_p);
+				return true;
+			}
+		}
+
+		if (atomic_load(&pool_p->outstanding) == 0)
+			return false;
+
+		// nothing anywhere, wait for a push or the end
+		pthread_mutex_lock(&pool_p->idleLock);
+		atomic_fetch_add(&pool_p->idle, 1);
+		while ((atomic_load(&pool_p->pushes) == seen) && (atomic_load(&pool_p->outstanding) != 0))
+			pthread_cond_wait(&pool_p->idleCond, &pool_p->idleLock);
+		atomic_fetch_sub(&pool_p->idle, 1);
+		pthread_mutex_unlock(&pool_p->idleLock);
+	}
+}
+
+void
+workpool_done (WorkPool_t *pool_p)
+{
+	/* preconds */
+	if (pool_p == NULL)
+		return;
+
+	if (atomic_fetch_sub(&pool_p->outstanding, 1) == 1)
+		wake_idle(pool_p, true);
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2021  Trevor Woerner <twoerner@gmail.com>
+ * SPDX-License-Identifier: OSL-3.0
+ */
+
+#ifndef ROM_SEARCH_WORKPOOL__H
+#define ROM_SEARCH_WORKPOOL__H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "common.h"
+
+/**
+ * pending partial IDs shared by several workers searching the same device
+ * population through different connections
+ *
+ * each worker has its own deque: it pushes and pops its own work at the
+ * bottom (depth-first, like the work stack) and when it runs dry it steals
+ * from the top of someone else's, where the oldest, i.e. shallowest and
+ * therefore biggest, subtrees are
+ *
+ * outstanding counts entries that have been pushed but not yet finished, the
+ * search is over when it drops to 0
+ *
+ * a worker that finds nothing to take sleeps on idleCond until something is
+ * pushed (pushes changes) or the search is over, instead of spinning on the
+ * other workers' locks while they wait on their buses
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	DeviceID_t *entries_p;
+	size_t top;
+	size_t bottom;
+	size_t max;
+} WorkDeque_t;
+
+typedef struct {
+	WorkDeque_t *deques_p;
+	int numDeques;
+	atomic_size_t outstanding;
+	pthread_mutex_t idleLock;
+	pthread_cond_t idleCond;
+	atomic_uint_fast64_t pushes;
+	atomic_int idle;
+} WorkPool_t;
+
+int workpool_init (WorkPool_t *pool_p, int numDeques);
+void workpool_free (WorkPool_t *pool_p);
+int workpool_push (WorkPool_t *pool_p, int slot, const DeviceID_t *device_p);
+bool workpool_take (WorkPool_t *pool_p, int slot, DeviceID_t *deviceOut_p, uint64_t *stealsOut_p);
+void workpool_done (WorkPool_t *pool_p);
+
+#endif